@@ -0,0 +1,805 @@
+// CPU benchmarks for collision, transforms, rendering, world building and
+// lookup, run on generated scenes. Doesn't need a display, GL context or the
+// SketchUp SDK. Prints CSV with times per operation in nanoseconds, and
+// throughput (eg. rays per second). --verify checks optimized paths against
+// the simple ones instead.
+
+#include "collision.h"
+#include "collisionscene.h"
+#include "log.h"
+#include "commandbuffer.h"
+#include "render.h"
+#include "scenegen.h"
+#include "simplify.h"
+#include "spatialhash.h"
+#include "staticbatch.h"
+#include "stats.h"
+#include "texcompress.h"
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <ostream>
+#include <random>
+
+using namespace diorama;
+
+using Clock = std::chrono::steady_clock;
+
+// keeps results alive so the compiler can't skip the work
+static volatile float sink;
+
+struct BenchOptions
+{
+    SceneParams scene;
+    int iterations = 100;
+    string filter;  // only run benchmarks containing this
+};
+
+// instances and triangles per mesh, from 1k to 1M triangles and 10 to 100k
+// components
+const std::pair<int, int> SWEEP_SIZES[] = {
+    {10, 100}, {100, 100}, {1000, 100}, {1000, 1000}, {10000, 100},
+    {100000, 10}
+};
+
+template<typename Functor>
+static void benchmark(const BenchOptions &options, string name,
+                      int opsPerIteration, Functor f)
+{
+    if (name.find(options.filter) == string::npos)
+        return;
+    f();  // warm up
+    TimingHistory times(0);
+    for (int i = 0; i < options.iterations; i++) {
+        auto start = Clock::now();
+        f();
+        double ns = std::chrono::duration<double, std::nano>(
+            Clock::now() - start).count();
+        times.add(ns / opsPerIteration);
+    }
+    cout <<options.scene.components()<< "," <<options.scene.triangles()
+        << "," <<name<< "," <<opsPerIteration<< "," <<times.average()
+        << "," <<times.percentile(0.5)<< "," <<times.percentile(0.95)
+        << "," <<times.min()<< "," <<(1e9 / times.average())<< "\n";
+}
+
+static vector<Transform> randomTransforms(int count, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> unit(-1, 1);
+    vector<Transform> transforms;
+    for (int i = 0; i < count; i++) {
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), 1));
+        transforms.push_back(
+            Transform::translate(glm::vec3(unit(rng), unit(rng), unit(rng))
+                                 * 1000.0f)
+            * Transform::rotate(unit(rng) * 3.14f, axis)
+            * Transform::scale(glm::vec3(1.5f + unit(rng))));
+    }
+    return transforms;
+}
+
+static void benchTransforms(const BenchOptions &options, std::mt19937 &rng)
+{
+    const int COUNT = 1024;
+    vector<Transform> transforms = randomTransforms(COUNT, rng);
+    vector<Transform> results(COUNT);
+
+    benchmark(options, "transform.multiply", COUNT, [&]() {
+        for (int i = 0; i < COUNT; i++)
+            results[i] = transforms[i] * transforms[(i + 1) % COUNT];
+        sink = results[COUNT - 1].matrix()[3][0];
+    });
+    benchmark(options, "transform.inverse", COUNT, [&]() {
+        for (int i = 0; i < COUNT; i++)
+            results[i] = transforms[i].inverse();
+        sink = results[COUNT - 1].matrix()[3][0];
+    });
+    benchmark(options, "transform.transformPoint", COUNT, [&]() {
+        glm::vec3 p(1, 2, 3);
+        for (int i = 0; i < COUNT; i++)
+            p = transforms[i].transformPoint(p) * 0.001f;
+        sink = p.x;
+    });
+
+    vector<AffineTransform> affine(transforms.begin(), transforms.end());
+    vector<AffineTransform> affineResults(COUNT);
+    benchmark(options, "transform.affine.multiply", COUNT, [&]() {
+        for (int i = 0; i < COUNT; i++)
+            affineResults[i] = affine[i] * affine[(i + 1) % COUNT];
+        sink = affineResults[COUNT - 1].origin().x;
+    });
+    benchmark(options, "transform.affine.inverse", COUNT, [&]() {
+        for (int i = 0; i < COUNT; i++)
+            affineResults[i] = affine[i].inverse();
+        sink = affineResults[COUNT - 1].origin().x;
+    });
+    vector<glm::vec3> points(COUNT, glm::vec3(1, 2, 3)), transformed(COUNT);
+    benchmark(options, "transform.affine.transformPoints", COUNT, [&]() {
+        affine[0].transformPoints(points.data(), transformed.data(), COUNT);
+        sink = transformed[COUNT - 1].x;
+    });
+}
+
+static void benchCollision(const BenchOptions &options, const World &world,
+                           std::mt19937 &rng)
+{
+    const int COUNT = 256;
+    std::uniform_real_distribution<float> coord(
+        0, sceneExtent(options.scene));
+    vector<glm::vec3> points;
+    for (int i = 0; i < COUNT; i++)
+        points.push_back(glm::vec3(coord(rng), coord(rng), 0));
+
+    benchmark(options, "physics.raycast", COUNT, [&]() {
+        int hits = 0;
+        for (auto &point : points) {
+            auto collision = physics::raycast(&world,
+                point + glm::vec3(0, 0, 1000), Transform::DOWN);
+            if (collision.component)
+                hits++;
+        }
+        sink = hits;
+    });
+
+    // many rays from above in different directions, like line of sight checks
+    const int BATCH_SIZE = 4096;
+    std::uniform_real_distribution<float> slope(-0.5f, 0.5f);
+    vector<physics::Ray> rays;
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        rays.push_back(physics::Ray {
+            glm::vec3(coord(rng), coord(rng), 1000),
+            glm::vec3(slope(rng), slope(rng), -1)});
+    }
+    vector<physics::CollisionInfo> rayResults;
+    for (int threads : {1, 0}) {
+        string name = threads == 1 ? "physics.raycastBatch"
+            : "physics.raycastBatch.threaded";
+        benchmark(options, name, BATCH_SIZE, [&]() {
+            physics::raycastBatch(&world, rays, rayResults, threads);
+            sink = rayResults[0].point.x;
+        });
+    }
+
+    vector<physics::CollisionInfo> collisions;
+    benchmark(options, "physics.sphereCollision", COUNT, [&]() {
+        collisions.clear();
+        for (auto &point : points)
+            physics::sphereCollision(&world, point, 24, collisions);
+        sink = collisions.size();
+    });
+    benchmark(options, "physics.slideSphere", COUNT, [&]() {
+        glm::vec3 total(0);
+        for (auto &point : points) {
+            total += physics::slideSphere(&world, point + glm::vec3(0, 0, 50),
+                                          24, glm::vec3(300, 0, -100));
+        }
+        sink = total.x;
+    });
+}
+
+static void findDynamic(Component *component, vector<Component *> &dynamic)
+{
+    if (component->dynamic)
+        dynamic.push_back(component);
+    for (auto &child : component->children())
+        findDynamic(child, dynamic);
+}
+
+static void benchCollisionScene(const BenchOptions &options, World &world,
+                                std::mt19937 &rng)
+{
+    // built up front too, in case the filter skips the build benchmarks
+    auto scene = physics::CollisionScene::build(&world);
+    benchmark(options, "physics.scene.build", 1, [&]() {
+        scene = physics::CollisionScene::build(&world);
+    });
+    benchmark(options, "physics.scene.rebuild", 1, [&]() {
+        // reusing mesh BVHs
+        scene = physics::CollisionScene::build(&world, scene.get());
+    });
+
+    const int COUNT = 256;
+    std::uniform_real_distribution<float> coord(
+        0, sceneExtent(options.scene));
+    vector<glm::vec3> points;
+    for (int i = 0; i < COUNT; i++)
+        points.push_back(glm::vec3(coord(rng), coord(rng), 0));
+
+    benchmark(options, "physics.scene.raycast", COUNT, [&]() {
+        int hits = 0;
+        for (auto &point : points) {
+            auto collision = scene->raycast(point + glm::vec3(0, 0, 1000),
+                                            Transform::DOWN);
+            if (collision.component)
+                hits++;
+        }
+        sink = hits;
+    });
+    vector<physics::CollisionInfo> collisions;
+    benchmark(options, "physics.scene.sphereCollision", COUNT, [&]() {
+        collisions.clear();
+        for (auto &point : points)
+            scene->sphereCollision(point, 24, collisions);
+        sink = collisions.size();
+    });
+    benchmark(options, "physics.scene.slideSphere", COUNT, [&]() {
+        glm::vec3 total(0);
+        for (auto &point : points) {
+            total += scene->slideSphere(point + glm::vec3(0, 0, 50), 24,
+                                        glm::vec3(300, 0, -100));
+        }
+        sink = total.x;
+    });
+
+    // move every dynamic component back and forth, updating only those
+    vector<Component *> dynamic;
+    if (world.root())
+        findDynamic(world.root(), dynamic);
+    if (dynamic.empty())
+        return;
+    glm::vec3 offset(10, 0, 0);
+    benchmark(options, "physics.scene.update", (int)dynamic.size(), [&]() {
+        for (auto &component : dynamic)
+            component->tLocalMut() *= Transform::translate(offset);
+        scene = physics::CollisionScene::update(&world, scene.get());
+        offset = -offset;
+    });
+    if (offset.x < 0) {  // moved an odd number of times
+        for (auto &component : dynamic)
+            component->tLocalMut() *= Transform::translate(offset);
+    }
+}
+
+static void benchSpatialHash(const BenchOptions &options, World &world,
+                             std::mt19937 &rng)
+{
+    physics::SpatialHash hash;
+    hash.build(&world);
+    benchmark(options, "physics.hash.build", 1, [&]() {
+        hash.build(&world);
+    });
+
+    // same queries as the scene, compare with physics.scene.*
+    const int COUNT = 256;
+    std::uniform_real_distribution<float> coord(
+        0, sceneExtent(options.scene));
+    vector<glm::vec3> points;
+    for (int i = 0; i < COUNT; i++)
+        points.push_back(glm::vec3(coord(rng), coord(rng), 0));
+
+    vector<physics::CollisionInfo> collisions;
+    benchmark(options, "physics.hash.sphereCollision", COUNT, [&]() {
+        collisions.clear();
+        for (auto &point : points)
+            hash.sphereCollision(point, 24, collisions);
+        sink = collisions.size();
+    });
+    benchmark(options, "physics.hash.slideSphere", COUNT, [&]() {
+        glm::vec3 total(0);
+        for (auto &point : points) {
+            total += hash.slideSphere(point + glm::vec3(0, 0, 50), 24,
+                                      glm::vec3(300, 0, -100));
+        }
+        sink = total.x;
+    });
+
+    // move every dynamic component back and forth
+    vector<Component *> dynamic;
+    if (world.root())
+        findDynamic(world.root(), dynamic);
+    if (dynamic.empty())
+        return;
+    glm::vec3 offset(10, 0, 0);
+    benchmark(options, "physics.hash.update", (int)dynamic.size(), [&]() {
+        for (auto &component : dynamic)
+            component->tLocalMut() *= Transform::translate(offset);
+        hash.update(&world);
+        offset = -offset;
+    });
+    if (offset.x < 0) {  // moved an odd number of times
+        for (auto &component : dynamic)
+            component->tLocalMut() *= Transform::translate(offset);
+    }
+}
+
+// looking down at the middle of the scene from the south
+static Transform benchCamera(const SceneParams &scene)
+{
+    float center = sceneExtent(scene) / 2;
+    return Transform::translate(glm::vec3(center, -center, center))
+        * Transform::rotate(glm::radians(-30.0f), Transform::RIGHT);
+}
+
+static void benchRender(const BenchOptions &options, const World &world,
+                        const ShaderManager &shaders)
+{
+    render::NullBackend backend;
+    render::Renderer renderer(&shaders, &backend);
+    renderer.resizeWindow(1920, 1080);
+    renderer.setCameraParameters(glm::radians(60.0f), 5, 100000);
+    Transform camera = benchCamera(options.scene);
+
+    // drawHierarchy, sort and command recording
+    benchmark(options, "render.frame", 1, [&]() {
+        renderer.render(&world, camera);
+        sink = renderer.stats().drawCalls;
+    });
+    renderer.setOcclusionCulling(false);
+    benchmark(options, "render.frame.noOcclusion", 1, [&]() {
+        renderer.render(&world, camera);
+        sink = renderer.stats().drawCalls;
+    });
+
+    // simplifying one of the scene's meshes, as the loader does for each
+    // render primitive
+    const Component *patch = world.findComponent("patch0");
+    if (patch && patch->mesh && !patch->mesh->collision.empty()) {
+        const CollisionPrimitive &primitive = patch->mesh->collision[0];
+        vector<glm::vec3> normals(primitive.vertices.size(),
+                                  glm::vec3(0, 0, 1));
+        vector<MeshIndex> indices;
+        benchmark(options, "mesh.buildLods", 1, [&]() {
+            indices = primitive.indices;
+            sink = buildLods(primitive.vertices, normals, normals,
+                             indices).size();
+        });
+    }
+}
+
+static void benchStaticBatching(const BenchOptions &options,
+                                const ShaderManager &shaders)
+{
+    if (string("render.frame.batched").find(options.filter) == string::npos)
+        return;  // don't build another scene for nothing
+    World world;
+    generateScene(&world, options.scene, &shaders);
+    render::StaticBatchParams params;
+    params.upload = false;
+    render::buildStaticBatches(&world, params);
+
+    render::NullBackend backend;
+    render::Renderer renderer(&shaders, &backend);
+    renderer.resizeWindow(1920, 1080);
+    renderer.setCameraParameters(glm::radians(60.0f), 5, 100000);
+    Transform camera = benchCamera(options.scene);
+    benchmark(options, "render.frame.batched", 1, [&]() {
+        renderer.render(&world, camera);
+        sink = renderer.stats().drawCalls;
+    });
+}
+
+static void benchWorld(const BenchOptions &options, World &world,
+                       std::mt19937 &rng)
+{
+    const int COUNT = 1024;
+    std::uniform_int_distribution<int> index(0, options.scene.instances - 1);
+    vector<string> names;
+    for (int i = 0; i < COUNT; i++)
+        names.push_back("patch" + std::to_string(index(rng)));
+
+    benchmark(options, "world.findComponents", COUNT, [&]() {
+        int found = 0;
+        for (auto &name : names)
+            world.findComponents(name, [&](Component &) { found++; });
+        sink = found;
+    });
+
+    // more patterns than the cache holds, so this measures the index
+    vector<string> patterns;
+    for (int i = 0; i < COUNT; i++) {
+        string number = std::to_string(index(rng));
+        if (i % 2)
+            patterns.push_back("patch" + number.substr(0, 2) + "*");
+        else
+            patterns.push_back("*" + number.substr(number.size() / 2));
+    }
+    benchmark(options, "world.findComponents.glob", COUNT, [&]() {
+        int found = 0;
+        for (auto &pattern : patterns)
+            world.findComponents(pattern, [&](Component &) { found++; });
+        sink = found;
+    });
+    // the same few patterns every frame, like gameplay scripts
+    const int REPEATED = 16;
+    benchmark(options, "world.findComponents.cached", REPEATED, [&]() {
+        int found = 0;
+        for (int i = 0; i < REPEATED; i++)
+            world.findComponents(patterns[i], [&](Component &) { found++; });
+        sink = found;
+    });
+
+    // detaching and reattaching, like moving objects between rooms
+    vector<Component *> moving;
+    world.findComponents("patch*", [&](Component &component) {
+        if (moving.size() < COUNT)
+            moving.push_back(&component);
+    });
+    auto reparent = [&]() {
+        for (auto component : moving) {
+            Component *parent = component->parent();
+            component->setParent(nullptr);
+            component->setParent(parent);
+        }
+    };
+    benchmark(options, "world.reparent", (int)moving.size(), reparent);
+    benchmark(options, "world.reparent.batched", (int)moving.size(), [&]() {
+        World::Batch batch(&world);
+        reparent();
+    });
+}
+
+static void benchBuild(const BenchOptions &options,
+                       const ShaderManager &shaders)
+{
+    // stands in for the loader: building meshes and adding the hierarchy to
+    // a world. slow, so run fewer times
+    BenchOptions buildOptions = options;
+    buildOptions.iterations = glm::max(options.iterations / 10, 1);
+    benchmark(buildOptions, "world.build", 1, [&]() {
+        World world;
+        generateScene(&world, options.scene, &shaders);
+        sink = world.root()->children().size();
+    });
+}
+
+static void benchTextures(const BenchOptions &options, std::mt19937 &rng)
+{
+    // noisy gradient, encoded with mips as when loading an uncached texture
+    const int SIZE = 256;
+    vector<uint8_t> pixels(SIZE * SIZE * 4);
+    std::uniform_int_distribution<int> noise(0, 31);
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            uint8_t *pixel = &pixels[(y * SIZE + x) * 4];
+            pixel[0] = (uint8_t)(x / 2 + noise(rng));
+            pixel[1] = (uint8_t)(y / 2 + noise(rng));
+            pixel[2] = (uint8_t)((x + y) / 4 + noise(rng));
+            pixel[3] = 255;
+        }
+    }
+    BenchOptions compressOptions = options;
+    compressOptions.iterations = glm::max(options.iterations / 10, 1);
+    benchmark(compressOptions, "texture.compress", 1, [&]() {
+        CompressedImage image = compressImage(pixels.data(), SIZE, SIZE);
+        sink = image.levels[0][0];
+    });
+}
+
+static void runAll(const BenchOptions &options)
+{
+    ShaderManager shaders;  // programs are never linked
+    World world;
+    generateScene(&world, options.scene, &shaders);
+
+    std::mt19937 rng(options.scene.seed);
+    benchTransforms(options, rng);
+    benchCollision(options, world, rng);
+    benchCollisionScene(options, world, rng);
+    benchSpatialHash(options, world, rng);
+    benchRender(options, world, shaders);
+    benchStaticBatching(options, shaders);
+    benchWorld(options, world, rng);
+    benchBuild(options, shaders);
+    benchTextures(options, rng);
+}
+
+// --verify compares optimized paths with the simple ones they replace,
+// instead of timing them
+struct Verification
+{
+    string name;
+    float tolerance;
+    int checks = 0;
+    int failures = 0;
+    float maxError = 0;
+
+    void check(float error)
+    {
+        checks++;
+        maxError = glm::max(maxError, error);
+        if (!(error <= tolerance))  // catches NaN
+            failures++;
+    }
+};
+
+static bool report(const BenchOptions &options, const Verification &v)
+{
+    cout <<options.scene.components()<< "," <<options.scene.triangles()
+        << "," <<v.name<< "," <<v.checks<< "," <<v.failures
+        << "," <<v.maxError<< "," <<v.tolerance<< "\n";
+    return v.failures == 0;
+}
+
+// largest difference relative to the largest element
+static float matrixError(const glm::mat4 &a, const glm::mat4 &b)
+{
+    float diff = 0, scale = 1;
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            diff = glm::max(diff, glm::abs(a[c][r] - b[c][r]));
+            scale = glm::max(scale, glm::abs(b[c][r]));
+        }
+    }
+    return diff / scale;
+}
+
+static bool verifyTransforms(const BenchOptions &options, std::mt19937 &rng)
+{
+    const int COUNT = 1024;
+    vector<Transform> transforms = randomTransforms(COUNT, rng);
+    vector<AffineTransform> affine(transforms.begin(), transforms.end());
+
+    Verification multiply {"transform.affine.multiply", 1e-5f};
+    Verification inverse {"transform.affine.inverse", 1e-4f};
+    Verification points {"transform.affine.transformPoints", 1e-5f};
+    const int POINTS = 8;  // per transform
+    vector<glm::vec3> in, out(POINTS);
+    std::uniform_real_distribution<float> coord(-1000, 1000);
+    for (int i = 0; i < POINTS; i++)
+        in.push_back(glm::vec3(coord(rng), coord(rng), coord(rng)));
+    for (int i = 0; i < COUNT; i++) {
+        const glm::mat4 &a = transforms[i].matrix();
+        const glm::mat4 &b = transforms[(i + 1) % COUNT].matrix();
+        multiply.check(matrixError(
+            (affine[i] * affine[(i + 1) % COUNT]).matrix(), a * b));
+        inverse.check(matrixError(affine[i].inverse().matrix(),
+                                  glm::inverse(a)));
+        affine[i].transformPoints(in.data(), out.data(), POINTS);
+        for (int p = 0; p < POINTS; p++) {
+            glm::vec3 expected(a * glm::vec4(in[p], 1));
+            points.check(glm::length(out[p] - expected)
+                         / glm::max(1.0f, glm::length(expected)));
+        }
+    }
+    bool ok = report(options, multiply);
+    ok = report(options, inverse) && ok;
+    return report(options, points) && ok;
+}
+
+// distance between hit points, or infinite if only one of them hit
+static float hitError(const physics::CollisionInfo &a,
+                      const physics::CollisionInfo &b)
+{
+    if (!a.component && !b.component)
+        return 0;
+    if (!a.component || !b.component)
+        return std::numeric_limits<float>::infinity();
+    return glm::distance(a.point, b.point);
+}
+
+// hit points of other collision paths only match the World hierarchy walk
+// to within rounding
+static float pointTolerance(const SceneParams &scene)
+{
+    return sceneExtent(scene) * 1e-5f + 0.01f;
+}
+
+// from above the scene in different directions
+static vector<physics::Ray> randomRays(const SceneParams &scene, int count,
+                                       std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> coord(0, sceneExtent(scene));
+    std::uniform_real_distribution<float> slope(-0.5f, 0.5f);
+    vector<physics::Ray> rays;
+    for (int i = 0; i < count; i++) {
+        rays.push_back(physics::Ray {
+            glm::vec3(coord(rng), coord(rng), 1000),
+            glm::vec3(slope(rng), slope(rng), -1)});
+    }
+    return rays;
+}
+
+static bool verifyRaycastBatch(const BenchOptions &options,
+                               const World &world, std::mt19937 &rng)
+{
+    vector<physics::Ray> rays = randomRays(options.scene, 4096, rng);
+    bool ok = true;
+    vector<physics::CollisionInfo> results;
+    for (int threads : {1, 0}) {
+        Verification v {threads == 1 ? "physics.raycastBatch"
+            : "physics.raycastBatch.threaded",
+            pointTolerance(options.scene)};
+        physics::raycastBatch(&world, rays, results, threads);
+        for (size_t i = 0; i < rays.size(); i++) {
+            v.check(hitError(results[i], physics::raycast(
+                &world, rays[i].origin, rays[i].dir)));
+        }
+        ok = report(options, v) && ok;
+    }
+    return ok;
+}
+
+static bool verifySceneRaycast(const BenchOptions &options,
+                               const World &world,
+                               const physics::CollisionScene &scene,
+                               const string &name, std::mt19937 &rng)
+{
+    Verification v {name, pointTolerance(options.scene)};
+    for (auto &ray : randomRays(options.scene, 1024, rng)) {
+        v.check(hitError(scene.raycast(ray.origin, ray.dir),
+                         physics::raycast(&world, ray.origin, ray.dir)));
+    }
+    return report(options, v);
+}
+
+// sphere queries of a CollisionScene or SpatialHash, named prefix.*
+template<typename Collider>
+static bool verifySpheres(const BenchOptions &options, const World &world,
+                          const Collider &collider, const string &prefix,
+                          std::mt19937 &rng)
+{
+    const int COUNT = 1024;
+    std::uniform_real_distribution<float> coord(
+        0, sceneExtent(options.scene));
+    std::uniform_real_distribution<float> slope(-0.5f, 0.5f);
+    // every overlapping triangle is reported once, so counts match exactly
+    Verification sphere {prefix + ".sphereCollision", 0};
+    // slides take several steps, and rounding can change which surface is
+    // hit first near edges
+    Verification slide {prefix + ".slideSphere", 1};
+    vector<physics::CollisionInfo> expected, collisions;
+    for (int i = 0; i < COUNT; i++) {
+        glm::vec3 center(coord(rng), coord(rng), 0);
+        expected.clear();
+        physics::sphereCollision(&world, center, 24, expected);
+        collisions.clear();
+        collider.sphereCollision(center, 24, collisions);
+        sphere.check(glm::abs(float(collisions.size())
+                              - float(expected.size())));
+
+        glm::vec3 start = center + glm::vec3(0, 0, 50);
+        glm::vec3 motion(slope(rng) * 600, slope(rng) * 600, -100);
+        slide.check(glm::distance(
+            collider.slideSphere(start, 24, motion),
+            physics::slideSphere(&world, start, 24, motion)));
+    }
+    bool ok = report(options, sphere);
+    return report(options, slide) && ok;
+}
+
+// moves every dynamic component, returns false if there are none
+static bool moveDynamic(World &world, glm::vec3 offset)
+{
+    vector<Component *> dynamic;
+    if (world.root())
+        findDynamic(world.root(), dynamic);
+    for (auto &component : dynamic)
+        component->tLocalMut() *= Transform::translate(offset);
+    return !dynamic.empty();
+}
+
+static bool verifyCollisionScene(const BenchOptions &options, World &world,
+                                 std::mt19937 &rng)
+{
+    auto scene = physics::CollisionScene::build(&world);
+    bool ok = verifySceneRaycast(options, world, *scene,
+                                 "physics.scene.raycast", rng);
+    ok = verifySpheres(options, world, *scene, "physics.scene", rng) && ok;
+
+    // only the moved instances are updated
+    glm::vec3 offset(37, -23, 5);
+    if (!moveDynamic(world, offset))
+        return ok;
+    scene = physics::CollisionScene::update(&world, scene.get());
+    ok = verifySceneRaycast(options, world, *scene,
+                            "physics.scene.update.raycast", rng) && ok;
+    ok = verifySpheres(options, world, *scene, "physics.scene.update", rng)
+        && ok;
+    moveDynamic(world, -offset);
+    return ok;
+}
+
+static bool verifySpatialHash(const BenchOptions &options, World &world,
+                              std::mt19937 &rng)
+{
+    physics::SpatialHash hash;
+    hash.build(&world);
+    bool ok = verifySpheres(options, world, hash, "physics.hash", rng);
+
+    // dynamic components are re-inserted where they moved
+    glm::vec3 offset(37, -23, 5);
+    if (!moveDynamic(world, offset))
+        return ok;
+    hash.update(&world);
+    ok = verifySpheres(options, world, hash, "physics.hash.update", rng)
+        && ok;
+    moveDynamic(world, -offset);
+    return ok;
+}
+
+static bool verifyAll(const BenchOptions &options)
+{
+    std::mt19937 rng(options.scene.seed);
+    bool ok = verifyTransforms(options, rng);
+
+    ShaderManager shaders;  // programs are never linked
+    World world;
+    generateScene(&world, options.scene, &shaders);
+    ok = verifyRaycastBatch(options, world, rng) && ok;
+    ok = verifyCollisionScene(options, world, rng) && ok;
+    ok = verifySpatialHash(options, world, rng) && ok;
+    return ok;
+}
+
+static void usage()
+{
+    cout << "usage: diorama_bench [--instances N] [--triangles N] "
+        "[--meshes N] [--depth N] [--branching N] [--materials N] "
+        "[--transparent RATIO] [--dynamic RATIO] [--iterations N] "
+        "[--filter NAME] [--sweep] [--verify]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    bool sweep = false, verify = false;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--sweep") {
+                sweep = true;
+            } else if (arg == "--verify") {
+                verify = true;
+            } else if (i + 1 >= argc) {
+                usage();
+                return EXIT_FAILURE;
+            } else if (arg == "--instances") {
+                options.scene.instances = std::stoi(argv[++i]);
+            } else if (arg == "--triangles") {
+                options.scene.trianglesPerMesh = std::stoi(argv[++i]);
+            } else if (arg == "--meshes") {
+                options.scene.meshes = std::stoi(argv[++i]);
+            } else if (arg == "--depth") {
+                options.scene.depth = std::stoi(argv[++i]);
+            } else if (arg == "--branching") {
+                options.scene.branching = std::stoi(argv[++i]);
+            } else if (arg == "--materials") {
+                options.scene.materials = std::stoi(argv[++i]);
+            } else if (arg == "--transparent") {
+                options.scene.transparentRatio = std::stof(argv[++i]);
+            } else if (arg == "--dynamic") {
+                options.scene.dynamicRatio = std::stof(argv[++i]);
+            } else if (arg == "--iterations") {
+                options.iterations = std::stoi(argv[++i]);
+            } else if (arg == "--filter") {
+                options.filter = argv[++i];
+            } else {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (std::exception &) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    // benchmarks pick random instances, and average over iterations
+    if (options.scene.instances < 1 || options.iterations < 1) {
+        cout << "--instances and --iterations must be at least 1\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<BenchOptions> runs;
+    if (sweep) {
+        for (auto &size : SWEEP_SIZES) {
+            runs.push_back(options);
+            runs.back().scene.instances = size.first;
+            runs.back().scene.trianglesPerMesh = size.second;
+        }
+    } else {
+        runs.push_back(options);
+    }
+    setVerbosity(Verbosity::Quiet);
+    if (verify) {
+        cout << "components,triangles,check,checks,failures,"
+            "max_error,tolerance\n";
+        bool ok = true;
+        for (auto &run : runs)
+            ok = verifyAll(run) && ok;
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    cout << "components,triangles,benchmark,ops,"
+        "mean_ns,p50_ns,p95_ns,min_ns,ops_per_sec\n";
+    for (auto &run : runs)
+        runAll(run);
+    return EXIT_SUCCESS;
+}
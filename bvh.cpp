@@ -0,0 +1,89 @@
+#include "bvh.h"
+#include <algorithm>
+
+namespace diorama {
+
+void BVH::build(const vector<BoundingBox> &itemBounds)
+{
+    nodes.clear();
+    _items.clear();
+    if (itemBounds.empty())
+        return;
+    vector<glm::vec3> centers;
+    centers.reserve(itemBounds.size());
+    for (uint32_t i = 0; i < itemBounds.size(); i++) {
+        centers.push_back((itemBounds[i].min + itemBounds[i].max) * 0.5f);
+        _items.push_back(i);
+    }
+    nodes.reserve(itemBounds.size() / LEAF_SIZE * 2 + 1);
+    buildNode(itemBounds, centers, 0, itemBounds.size());
+}
+
+void BVH::refit(const vector<BoundingBox> &leafOrderBounds)
+{
+    // children always come after their parent
+    for (size_t i = nodes.size(); i-- > 0;) {
+        Node &node = nodes[i];
+        BoundingBox bounds;
+        if (node.count > 0) {
+            for (uint32_t j = node.first; j < node.first + node.count; j++)
+                bounds.add(leafOrderBounds[j]);
+        } else {
+            bounds.add(nodes[i + 1].bounds);
+            bounds.add(nodes[node.first].bounds);
+        }
+        node.bounds = bounds;
+    }
+}
+
+const vector<uint32_t> & BVH::items() const
+{
+    return _items;
+}
+
+BoundingBox BVH::bounds() const
+{
+    return nodes.empty() ? BoundingBox() : nodes[0].bounds;
+}
+
+uint32_t BVH::buildNode(const vector<BoundingBox> &itemBounds,
+                        const vector<glm::vec3> &centers,
+                        uint32_t first, uint32_t count)
+{
+    uint32_t index = nodes.size();
+    nodes.emplace_back();
+
+    BoundingBox bounds, centerBounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        bounds.add(itemBounds[_items[i]]);
+        centerBounds.add(centers[_items[i]]);
+    }
+    nodes[index].bounds = bounds;
+
+    glm::vec3 extent = centerBounds.max - centerBounds.min;
+    int axis = 0;
+    if (extent.y > extent[axis])
+        axis = 1;
+    if (extent.z > extent[axis])
+        axis = 2;
+    if (count <= LEAF_SIZE || extent[axis] <= 0) {
+        nodes[index].first = first;
+        nodes[index].count = count;
+        return index;
+    }
+
+    // split at the median center along the longest axis
+    uint32_t half = count / 2;
+    auto begin = _items.begin() + first;
+    std::nth_element(begin, begin + half, begin + count,
+        [&](uint32_t a, uint32_t b) {
+            return centers[a][axis] < centers[b][axis];
+        });
+    buildNode(itemBounds, centers, first, half);  // at index + 1
+    uint32_t right = buildNode(itemBounds, centers, first + half, count - half);
+    nodes[index].first = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+}  // namespace
@@ -0,0 +1,71 @@
+#pragma once
+#include "common.h"
+
+#include "mathutils.h"
+#include <cstdint>
+
+namespace diorama {
+
+// Bounding volume hierarchy over a list of boxes. Doesn't change after
+// building, so it can be read from any thread.
+class BVH
+{
+public:
+    struct Node
+    {
+        BoundingBox bounds;
+        // leaf if count > 0, covering items [first, first + count).
+        // otherwise the children are at this index + 1 and first
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    static const uint32_t LEAF_SIZE = 4;
+
+    void build(const vector<BoundingBox> &itemBounds);
+    // update node bounds after items moved, keeping the tree. bounds are in
+    // the order of items(), like the callers' reordered items. the tree gets
+    // worse as items move further, so rebuild eventually
+    void refit(const vector<BoundingBox> &leafOrderBounds);
+
+    // indices into itemBounds, in the order referenced by leaves. callers
+    // usually reorder their items to match
+    const vector<uint32_t> & items() const;
+    BoundingBox bounds() const;
+
+    // test(const BoundingBox &) decides whether to descend into a node.
+    // leaf(first, count) is called for each leaf that passes
+    template<typename Test, typename Leaf>
+    void traverse(Test test, Leaf leaf) const
+    {
+        if (nodes.empty())
+            return;
+        // depth is about log2 of the item count
+        uint32_t stack[64];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0) {
+            uint32_t index = stack[--size];
+            const Node &node = nodes[index];
+            if (!test(node.bounds))
+                continue;
+            if (node.count > 0) {
+                leaf(node.first, node.count);
+            } else {
+                // TODO visit the nearer child first for rays
+                stack[size++] = node.first;
+                stack[size++] = index + 1;
+            }
+        }
+    }
+
+private:
+    uint32_t buildNode(const vector<BoundingBox> &itemBounds,
+                       const vector<glm::vec3> &centers,
+                       uint32_t first, uint32_t count);
+
+    vector<Node> nodes;
+    vector<uint32_t> _items;
+};
+
+}  // namespace
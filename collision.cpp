@@ -1,5 +1,12 @@
 #include "collision.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <limits>
+#include <mutex>
+#include <thread>
 #include <glm/gtx/norm.hpp>
 
 // :(
@@ -13,16 +20,65 @@ static CollisionInfo raycastPrimitive(
     Component *component, const CollisionPrimitive *primitive,
     glm::vec3 origin, glm::vec3 dir, float *closestDist2);
 
+const int RAY_PACKET_SIZE = 16;
+
+struct RayPacket
+{
+    int count = 0;
+    const Ray *rays[RAY_PACKET_SIZE];
+    CollisionInfo *results[RAY_PACKET_SIZE];
+    // distance along each ray to the closest hit, in units of dir
+    float closest[RAY_PACKET_SIZE];
+};
+
+static void raycastPacket(
+    Component *component, AffineTransform worldT, RayPacket *packet);
+
 static void sphereHierarchy(
-    Component *component, Transform worldT, glm::vec3 center, float sqRadius,
-    vector<CollisionInfo> &collisions);
+    Component *component, AffineTransform worldT, glm::vec3 center,
+    float sqRadius,
+    const BoundingBox &bounds, vector<CollisionInfo> &collisions);
 static void spherePrimitive(
     Component *component, const CollisionPrimitive *primitive,
-    Transform worldT, glm::vec3 center, float sqRadius,
+    AffineTransform worldT, glm::vec3 center, float sqRadius,
     vector<CollisionInfo> &collisions);
 
+struct Sweep
+{
+    glm::vec3 center;
+    float radius;
+    glm::vec3 motion;
+    BoundingBox bounds;  // of the whole motion
+};
+
+static void sweepHierarchy(
+    Component *component, AffineTransform worldT, const Sweep &sweep,
+    SweepInfo *closest);
+static void sweepPrimitive(
+    Component *component, const CollisionPrimitive *primitive,
+    AffineTransform worldT, const Sweep &sweep, SweepInfo *closest);
+
+static thread_local CollisionStats threadStats;
+// vertices of the current primitive in world space
+static thread_local vector<glm::vec3> worldVertices;
+
+static const vector<glm::vec3> & transformVertices(
+    const CollisionPrimitive *primitive, const AffineTransform &worldT)
+{
+    worldVertices.resize(primitive->vertices.size());
+    worldT.transformPoints(primitive->vertices.data(), worldVertices.data(),
+                           primitive->vertices.size());
+    return worldVertices;
+}
+
+CollisionStats & collisionStats()
+{
+    return threadStats;
+}
+
 CollisionInfo raycast(const World *world, glm::vec3 origin, glm::vec3 dir)
 {
+    PROFILE_ZONE("physics::raycast");
     CollisionInfo collision = raycastHierarchy(world->root(), origin, dir);
     if (collision.component)
         collision.normal = glm::normalize(collision.normal);
@@ -32,8 +88,8 @@ CollisionInfo raycast(const World *world, glm::vec3 origin, glm::vec3 dir)
 static CollisionInfo raycastHierarchy(
     Component *component, glm::vec3 origin, glm::vec3 dir)
 {
-    const Transform &t = component->tLocal();
-    Transform invT = t.inverse();
+    AffineTransform t = component->tLocal();
+    AffineTransform invT = t.inverse();
     origin = invT.transformPoint(origin);
     dir = invT.transformVector(dir);  // TODO preserve length
 
@@ -64,8 +120,7 @@ static CollisionInfo raycastHierarchy(
 
     if (closest.component) {
         closest.point = t.transformPoint(closest.point);
-        closest.normal = glm::transpose(glm::mat3(invT.matrix()))
-            * closest.normal;
+        closest.normal = t.normalMatrix() * closest.normal;
     }
     return closest;
 }
@@ -75,64 +130,313 @@ static CollisionInfo raycastPrimitive(
     glm::vec3 origin, glm::vec3 dir, float *closestDist2)
 {
     CollisionInfo closest;
+    threadStats.trianglesTested += primitive->indices.size() / 3;
 
+    float closestDist = glm::sqrt(*closestDist2);
     for (int i = 0; i < primitive->indices.size(); i += 3) {
         glm::vec3 a = primitive->vertices[primitive->indices[i]];
         glm::vec3 b = primitive->vertices[primitive->indices[i + 1]];
         glm::vec3 c = primitive->vertices[primitive->indices[i + 2]];
+        glm::vec3 normal;
+        if (raycastTriangle(a, b, c, origin, dir, &closestDist, &normal)) {
+            closest.component = component;
+            closest.point = origin + dir * closestDist;
+            closest.normal = normal;
+        }
+    }
+    *closestDist2 = closestDist * closestDist;
+    return closest;
+}
 
-        // triangle plane normal and coefficient
-        glm::vec3 triCross = glm::cross(b - a, c - a);
-        if (triCross == glm::vec3(0))  // happens with some geometry idk
-            continue;
-        glm::vec3 planeNormal = glm::normalize(triCross);  // TODO avoid?
-        float planeK = glm::dot(planeNormal, a);
-
-        // intersect ray with plane
-        float nDotD = glm::dot(planeNormal, dir);
-        if (nDotD > -1e-6)
-            continue;  // only front facing
-        float t = (planeK - glm::dot(planeNormal, origin)) / nDotD;
-        if (t <= 0 || t*t > *closestDist2)
+bool raycastTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                     glm::vec3 origin, glm::vec3 dir,
+                     float *t, glm::vec3 *normal)
+{
+    // triangle plane normal and coefficient
+    glm::vec3 triCross = glm::cross(b - a, c - a);
+    if (triCross == glm::vec3(0))  // happens with some geometry idk
+        return false;
+    glm::vec3 planeNormal = glm::normalize(triCross);  // TODO avoid?
+    float planeK = glm::dot(planeNormal, a);
+
+    // intersect ray with plane
+    float nDotD = glm::dot(planeNormal, dir);
+    if (nDotD > -1e-6)
+        return false;  // only front facing
+    float planeT = (planeK - glm::dot(planeNormal, origin)) / nDotD;
+    if (planeT <= 0 || planeT >= *t)
+        return false;
+    glm::vec3 intersect = origin + dir * planeT;
+
+    // double-area of smaller triangles defined by intersection point
+    float dAreaQBC = glm::dot(glm::cross(c - b, intersect - b), planeNormal);
+    float dAreaAQC = glm::dot(glm::cross(a - c, intersect - c), planeNormal);
+    float dAreaABQ = glm::dot(glm::cross(b - a, intersect - a), planeNormal);
+
+    // inside triangle?
+    // check if inside all the edges
+    if (dAreaQBC < 0 || dAreaAQC < 0 || dAreaABQ < 0)
+        return false;  // not inside triangle
+
+    *t = planeT;
+    *normal = planeNormal;
+    return true;
+}
+
+// interleave the low 10 bits with zeros
+static uint32_t spreadBits(uint32_t x)
+{
+    x &= 0x3FF;
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// order rays by direction octant, then along a Morton curve through their
+// origins, so neighbors in a packet take similar paths
+static vector<uint32_t> coherentOrder(const vector<Ray> &rays)
+{
+    BoundingBox bounds;
+    for (auto &ray : rays)
+        bounds.add(ray.origin);
+    glm::vec3 scale = 1023.0f / glm::max(bounds.max - bounds.min,
+                                         glm::vec3(1e-6f));
+
+    // 3 octant bits above 30 Morton bits
+    vector<std::pair<uint64_t, uint32_t>> keys;
+    keys.reserve(rays.size());
+    for (uint32_t i = 0; i < rays.size(); i++) {
+        glm::ivec3 cell((rays[i].origin - bounds.min) * scale);
+        uint64_t octant = (rays[i].dir.x < 0) | (rays[i].dir.y < 0) << 1
+            | (rays[i].dir.z < 0) << 2;
+        uint64_t key = octant << 30 | spreadBits(cell.x)
+            | spreadBits(cell.y) << 1 | spreadBits(cell.z) << 2;
+        keys.emplace_back(key, i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    vector<uint32_t> order;
+    order.reserve(keys.size());
+    for (auto &key : keys)
+        order.push_back(key.second);
+    return order;
+}
+
+// Threads kept between calls, since starting them costs about as much as a
+// small batch. Grows to the most threads asked for.
+class WorkerPool
+{
+public:
+    ~WorkerPool();
+    // calls work(1) to work(numThreads - 1) on pool threads and work(0) on
+    // the calling thread, returns when they've all finished
+    void run(int numThreads, const std::function<void(int)> &work);
+
+private:
+    // seen is the generation when the thread started
+    void workerMain(int index, uint64_t seen);
+
+    std::mutex runMutex;  // one run at a time
+    std::mutex mutex;  // for everything below
+    std::condition_variable wake, finished;
+    vector<std::thread> threads;  // thread i has index i + 1
+    const std::function<void(int)> *job = nullptr;
+    int jobThreads = 0;
+    uint64_t generation = 0;  // counts runs, wakes the workers
+    int remaining = 0;  // pool threads still working
+    bool quit = false;
+};
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void WorkerPool::run(int numThreads, const std::function<void(int)> &work)
+{
+    std::lock_guard<std::mutex> runLock(runMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while ((int)threads.size() < numThreads - 1) {
+            int index = (int)threads.size() + 1;
+            uint64_t seen = generation;
+            threads.emplace_back([this, index, seen]() {
+                workerMain(index, seen);
+            });
+        }
+        job = &work;
+        jobThreads = numThreads;
+        remaining = numThreads - 1;
+        generation++;
+    }
+    wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return remaining == 0; });
+    job = nullptr;
+}
+
+void WorkerPool::workerMain(int index, uint64_t seen)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&]() { return quit || generation != seen; });
+        if (quit)
+            return;
+        seen = generation;
+        if (index >= jobThreads)
+            continue;  // not needed for this run
+        const std::function<void(int)> *work = job;
+        lock.unlock();
+        (*work)(index);
+        lock.lock();
+        if (--remaining == 0)
+            finished.notify_one();
+    }
+}
+
+static WorkerPool workerPool;
+
+void raycastBatch(const World *world, const vector<Ray> &rays,
+                  vector<CollisionInfo> &results, int numThreads)
+{
+    PROFILE_ZONE("physics::raycastBatch");
+    results.assign(rays.size(), CollisionInfo());
+    if (rays.empty())
+        return;
+    vector<uint32_t> order = coherentOrder(rays);
+
+    size_t numPackets = (rays.size() + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE;
+    if (numThreads <= 0)
+        numThreads = glm::max((int)std::thread::hardware_concurrency(), 1);
+    numThreads = (int)std::min((size_t)numThreads, numPackets);
+
+    std::atomic<size_t> nextPacket {0};
+    // stats are per thread, add them to the caller's
+    vector<size_t> threadTriangles(numThreads, 0);
+    std::function<void(int)> work = [&](int thread) {
+        PROFILE_ZONE("physics::raycastBatch worker");
+        size_t startTriangles = threadStats.trianglesTested;
+        size_t p;
+        while ((p = nextPacket++) < numPackets) {
+            RayPacket packet;
+            size_t end = std::min((p + 1) * RAY_PACKET_SIZE, rays.size());
+            for (size_t i = p * RAY_PACKET_SIZE; i < end; i++) {
+                packet.rays[packet.count] = &rays[order[i]];
+                packet.results[packet.count] = &results[order[i]];
+                packet.closest[packet.count] =
+                    std::numeric_limits<float>::max();
+                packet.count++;
+            }
+            raycastPacket(world->root(), AffineTransform(), &packet);
+        }
+        threadTriangles[thread] = threadStats.trianglesTested - startTriangles;
+    };
+
+    workerPool.run(numThreads, work);
+    for (int i = 1; i < numThreads; i++)
+        threadStats.trianglesTested += threadTriangles[i];
+}
+
+static void raycastPacket(
+    Component *component, AffineTransform worldT, RayPacket *packet)
+{
+    worldT *= component->tLocal();
+    for (auto &child : component->children())
+        raycastPacket(child, worldT, packet);
+    if (!component->mesh || component->mesh->collision.empty())
+        return;
+
+    // transform once for the whole packet. distances along the ray stay the
+    // same in local space since dir isn't normalized
+    AffineTransform invT = worldT.inverse();
+    glm::mat3 normalMatrix = worldT.normalMatrix();
+    glm::vec3 origins[RAY_PACKET_SIZE], dirs[RAY_PACKET_SIZE];
+    for (int r = 0; r < packet->count; r++) {
+        origins[r] = invT.transformPoint(packet->rays[r]->origin);
+        dirs[r] = invT.transformVector(packet->rays[r]->dir);
+    }
+
+    for (auto &primitive : component->mesh->collision) {
+        int active[RAY_PACKET_SIZE];
+        int numActive = 0;
+        for (int r = 0; r < packet->count; r++) {
+            if (primitive.bounds.intersectsRay(origins[r], dirs[r],
+                                               packet->closest[r]))
+                active[numActive++] = r;
+        }
+        if (numActive == 0)
             continue;
-        glm::vec3 intersect = origin + dir * t;
+        threadStats.trianglesTested +=
+            primitive.indices.size() / 3 * numActive;
 
-        // double-area of smaller triangles defined by intersection point
-        float dAreaQBC = glm::dot(glm::cross(c - b, intersect - b), planeNormal);
-        float dAreaAQC = glm::dot(glm::cross(a - c, intersect - c), planeNormal);
-        float dAreaABQ = glm::dot(glm::cross(b - a, intersect - a), planeNormal);
+        // triangle setup is shared by every ray in the packet
+        for (int i = 0; i < primitive.indices.size(); i += 3) {
+            glm::vec3 a = primitive.vertices[primitive.indices[i]];
+            glm::vec3 b = primitive.vertices[primitive.indices[i + 1]];
+            glm::vec3 c = primitive.vertices[primitive.indices[i + 2]];
+            glm::vec3 triCross = glm::cross(b - a, c - a);
+            if (triCross == glm::vec3(0))
+                continue;
+            glm::vec3 planeNormal = glm::normalize(triCross);
+            float planeK = glm::dot(planeNormal, a);
 
-        // inside triangle?
-        // check if inside all the edges
-        if (dAreaQBC < 0 || dAreaAQC < 0 || dAreaABQ < 0)
-            continue;  // not inside triangle
+            for (int k = 0; k < numActive; k++) {
+                int r = active[k];
+                float nDotD = glm::dot(planeNormal, dirs[r]);
+                if (nDotD > -1e-6)
+                    continue;  // only front facing
+                float t = (planeK - glm::dot(planeNormal, origins[r])) / nDotD;
+                if (t <= 0 || t >= packet->closest[r])
+                    continue;
+                glm::vec3 q = origins[r] + dirs[r] * t;
+                if (glm::dot(glm::cross(c - b, q - b), planeNormal) < 0
+                        || glm::dot(glm::cross(a - c, q - c), planeNormal) < 0
+                        || glm::dot(glm::cross(b - a, q - a), planeNormal) < 0)
+                    continue;  // not inside triangle
 
-        closest.component = component;
-        closest.point = intersect;
-        closest.normal = planeNormal;
-        *closestDist2 = t*t;
+                packet->closest[r] = t;
+                const Ray *ray = packet->rays[r];
+                *packet->results[r] = CollisionInfo {
+                    component, ray->origin + ray->dir * t,
+                    glm::normalize(normalMatrix * planeNormal)};
+            }
+        }
     }
-    return closest;
 }
 
 void sphereCollision(const World *world, glm::vec3 center, float radius,
                      vector<CollisionInfo> &collisions)
 {
-    sphereHierarchy(world->root(), Transform(), center, radius*radius,
-                    collisions);
+    PROFILE_ZONE("physics::sphereCollision");
+    BoundingBox bounds;
+    bounds.add(center);
+    sphereHierarchy(world->root(), AffineTransform(), center, radius*radius,
+                    bounds.expanded(radius), collisions);
 }
 
 static void sphereHierarchy(
-    Component *component, Transform worldT, glm::vec3 center, float sqRadius,
-    vector<CollisionInfo> &collisions)
+    Component *component, AffineTransform worldT, glm::vec3 center,
+    float sqRadius,
+    const BoundingBox &bounds, vector<CollisionInfo> &collisions)
 {
     worldT *= component->tLocal();
 
     for (auto &child : component->children()){
-        sphereHierarchy(child, worldT, center, sqRadius, collisions);
+        sphereHierarchy(child, worldT, center, sqRadius, bounds, collisions);
     }
     if (component->mesh && !component->mesh->collision.empty()) {
         for (auto &primitive : component->mesh->collision) {
+            if (!primitive.bounds.transformed(worldT).intersects(bounds))
+                continue;
             spherePrimitive(component, &primitive, worldT,
                             center, sqRadius, collisions);
         }
@@ -141,71 +445,261 @@ static void sphereHierarchy(
 
 static void spherePrimitive(
     Component *component, const CollisionPrimitive *primitive,
-    Transform worldT, glm::vec3 center, float sqRadius,
+    AffineTransform worldT, glm::vec3 center, float sqRadius,
     vector<CollisionInfo> &collisions)
+{
+    threadStats.trianglesTested += primitive->indices.size() / 3;
+    const vector<glm::vec3> &vertices = transformVertices(primitive, worldT);
+    for (int i = 0; i < primitive->indices.size(); i += 3) {
+        glm::vec3 a = vertices[primitive->indices[i]];
+        glm::vec3 b = vertices[primitive->indices[i + 1]];
+        glm::vec3 c = vertices[primitive->indices[i + 2]];
+
+        CollisionInfo collision;
+        if (sphereTriangle(a, b, c, center, sqRadius, &collision)) {
+            collision.component = component;
+            collisions.push_back(collision);
+        }
+    }
+}
+
+bool sphereTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                    glm::vec3 center, float sqRadius, CollisionInfo *collision)
 {
     // https://gdbooks.gitbooks.io/3dcollisions/content/
-    // some of this is copied from raycastPrimitive :(
+    // some of this is copied from raycastTriangle :(
+    glm::vec3 triCross = glm::cross(b - a, c - a);
+    if (triCross == glm::vec3(0))  // happens with some geometry idk
+        return false;
+    glm::vec3 planeNorm = glm::normalize(triCross);  // TODO avoid?
+    // planeK is also the distance to the origin (center of sphere)
+    float planeK = glm::dot(planeNorm, a);
+
+    float distToPlane = glm::dot(planeNorm, center) - planeK;
+    if (distToPlane < 0)  // wrong side
+        return false;
+    glm::vec3 planePt = center - distToPlane * planeNorm;  // point on plane
+
+    // check if inside each edge
+    bool insideBC = glm::dot(glm::cross(c - b, planePt - b), planeNorm) >= 0;
+    bool insideCA = glm::dot(glm::cross(a - c, planePt - c), planeNorm) >= 0;
+    bool insideAB = glm::dot(glm::cross(b - a, planePt - a), planeNorm) >= 0;
+
+    //  \  |            here's a triangle
+    //   \ |
+    //    \|            enjoy
+    //     A
+    //     |\
+    //     | \
+    //     |  \
+    //     |   \
+    // ----B----C----
+    //     |     \
+    //     |      \
+
+    glm::vec3 point;
+    if (insideBC && insideCA && insideAB) {
+        point = planePt;
+    } else {
+        glm::vec3 e1, e2; // points forming an edge
+        if (!insideBC) {
+            e1 = b; e2 = c;
+        } else if (!insideCA) {
+            e1 = c; e2 = a;
+        } else { // !insideAB
+            e1 = a; e2 = b;
+        }
+        glm::vec3 edge = e2 - e1;
+        float t = glm::dot(planePt - e1, edge) / glm::dot(edge, edge);
+        t = glm::clamp(t, 0.0f, 1.0f);
+        point = e1 + t * edge;
+    }
+
+    if (glm::distance2(point, center) > sqRadius)
+        return false;
+    collision->point = point;
+    collision->normal = planeNorm;
+    return true;
+}
+
+SweepInfo sphereSweep(const World *world, glm::vec3 center, float radius,
+                      glm::vec3 motion)
+{
+    PROFILE_ZONE("physics::sphereSweep");
+    SweepInfo closest;
+    if (motion == glm::vec3(0))
+        return closest;
+    Sweep sweep {center, radius, motion};
+    sweep.bounds.add(center);
+    sweep.bounds.add(center + motion);
+    sweep.bounds = sweep.bounds.expanded(radius);
+    sweepHierarchy(world->root(), AffineTransform(), sweep, &closest);
+    return closest;
+}
+
+glm::vec3 slideSphere(const World *world, glm::vec3 center, float radius,
+                      glm::vec3 motion, int maxIterations)
+{
+    PROFILE_ZONE("physics::slideSphere");
+    return slide(center, radius, motion, maxIterations,
+        [&](glm::vec3 center, glm::vec3 motion) {
+            return sphereSweep(world, center, radius, motion);
+        },
+        [&](glm::vec3 center, vector<CollisionInfo> &collisions) {
+            sphereCollision(world, center, radius, collisions);
+        });
+}
+
+static void sweepHierarchy(
+    Component *component, AffineTransform worldT, const Sweep &sweep,
+    SweepInfo *closest)
+{
+    worldT *= component->tLocal();
+
+    for (auto &child : component->children()) {
+        sweepHierarchy(child, worldT, sweep, closest);
+    }
+    if (component->mesh && !component->mesh->collision.empty()) {
+        for (auto &primitive : component->mesh->collision) {
+            if (!primitive.bounds.transformed(worldT).intersects(sweep.bounds))
+                continue;
+            sweepPrimitive(component, &primitive, worldT, sweep, closest);
+        }
+    }
+}
+
+// lowest root of a*t^2 + b*t + c = 0 in [0, maxT). the equation is the
+// (scaled) squared distance minus squared radius, possibly negated, so after
+// making a positive a negative c means the sphere already overlaps. like the
+// embedded case in the paper that's a hit at 0, if it's moving further in
+static bool lowestRoot(float a, float b, float c, float maxT, float *root)
+{
+    if (a < 0) {
+        a = -a;
+        b = -b;
+        c = -c;
+    }
+    if (c < 0) {
+        if (b >= 0 || maxT <= 0)  // moving out
+            return false;
+        *root = 0;
+        return true;
+    }
+    float det = b*b - 4*a*c;
+    if (det < 0 || a == 0)
+        return false;
+    float first = (-b - glm::sqrt(det)) / (2*a);
+    if (first < 0 || first >= maxT)
+        return false;
+    *root = first;
+    return true;
+}
+
+static void sweepPrimitive(
+    Component *component, const CollisionPrimitive *primitive,
+    AffineTransform worldT, const Sweep &sweep, SweepInfo *closest)
+{
+    threadStats.trianglesTested += primitive->indices.size() / 3;
+    const vector<glm::vec3> &vertices = transformVertices(primitive, worldT);
     for (int i = 0; i < primitive->indices.size(); i += 3) {
-        glm::vec3 a = primitive->vertices[primitive->indices[i]];
-        glm::vec3 b = primitive->vertices[primitive->indices[i + 1]];
-        glm::vec3 c = primitive->vertices[primitive->indices[i + 2]];
-        a = worldT.transformPoint(a);
-        b = worldT.transformPoint(b);
-        c = worldT.transformPoint(c);
+        glm::vec3 a = vertices[primitive->indices[i]];
+        glm::vec3 b = vertices[primitive->indices[i + 1]];
+        glm::vec3 c = vertices[primitive->indices[i + 2]];
 
-        glm::vec3 triCross = glm::cross(b - a, c - a);
-        if (triCross == glm::vec3(0))  // happens with some geometry idk
+        BoundingBox triBounds;
+        triBounds.add(a);
+        triBounds.add(b);
+        triBounds.add(c);
+        if (!triBounds.intersects(sweep.bounds))
             continue;
-        glm::vec3 planeNorm = glm::normalize(triCross);  // TODO avoid?
-        // planeK is also the distance to the origin (center of sphere)
-        float planeK = glm::dot(planeNorm, a);
+        if (sweepTriangle(a, b, c, sweep.center, sweep.radius, sweep.motion,
+                          &closest->time, &closest->collision))
+            closest->collision.component = component;
+    }
+}
 
-        float distToPlane = glm::dot(planeNorm, center) - planeK;
-        if (distToPlane < 0)  // wrong side
-            continue;
-        glm::vec3 planePt = center - distToPlane * planeNorm;  // point on plane
-
-        // check if inside each edge
-        bool insideBC = glm::dot(glm::cross(c - b, planePt - b), planeNorm) >= 0;
-        bool insideCA = glm::dot(glm::cross(a - c, planePt - c), planeNorm) >= 0;
-        bool insideAB = glm::dot(glm::cross(b - a, planePt - a), planeNorm) >= 0;
-
-        //  \  |            here's a triangle
-        //   \ |
-        //    \|            enjoy
-        //     A
-        //     |\
-        //     | \
-        //     |  \
-        //     |   \
-        // ----B----C----
-        //     |     \
-        //     |      \
+bool sweepTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                   glm::vec3 center, float radius, glm::vec3 motion,
+                   float *time, CollisionInfo *collision)
+{
+    // http://www.peroxide.dk/papers/collision/collision.pdf
+    float sqRadius = radius * radius;
+    float sqMotion = glm::dot(motion, motion);
 
-        CollisionInfo collision;
-        collision.normal = planeNorm;
-        if (insideBC && insideCA && insideAB) {
-            collision.point = planePt;
-        } else {
-            glm::vec3 e1, e2; // points forming an edge
-            if (!insideBC) {
-                e1 = b; e2 = c;
-            } else if (!insideCA) {
-                e1 = c; e2 = a;
-            } else { // !insideAB
-                e1 = a; e2 = b;
-            }
-            glm::vec3 edge = e2 - e1;
-            float t = glm::dot(planePt - e1, edge) / glm::dot(edge, edge);
-            t = glm::clamp(t, 0.0f, 1.0f);
-            collision.point = e1 + t * edge;
-        }
+    glm::vec3 triCross = glm::cross(b - a, c - a);
+    if (triCross == glm::vec3(0))  // happens with some geometry idk
+        return false;
+    glm::vec3 planeNorm = glm::normalize(triCross);
+    float planeK = glm::dot(planeNorm, a);
 
-        if (glm::distance2(collision.point, center) <= sqRadius) {
-            collisions.push_back(collision);
+    float distToPlane = glm::dot(planeNorm, center) - planeK;
+    if (distToPlane < 0)  // wrong side
+        return false;
+    float normalSpeed = glm::dot(planeNorm, motion);
+    if (normalSpeed >= 0)  // moving away or parallel
+        return false;
+    // time the sphere touches the plane, 0 if it already does
+    float planeTime = glm::max((distToPlane - radius) / -normalSpeed, 0.0f);
+    if (planeTime >= *time)
+        return false;
+    glm::vec3 planePt = center + motion * planeTime
+        - planeNorm * glm::min(distToPlane, radius);
+
+    bool insideBC = glm::dot(glm::cross(c - b, planePt - b), planeNorm) >= 0;
+    bool insideCA = glm::dot(glm::cross(a - c, planePt - c), planeNorm) >= 0;
+    bool insideAB = glm::dot(glm::cross(b - a, planePt - a), planeNorm) >= 0;
+    if (insideBC && insideCA && insideAB) {
+        *time = planeTime;
+        collision->point = planePt;
+        collision->normal = planeNorm;
+        return true;
+    }
+
+    // otherwise the sphere can only hit a vertex or an edge
+    float hitTime = *time;
+    glm::vec3 hitPt;
+    bool hit = false;
+    for (glm::vec3 vertex : {a, b, c}) {
+        glm::vec3 fromVertex = center - vertex;
+        float t;
+        if (lowestRoot(sqMotion, 2 * glm::dot(motion, fromVertex),
+                       glm::dot(fromVertex, fromVertex) - sqRadius,
+                       hitTime, &t)) {
+            hitTime = t;
+            hitPt = vertex;
+            hit = true;
+        }
+    }
+    glm::vec3 edges[3][2] = {{a, b}, {b, c}, {c, a}};
+    for (auto &e : edges) {
+        glm::vec3 edge = e[1] - e[0];
+        glm::vec3 base = e[0] - center;
+        float sqEdge = glm::dot(edge, edge);
+        float edgeDotMotion = glm::dot(edge, motion);
+        float edgeDotBase = glm::dot(edge, base);
+        float t;
+        if (lowestRoot(
+                sqEdge * -sqMotion + edgeDotMotion * edgeDotMotion,
+                sqEdge * 2 * glm::dot(motion, base)
+                    - 2 * edgeDotMotion * edgeDotBase,
+                sqEdge * (sqRadius - glm::dot(base, base))
+                    + edgeDotBase * edgeDotBase,
+                hitTime, &t)) {
+            // position along the edge
+            float f = (edgeDotMotion * t - edgeDotBase) / sqEdge;
+            if (f >= 0 && f <= 1) {
+                hitTime = t;
+                hitPt = e[0] + f * edge;
+                hit = true;
+            }
         }
     }
+    if (!hit)
+        return false;
+    *time = hitTime;
+    collision->point = hitPt;
+    collision->normal = glm::normalize(center + motion * hitTime - hitPt);
+    return true;
 }
 
 }  // namespace
@@ -14,9 +14,121 @@ struct CollisionInfo
     // TODO substance
 };
 
+// work done by queries on the calling thread, reset by the caller
+struct CollisionStats
+{
+    size_t trianglesTested = 0;
+};
+
+CollisionStats & collisionStats();
+
 CollisionInfo raycast(const World *world, glm::vec3 origin, glm::vec3 dir);
 
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 dir;  // doesn't need to be normalized
+};
+
+// Cast many rays at once, results[i] is for rays[i]. Rays are sorted into
+// coherent packets which walk the hierarchy together, divided between
+// numThreads threads (0 for one per core). The threads are kept for later
+// calls. The world must not change during the call.
+void raycastBatch(const World *world, const vector<Ray> &rays,
+                  vector<CollisionInfo> &results, int numThreads = 1);
+
 void sphereCollision(const World *world, glm::vec3 center, float radius,
                      vector<CollisionInfo> &collisions);
 
+struct SweepInfo
+{
+    CollisionInfo collision;  // component is null if nothing was hit
+    float time = 1;  // fraction of the motion before contact
+};
+
+// move a sphere along motion and find the first front-facing triangle it
+// touches. normal points from the contact point to the sphere center. a sphere
+// that already overlaps a triangle and is moving further in hits at time 0
+SweepInfo sphereSweep(const World *world, glm::vec3 center, float radius,
+                      glm::vec3 motion);
+
+// move a sphere along motion, sliding along surfaces instead of stopping.
+// first pushes it out of anything it overlaps. returns the new center
+glm::vec3 slideSphere(const World *world, glm::vec3 center, float radius,
+                      glm::vec3 motion, int maxIterations = 4);
+
+// keep this far away from surfaces after sliding, so the next sweep doesn't
+// start touching them
+const float SLIDE_SKIN = 0.01f;
+const int MAX_DEPENETRATE_ITERATIONS = 4;
+
+// push a sphere out of the front of surfaces it overlaps, which sweeps can
+// only stop at (eg. after spawning inside something, or when a dynamic
+// component moves into it). overlap is of the form f(center, collisions),
+// like sphereCollision. returns the new center
+template<typename OverlapFunctor>
+glm::vec3 depenetrate(glm::vec3 center, float radius, OverlapFunctor overlap)
+{
+    vector<CollisionInfo> collisions;
+    for (int i = 0; i < MAX_DEPENETRATE_ITERATIONS; i++) {
+        collisions.clear();
+        overlap(center, collisions);
+        bool moved = false;
+        // one at a time, so coplanar triangles don't add up
+        for (auto &collision : collisions) {
+            glm::vec3 offset = center - collision.point;
+            float dist = glm::length(offset);
+            if (dist >= radius)
+                continue;
+            glm::vec3 dir = dist > 1e-6f ? offset / dist : collision.normal;
+            center += dir * (radius + SLIDE_SKIN - dist);
+            moved = true;
+        }
+        if (!moved)
+            break;
+    }
+    return center;
+}
+
+// slideSphere with any sweep, of the form f(center, motion) -> SweepInfo,
+// and overlap test for depenetrate()
+template<typename SweepFunctor, typename OverlapFunctor>
+glm::vec3 slide(glm::vec3 center, float radius, glm::vec3 motion,
+                int maxIterations, SweepFunctor sweep, OverlapFunctor overlap)
+{
+    center = depenetrate(center, radius, overlap);
+    for (int i = 0; i < maxIterations; i++) {
+        if (glm::dot(motion, motion) < 1e-8f)
+            break;
+        SweepInfo hit = sweep(center, motion);
+        if (!hit.collision.component)
+            return center + motion;
+        // stop just short of the contact
+        float length = glm::length(motion);
+        float travel = glm::max(hit.time * length - SLIDE_SKIN, 0.0f);
+        center += motion * (travel / length);
+        // project the rest of the motion onto the surface
+        motion *= 1 - hit.time;
+        glm::vec3 normal = hit.collision.normal;
+        motion -= normal * glm::dot(motion, normal);
+    }
+    // out of iterations (probably stuck in a corner), drop the rest
+    return center;
+}
+
+// Single triangle tests, front faces only (counter-clockwise). They don't
+// fill in the component.
+
+// hit if closer than *t along the ray, updates t (in units of dir)
+bool raycastTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                     glm::vec3 origin, glm::vec3 dir,
+                     float *t, glm::vec3 *normal);
+// closest point on the triangle, if inside the sphere
+bool sphereTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                    glm::vec3 center, float sqRadius, CollisionInfo *collision);
+// hit if before *time, updates time
+bool sweepTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c,
+                   glm::vec3 center, float radius, glm::vec3 motion,
+                   float *time, CollisionInfo *collision);
+
 }  // namespace
@@ -0,0 +1,193 @@
+#include "collisioncook.h"
+#include "profiler.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace diorama::physics {
+
+// collapsing can enable more collapses, but rarely after a few passes
+const int MAX_COLLAPSE_PASSES = 8;
+
+using Triangle = array<uint32_t, 3>;
+
+// state for collapsing vertices of a welded mesh
+struct Cooker
+{
+    vector<glm::vec3> vertices;
+    vector<Triangle> triangles;
+    vector<bool> alive;  // for each triangle
+    vector<vector<uint32_t>> vertexTriangles;  // may include dead triangles
+    float cosAngle;
+
+    glm::vec3 normal(const Triangle &tri) const;
+    bool tryCollapse(uint32_t v);
+};
+
+glm::vec3 Cooker::normal(const Triangle &tri) const
+{
+    return glm::cross(vertices[tri[1]] - vertices[tri[0]],
+                      vertices[tri[2]] - vertices[tri[0]]);
+}
+
+static bool hasVertex(const Triangle &tri, uint32_t v)
+{
+    return tri[0] == v || tri[1] == v || tri[2] == v;
+}
+
+// Move vertex v onto a neighbor if that doesn't change the surface: every
+// triangle around it is coplanar, and on a boundary it must lie on a
+// straight edge. Triangles sharing the collapsed edge disappear.
+bool Cooker::tryCollapse(uint32_t v)
+{
+    auto &around = vertexTriangles[v];
+    around.erase(std::remove_if(around.begin(), around.end(),
+        [&](uint32_t t) { return !alive[t]; }), around.end());
+    if (around.empty())
+        return false;
+
+    glm::vec3 planeNormal = glm::normalize(normal(triangles[around[0]]));
+    for (uint32_t t : around) {
+        if (glm::dot(glm::normalize(normal(triangles[t])), planeNormal)
+                < cosAngle)
+            return false;
+    }
+
+    // count triangles using each edge from v. boundary edges have one
+    using Neighbor = std::pair<uint32_t, int>;
+    vector<Neighbor> neighbors;
+    for (uint32_t t : around) {
+        for (uint32_t u : triangles[t]) {
+            if (u == v)
+                continue;
+            auto it = std::find_if(neighbors.begin(), neighbors.end(),
+                [&](const Neighbor &n) { return n.first == u; });
+            if (it != neighbors.end())
+                it->second++;
+            else
+                neighbors.emplace_back(u, 1);
+        }
+    }
+    vector<uint32_t> boundary, candidates;
+    for (auto &n : neighbors) {
+        if (n.second > 2)
+            return false;  // non-manifold, leave it alone
+        if (n.second == 1)
+            boundary.push_back(n.first);
+        candidates.push_back(n.first);
+    }
+    if (boundary.size() == 2) {
+        glm::vec3 a = vertices[boundary[0]], b = vertices[boundary[1]];
+        glm::vec3 p = vertices[v];
+        if (glm::dot(glm::normalize(p - a), glm::normalize(b - p)) < cosAngle)
+            return false;  // a corner
+        candidates = boundary;
+    } else if (!boundary.empty()) {
+        return false;
+    }
+
+    for (uint32_t u : candidates) {
+        bool valid = true;
+        for (uint32_t t : around) {
+            if (hasVertex(triangles[t], u))
+                continue;  // removed
+            Triangle moved = triangles[t];
+            std::replace(moved.begin(), moved.end(), v, u);
+            glm::vec3 n = normal(moved);
+            // would flip or become degenerate
+            if (n == glm::vec3(0)
+                    || glm::dot(glm::normalize(n), planeNormal) < cosAngle) {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid)
+            continue;
+
+        for (uint32_t t : around) {
+            if (hasVertex(triangles[t], u)) {
+                alive[t] = false;
+            } else {
+                std::replace(triangles[t].begin(), triangles[t].end(), v, u);
+                vertexTriangles[u].push_back(t);
+            }
+        }
+        around.clear();
+        return true;
+    }
+    return false;
+}
+
+void cookCollision(CollisionPrimitive *primitive, const CookParams &params)
+{
+    PROFILE_ZONE("cookCollision");
+    Cooker cooker;
+    cooker.cosAngle = glm::cos(params.coplanarAngle);
+
+    // weld by rounding to a grid. vertices on either side of a grid line
+    // aren't merged, but that only misses some collapses
+    std::map<std::tuple<int, int, int>, uint32_t> welded;
+    vector<uint32_t> remap;
+    remap.reserve(primitive->vertices.size());
+    for (auto &vertex : primitive->vertices) {
+        glm::vec3 cell = glm::round(vertex / params.weldDistance);
+        auto key = std::make_tuple((int)cell.x, (int)cell.y, (int)cell.z);
+        auto it = welded.find(key);
+        if (it == welded.end()) {
+            it = welded.emplace(key, (uint32_t)cooker.vertices.size()).first;
+            cooker.vertices.push_back(vertex);
+        }
+        remap.push_back(it->second);
+    }
+
+    cooker.vertexTriangles.resize(cooker.vertices.size());
+    for (int i = 0; i + 2 < primitive->indices.size(); i += 3) {
+        Triangle tri {
+            remap[primitive->indices[i]],
+            remap[primitive->indices[i + 1]],
+            remap[primitive->indices[i + 2]]};
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]
+                || cooker.normal(tri) == glm::vec3(0))
+            continue;  // degenerate
+        uint32_t index = cooker.triangles.size();
+        cooker.triangles.push_back(tri);
+        for (uint32_t v : tri)
+            cooker.vertexTriangles[v].push_back(index);
+    }
+    cooker.alive.assign(cooker.triangles.size(), true);
+
+    for (int pass = 0; pass < MAX_COLLAPSE_PASSES; pass++) {
+        bool collapsed = false;
+        for (uint32_t v = 0; v < cooker.vertices.size(); v++)
+            collapsed |= cooker.tryCollapse(v);
+        if (!collapsed)
+            break;
+    }
+
+    float sqMinSize = params.minTriangleSize * params.minTriangleSize;
+    vector<uint32_t> newIndex(cooker.vertices.size(), UINT32_MAX);
+    primitive->vertices.clear();
+    primitive->indices.clear();
+    for (uint32_t t = 0; t < cooker.triangles.size(); t++) {
+        if (!cooker.alive[t])
+            continue;
+        const Triangle &tri = cooker.triangles[t];
+        float sqLongest = 0;
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 edge = cooker.vertices[tri[(i + 1) % 3]]
+                - cooker.vertices[tri[i]];
+            sqLongest = glm::max(sqLongest, glm::dot(edge, edge));
+        }
+        if (sqLongest < sqMinSize)
+            continue;
+        for (uint32_t v : tri) {
+            if (newIndex[v] == UINT32_MAX) {
+                newIndex[v] = primitive->vertices.size();
+                primitive->vertices.push_back(cooker.vertices[v]);
+            }
+            primitive->indices.push_back((MeshIndex)newIndex[v]);
+        }
+    }
+}
+
+}  // namespace
@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+
+#include "mesh.h"
+
+namespace diorama::physics {
+
+// distances are in model units (inches for SketchUp)
+struct CookParams
+{
+    float weldDistance = 0.01f;  // vertices closer than this are merged
+    // triangles with every edge shorter than this are removed. small details
+    // don't matter to the player sphere
+    float minTriangleSize = 1.0f;
+    // faces within this angle (radians) of each other count as coplanar
+    float coplanarAngle = 0.01f;
+};
+
+// Simplifies collision geometry once at load time. Welds vertices, merges
+// coplanar triangles by collapsing vertices that don't change the surface,
+// then removes tiny triangles. Call computeBounds() after.
+void cookCollision(CollisionPrimitive *primitive,
+                   const CookParams &params = CookParams());
+
+}  // namespace
@@ -0,0 +1,330 @@
+#include "collisionscene.h"
+#include "profiler.h"
+#include <algorithm>
+#include <limits>
+
+namespace diorama::physics {
+
+shared_ptr<const CollisionScene> CollisionScene::update(
+    const World *world, const CollisionScene *previous)
+{
+    // pointers in scenes from before World::clear() could be reused
+    if (previous && previous->generation != world->generation())
+        previous = nullptr;
+    if (previous && previous->structureChanges == world->structureChanges()) {
+        vector<Component *> components;
+        if (world->movedSince(previous->moveCount, &components))
+            return previous->moved(world, components);
+    }
+    return build(world, previous);
+}
+
+shared_ptr<const CollisionScene> CollisionScene::build(
+    const World *world, const CollisionScene *previous)
+{
+    PROFILE_ZONE("CollisionScene::build");
+    if (previous && previous->generation != world->generation())
+        previous = nullptr;
+    auto scene = std::make_shared<CollisionScene>();
+    scene->_worldChanges = world->changeCount();
+    scene->generation = world->generation();
+    scene->structureChanges = world->structureChanges();
+    scene->moveCount = world->moveCount();
+    auto meshMap = std::make_shared<MeshMap>();
+    if (world->root()) {
+        scene->addHierarchy(world->root(), AffineTransform(), previous,
+                            meshMap.get());
+    }
+    scene->meshes = meshMap;
+
+    vector<BoundingBox> bounds;
+    bounds.reserve(scene->instances.size());
+    for (auto &instance : scene->instances)
+        bounds.push_back(instance.mesh->bvh.bounds().transformed(
+            instance.worldT));
+    scene->instanceBVH.build(bounds);
+
+    vector<Instance> sorted;
+    sorted.reserve(scene->instances.size());
+    auto indices = std::make_shared<InstanceMap>();
+    for (uint32_t i : scene->instanceBVH.items()) {
+        (*indices)[scene->instances[i].component] = (uint32_t)sorted.size();
+        sorted.push_back(scene->instances[i]);
+        scene->instanceBounds.push_back(bounds[i]);
+    }
+    scene->instances = std::move(sorted);
+    scene->instanceIndices = indices;
+    return scene;
+}
+
+void CollisionScene::addHierarchy(Component *component,
+                                  AffineTransform worldT,
+                                  const CollisionScene *previous,
+                                  MeshMap *meshMap)
+{
+    worldT *= component->tLocal();
+    const Mesh *mesh = component->mesh;
+    if (mesh && !mesh->collision.empty()) {
+        auto meshIt = meshMap->find(mesh);
+        if (meshIt == meshMap->end()) {
+            shared_ptr<const MeshBVH> meshBVH;
+            if (previous) {
+                auto prevIt = previous->meshes->find(mesh);
+                if (prevIt != previous->meshes->end())
+                    meshBVH = prevIt->second;
+            }
+            if (!meshBVH)
+                meshBVH = buildMesh(mesh);
+            meshIt = meshMap->emplace(mesh, meshBVH).first;
+        }
+        if (!meshIt->second->triangles.empty()) {
+            instances.push_back(Instance {
+                component, worldT, worldT.inverse(), worldT.normalMatrix(),
+                meshIt->second.get()});
+        }
+    }
+    for (auto &child : component->children())
+        addHierarchy(child, worldT, previous, meshMap);
+}
+
+// product of the local transforms from the root down
+static AffineTransform worldTransform(const Component *component)
+{
+    if (!component)
+        return AffineTransform();
+    return worldTransform(component->parent()) * component->tLocal();
+}
+
+shared_ptr<const CollisionScene> CollisionScene::moved(
+    const World *world, vector<Component *> &components) const
+{
+    PROFILE_ZONE("CollisionScene::moved");
+    // published scenes can't change, so update a copy. meshes and instance
+    // indices are shared
+    auto scene = std::make_shared<CollisionScene>(*this);
+    scene->_worldChanges = world->changeCount();
+    scene->moveCount = world->moveCount();
+
+    std::sort(components.begin(), components.end());
+    components.erase(std::unique(components.begin(), components.end()),
+                     components.end());
+    for (auto component : components)
+        scene->moveHierarchy(component, worldTransform(component->parent()));
+    scene->instanceBVH.refit(scene->instanceBounds);
+    return scene;
+}
+
+void CollisionScene::moveHierarchy(Component *component,
+                                   AffineTransform worldT)
+{
+    worldT *= component->tLocal();
+    auto indexIt = instanceIndices->find(component);
+    if (indexIt != instanceIndices->end())
+        setTransform(indexIt->second, worldT);
+    for (auto &child : component->children())
+        moveHierarchy(child, worldT);
+}
+
+void CollisionScene::setTransform(uint32_t index,
+                                  const AffineTransform &worldT)
+{
+    Instance &instance = instances[index];
+    instance.worldT = worldT;
+    instance.invT = worldT.inverse();
+    instance.normalMatrix = worldT.normalMatrix();
+    instanceBounds[index] = instance.mesh->bvh.bounds().transformed(worldT);
+}
+
+shared_ptr<const CollisionScene::MeshBVH> CollisionScene::buildMesh(
+    const Mesh *mesh)
+{
+    PROFILE_ZONE("CollisionScene::buildMesh");
+    vector<Triangle> triangles;
+    vector<BoundingBox> bounds;
+    for (auto &primitive : mesh->collision) {
+        for (int i = 0; i < primitive.indices.size(); i += 3) {
+            Triangle tri {
+                primitive.vertices[primitive.indices[i]],
+                primitive.vertices[primitive.indices[i + 1]],
+                primitive.vertices[primitive.indices[i + 2]]};
+            if (glm::cross(tri.b - tri.a, tri.c - tri.a) == glm::vec3(0))
+                continue;  // degenerate, would never collide
+            triangles.push_back(tri);
+            bounds.emplace_back();
+            bounds.back().add(tri.a);
+            bounds.back().add(tri.b);
+            bounds.back().add(tri.c);
+        }
+    }
+
+    auto meshBVH = std::make_shared<MeshBVH>();
+    meshBVH->bvh.build(bounds);
+    meshBVH->triangles.reserve(triangles.size());
+    for (uint32_t i : meshBVH->bvh.items())
+        meshBVH->triangles.push_back(triangles[i]);
+    return meshBVH;
+}
+
+CollisionInfo CollisionScene::raycast(glm::vec3 origin, glm::vec3 dir) const
+{
+    PROFILE_ZONE("CollisionScene::raycast");
+    CollisionInfo closest;
+    // distance along the ray in units of dir, which is the same in every
+    // space since dir isn't normalized after transforming
+    float closestT = std::numeric_limits<float>::max();
+    size_t tested = 0;
+
+    instanceBVH.traverse(
+        [&](const BoundingBox &box) {
+            return box.intersectsRay(origin, dir, closestT);
+        },
+        [&](uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; i++) {
+                const Instance &instance = instances[i];
+                glm::vec3 localOrigin = instance.invT.transformPoint(origin);
+                glm::vec3 localDir = instance.invT.transformVector(dir);
+                const MeshBVH &mesh = *instance.mesh;
+                mesh.bvh.traverse(
+                    [&](const BoundingBox &box) {
+                        return box.intersectsRay(localOrigin, localDir,
+                                                 closestT);
+                    },
+                    [&](uint32_t triFirst, uint32_t triCount) {
+                        tested += triCount;
+                        for (uint32_t t = triFirst;
+                                t < triFirst + triCount; t++) {
+                            const Triangle &tri = mesh.triangles[t];
+                            glm::vec3 normal;
+                            if (raycastTriangle(tri.a, tri.b, tri.c,
+                                    localOrigin, localDir,
+                                    &closestT, &normal)) {
+                                closest.component = instance.component;
+                                closest.point = origin + dir * closestT;
+                                closest.normal = glm::normalize(
+                                    instance.normalMatrix * normal);
+                            }
+                        }
+                    });
+            }
+        });
+    collisionStats().trianglesTested += tested;
+    return closest;
+}
+
+void CollisionScene::sphereCollision(glm::vec3 center, float radius,
+                                     vector<CollisionInfo> &collisions) const
+{
+    PROFILE_ZONE("CollisionScene::sphereCollision");
+    BoundingBox query;
+    query.add(center);
+    query = query.expanded(radius);
+    float sqRadius = radius * radius;
+    size_t tested = 0;
+
+    instanceBVH.traverse(
+        [&](const BoundingBox &box) { return box.intersects(query); },
+        [&](uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; i++) {
+                const Instance &instance = instances[i];
+                BoundingBox localQuery = query.transformed(instance.invT);
+                const MeshBVH &mesh = *instance.mesh;
+                mesh.bvh.traverse(
+                    [&](const BoundingBox &box) {
+                        return box.intersects(localQuery);
+                    },
+                    [&](uint32_t triFirst, uint32_t triCount) {
+                        tested += triCount;
+                        for (uint32_t t = triFirst;
+                                t < triFirst + triCount; t++) {
+                            const Triangle &tri = mesh.triangles[t];
+                            const AffineTransform &w = instance.worldT;
+                            CollisionInfo collision;
+                            if (sphereTriangle(w.transformPoint(tri.a),
+                                    w.transformPoint(tri.b),
+                                    w.transformPoint(tri.c),
+                                    center, sqRadius, &collision)) {
+                                collision.component = instance.component;
+                                collisions.push_back(collision);
+                            }
+                        }
+                    });
+            }
+        });
+    collisionStats().trianglesTested += tested;
+}
+
+SweepInfo CollisionScene::sphereSweep(glm::vec3 center, float radius,
+                                      glm::vec3 motion) const
+{
+    PROFILE_ZONE("CollisionScene::sphereSweep");
+    SweepInfo closest;
+    if (motion == glm::vec3(0))
+        return closest;
+    BoundingBox query;
+    query.add(center);
+    query.add(center + motion);
+    query = query.expanded(radius);
+    size_t tested = 0;
+
+    instanceBVH.traverse(
+        [&](const BoundingBox &box) { return box.intersects(query); },
+        [&](uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; i++) {
+                const Instance &instance = instances[i];
+                BoundingBox localQuery = query.transformed(instance.invT);
+                const MeshBVH &mesh = *instance.mesh;
+                mesh.bvh.traverse(
+                    [&](const BoundingBox &box) {
+                        return box.intersects(localQuery);
+                    },
+                    [&](uint32_t triFirst, uint32_t triCount) {
+                        tested += triCount;
+                        for (uint32_t t = triFirst;
+                                t < triFirst + triCount; t++) {
+                            const Triangle &tri = mesh.triangles[t];
+                            const AffineTransform &w = instance.worldT;
+                            if (sweepTriangle(w.transformPoint(tri.a),
+                                    w.transformPoint(tri.b),
+                                    w.transformPoint(tri.c),
+                                    center, radius, motion,
+                                    &closest.time, &closest.collision))
+                                closest.collision.component =
+                                    instance.component;
+                        }
+                    });
+            }
+        });
+    collisionStats().trianglesTested += tested;
+    return closest;
+}
+
+glm::vec3 CollisionScene::slideSphere(glm::vec3 center, float radius,
+                                      glm::vec3 motion,
+                                      int maxIterations) const
+{
+    return slide(center, radius, motion, maxIterations,
+        [&](glm::vec3 center, glm::vec3 motion) {
+            return sphereSweep(center, radius, motion);
+        },
+        [&](glm::vec3 center, vector<CollisionInfo> &collisions) {
+            sphereCollision(center, radius, collisions);
+        });
+}
+
+uint64_t CollisionScene::worldChanges() const
+{
+    return _worldChanges;
+}
+
+
+shared_ptr<const CollisionScene> SharedCollisionScene::load() const
+{
+    return std::atomic_load(&scene);
+}
+
+void SharedCollisionScene::publish(shared_ptr<const CollisionScene> scene)
+{
+    std::atomic_store(&this->scene, scene);
+}
+
+}  // namespace
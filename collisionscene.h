@@ -0,0 +1,101 @@
+#pragma once
+#include "common.h"
+
+#include "bvh.h"
+#include "collision.h"
+#include <unordered_map>
+
+namespace diorama::physics {
+
+// Read-only copy of the collision geometry in a World, with a BVH over the
+// triangles of each mesh and another over the instances. It can be queried
+// from any thread while the World changes. Components in results only
+// identify what was hit, other threads shouldn't touch them.
+class CollisionScene
+{
+public:
+    // Meshes are keyed by pointer, and World only frees them in clear(), so
+    // BVHs from the previous scene can be reused if it was built in the same
+    // World::generation(). Then only instance transforms and the top level
+    // BVH are rebuilt. These read the world, so call them on the thread that
+    // changes it.
+    static shared_ptr<const CollisionScene> build(
+        const World *world, const CollisionScene *previous = nullptr);
+    // If only components moved since previous was built, its instances are
+    // copied and the moved ones updated, then the top level BVH is refit.
+    // Otherwise the same as build().
+    static shared_ptr<const CollisionScene> update(
+        const World *world, const CollisionScene *previous);
+
+    CollisionInfo raycast(glm::vec3 origin, glm::vec3 dir) const;
+    void sphereCollision(glm::vec3 center, float radius,
+                         vector<CollisionInfo> &collisions) const;
+    SweepInfo sphereSweep(glm::vec3 center, float radius,
+                          glm::vec3 motion) const;
+    glm::vec3 slideSphere(glm::vec3 center, float radius, glm::vec3 motion,
+                          int maxIterations = 4) const;
+
+    uint64_t worldChanges() const;  // World::changeCount() when built
+
+private:
+    struct Triangle
+    {
+        glm::vec3 a, b, c;
+    };
+
+    // in mesh space
+    struct MeshBVH
+    {
+        vector<Triangle> triangles;  // in leaf order
+        BVH bvh;
+    };
+
+    struct Instance
+    {
+        Component *component;
+        AffineTransform worldT, invT;
+        glm::mat3 normalMatrix;  // mesh space to world space
+        const MeshBVH *mesh;  // owned by meshes
+    };
+
+    using MeshMap = std::unordered_map<const Mesh *,
+                                       shared_ptr<const MeshBVH>>;
+    // position in instances
+    using InstanceMap = std::unordered_map<const Component *, uint32_t>;
+
+    static shared_ptr<const MeshBVH> buildMesh(const Mesh *mesh);
+    void addHierarchy(Component *component, AffineTransform worldT,
+                      const CollisionScene *previous, MeshMap *meshMap);
+    // copy with the moved components' instances (and their children's)
+    // updated
+    shared_ptr<const CollisionScene> moved(
+        const World *world, vector<Component *> &components) const;
+    void moveHierarchy(Component *component, AffineTransform worldT);
+    void setTransform(uint32_t index, const AffineTransform &worldT);
+
+    // shared by scenes updated from this one, which only differ in
+    // transforms
+    shared_ptr<const MeshMap> meshes;
+    shared_ptr<const InstanceMap> instanceIndices;
+    vector<Instance> instances;  // in leaf order
+    vector<BoundingBox> instanceBounds;  // world space, same order
+    BVH instanceBVH;  // world space
+    uint64_t _worldChanges = 0;
+    uint64_t generation = 0;  // World::generation() when built
+    uint64_t structureChanges = 0;  // World::structureChanges() when built
+    uint64_t moveCount = 0;  // World::moveCount() when built
+};
+
+// Holds the current scene. The main thread publishes new scenes while other
+// threads load and keep using older ones.
+class SharedCollisionScene
+{
+public:
+    shared_ptr<const CollisionScene> load() const;
+    void publish(shared_ptr<const CollisionScene> scene);
+
+private:
+    shared_ptr<const CollisionScene> scene;  // only use atomic functions
+};
+
+}  // namespace
@@ -0,0 +1,327 @@
+#include "commandbuffer.h"
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace diorama::render {
+
+const char * const PASS_NAMES[PASS_MAX] = {"opaque", "transparent", "debug"};
+
+void CommandBuffer::clear()
+{
+    _commands.clear();
+    _data.clear();
+    _lineVertices.clear();
+}
+
+void CommandBuffer::clearScreen()
+{
+    RenderCommand &command = push(RenderCommand::CLEAR);
+    command.clear.color = true;
+    command.clear.depth = true;
+}
+
+void CommandBuffer::clearDepth()
+{
+    RenderCommand &command = push(RenderCommand::CLEAR);
+    command.clear.color = false;
+    command.clear.depth = true;
+}
+
+void CommandBuffer::setViewport(int width, int height)
+{
+    RenderCommand &command = push(RenderCommand::SET_VIEWPORT);
+    command.viewport.width = width;
+    command.viewport.height = height;
+}
+
+void CommandBuffer::setCamera(const CameraBlock &camera)
+{
+    RenderCommand &command = push(RenderCommand::SET_CAMERA);
+    command.uniform.location = -1;
+    command.uniform.offset = pushData((const float *)&camera,
+                                      sizeof(CameraBlock) / sizeof(float));
+}
+
+void CommandBuffer::useProgram(GLProgram program)
+{
+    push(RenderCommand::USE_PROGRAM).object = program;
+}
+
+void CommandBuffer::bindTexture(int unit, GLTexture texture)
+{
+    RenderCommand &command = push(RenderCommand::BIND_TEXTURE);
+    command.texture.unit = unit;
+    command.texture.texture = texture;
+}
+
+void CommandBuffer::bindVertexArray(GLVertexArray vertexArray)
+{
+    push(RenderCommand::BIND_VERTEX_ARRAY).object = vertexArray;
+}
+
+void CommandBuffer::setUniform(GLUniformLocation location, int value)
+{
+    RenderCommand &command = push(RenderCommand::UNIFORM_1I);
+    command.uniformInt.location = location;
+    command.uniformInt.value = value;
+}
+
+void CommandBuffer::setUniform(GLUniformLocation location,
+                               const glm::vec2 &value)
+{
+    uint32_t offset = pushData(glm::value_ptr(value), 2);
+    RenderCommand &command = push(RenderCommand::UNIFORM_2F);
+    command.uniform.location = location;
+    command.uniform.offset = offset;
+}
+
+void CommandBuffer::setUniform(GLUniformLocation location,
+                               const glm::vec4 &value)
+{
+    uint32_t offset = pushData(glm::value_ptr(value), 4);
+    RenderCommand &command = push(RenderCommand::UNIFORM_4F);
+    command.uniform.location = location;
+    command.uniform.offset = offset;
+}
+
+void CommandBuffer::setUniform(GLUniformLocation location,
+                               const glm::mat3 &value)
+{
+    uint32_t offset = pushData(glm::value_ptr(value), 9);
+    RenderCommand &command = push(RenderCommand::UNIFORM_MATRIX_3F);
+    command.uniform.location = location;
+    command.uniform.offset = offset;
+}
+
+void CommandBuffer::setUniform(GLUniformLocation location,
+                               const glm::mat4 &value)
+{
+    uint32_t offset = pushData(glm::value_ptr(value), 16);
+    RenderCommand &command = push(RenderCommand::UNIFORM_MATRIX_4F);
+    command.uniform.location = location;
+    command.uniform.offset = offset;
+}
+
+void CommandBuffer::setCullFace(bool reversed)
+{
+    push(RenderCommand::SET_CULL_FACE).reversed = reversed;
+}
+
+void CommandBuffer::setRenderOrder(RenderOrder order)
+{
+    push(RenderCommand::SET_RENDER_ORDER).order = order;
+}
+
+void CommandBuffer::drawElements(int numIndices, int firstIndex)
+{
+    RenderCommand &command = push(RenderCommand::DRAW_ELEMENTS);
+    command.elements.first = firstIndex;
+    command.elements.count = numIndices;
+}
+
+void CommandBuffer::drawLines(const glm::vec3 *vertices, int numVertices)
+{
+    RenderCommand &command = push(RenderCommand::DRAW_LINES);
+    command.lines.first = _lineVertices.size();
+    command.lines.count = numVertices;
+    _lineVertices.insert(_lineVertices.end(), vertices, vertices + numVertices);
+}
+
+void CommandBuffer::beginPass(RenderPass pass)
+{
+    push(RenderCommand::BEGIN_PASS).pass = pass;
+}
+
+void CommandBuffer::endPass(RenderPass pass)
+{
+    push(RenderCommand::END_PASS).pass = pass;
+}
+
+const vector<RenderCommand> & CommandBuffer::commands() const
+{
+    return _commands;
+}
+
+const float * CommandBuffer::data(uint32_t offset) const
+{
+    return &_data[offset];
+}
+
+const vector<glm::vec3> & CommandBuffer::lineVertices() const
+{
+    return _lineVertices;
+}
+
+RenderCommand & CommandBuffer::push(RenderCommand::Type type)
+{
+    _commands.emplace_back();
+    RenderCommand &command = _commands.back();
+    command.type = type;
+    return command;
+}
+
+uint32_t CommandBuffer::pushData(const float *values, size_t count)
+{
+    uint32_t offset = _data.size();
+    _data.insert(_data.end(), values, values + count);
+    return offset;
+}
+
+
+StateCache::StateCache()
+{
+    invalidate();
+}
+
+void StateCache::invalidate()
+{
+    invalidateBindings();
+    reversed = -1;
+    order = -1;
+    viewportWidth = viewportHeight = -1;
+    cameraKnown = false;
+    uniforms.clear();
+    programUniforms = nullptr;
+}
+
+void StateCache::invalidateBindings()
+{
+    program = UNKNOWN;
+    programUniforms = nullptr;
+    textures.fill(UNKNOWN);
+    vertexArray = UNKNOWN;
+}
+
+bool StateCache::apply(const RenderCommand &command,
+                       const CommandBuffer &commands)
+{
+    bool needed = true;
+    switch (command.type) {
+    case RenderCommand::SET_VIEWPORT:
+        needed = command.viewport.width != viewportWidth
+            || command.viewport.height != viewportHeight;
+        viewportWidth = command.viewport.width;
+        viewportHeight = command.viewport.height;
+        break;
+    case RenderCommand::SET_CAMERA:
+        needed = !cameraKnown || memcmp(camera.data(),
+            commands.data(command.uniform.offset), sizeof(camera)) != 0;
+        memcpy(camera.data(), commands.data(command.uniform.offset),
+               sizeof(camera));
+        cameraKnown = true;
+        break;
+    case RenderCommand::USE_PROGRAM:
+        needed = command.object != program;
+        program = command.object;
+        programUniforms = &uniforms[program];
+        break;
+    case RenderCommand::BIND_TEXTURE:
+        if (command.texture.unit < MAX_TEXTURE_UNITS) {
+            GLTexture &bound = textures[command.texture.unit];
+            needed = command.texture.texture != bound;
+            bound = command.texture.texture;
+        }
+        break;
+    case RenderCommand::BIND_VERTEX_ARRAY:
+        needed = command.object != vertexArray;
+        vertexArray = command.object;
+        break;
+    case RenderCommand::UNIFORM_1I: {
+        float value;
+        static_assert(sizeof(value) == sizeof(command.uniformInt.value));
+        memcpy(&value, &command.uniformInt.value, sizeof(value));
+        needed = setUniform(command.uniformInt.location, &value, 1);
+        break;
+    }
+    case RenderCommand::UNIFORM_2F:
+        needed = setUniform(command.uniform.location,
+                            commands.data(command.uniform.offset), 2);
+        break;
+    case RenderCommand::UNIFORM_4F:
+        needed = setUniform(command.uniform.location,
+                            commands.data(command.uniform.offset), 4);
+        break;
+    case RenderCommand::UNIFORM_MATRIX_3F:
+        needed = setUniform(command.uniform.location,
+                            commands.data(command.uniform.offset), 9);
+        break;
+    case RenderCommand::UNIFORM_MATRIX_4F:
+        needed = setUniform(command.uniform.location,
+                            commands.data(command.uniform.offset), 16);
+        break;
+    case RenderCommand::SET_CULL_FACE:
+        needed = (int)command.reversed != reversed;
+        reversed = command.reversed;
+        break;
+    case RenderCommand::SET_RENDER_ORDER:
+        needed = (int)command.order != order;
+        order = (int)command.order;
+        break;
+    case RenderCommand::DRAW_LINES:
+        vertexArray = UNKNOWN;  // backends bind their own for lines
+        break;
+    default:
+        break;
+    }
+    if (!needed)
+        filteredCounts[command.type]++;
+    return needed;
+}
+
+void StateCache::resetCounts()
+{
+    filteredCounts.fill(0);
+}
+
+size_t StateCache::numFiltered() const
+{
+    size_t total = 0;
+    for (size_t count : filteredCounts)
+        total += count;
+    return total;
+}
+
+bool StateCache::setUniform(GLUniformLocation location, const float *values,
+                            int count)
+{
+    if (location < 0)
+        return false;  // not used by the program, GL would ignore it
+    if (!programUniforms || location >= MAX_CACHED_LOCATION)
+        return true;
+    if (location >= (int)programUniforms->size())
+        programUniforms->resize(location + 1);
+    UniformValue &uniform = (*programUniforms)[location];
+    if (uniform.count == count
+            && memcmp(uniform.values.data(), values, count * sizeof(float))
+                == 0)
+        return false;
+    uniform.count = count;
+    memcpy(uniform.values.data(), values, count * sizeof(float));
+    return true;
+}
+
+void NullBackend::init()
+{}
+
+void NullBackend::execute(const CommandBuffer &commands)
+{
+    // like GLBackend, bindings may have changed between frames
+    stateCache.invalidateBindings();
+    for (auto &command : commands.commands()) {
+        commandCounts[command.type]++;
+        stateCache.apply(command, commands);
+        if (command.type == RenderCommand::DRAW_ELEMENTS)
+            numTriangles += command.elements.count / 3;
+    }
+    numFrames++;
+}
+
+void NullBackend::resetCounts()
+{
+    commandCounts.fill(0);
+    stateCache.resetCounts();
+    numFrames = 0;
+    numTriangles = 0;
+}
+
+}  // namespace
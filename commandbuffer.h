@@ -0,0 +1,182 @@
+#pragma once
+#include "common.h"
+
+#include "glutils.h"
+#include "material.h"
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+namespace diorama::render {
+
+// sections of a frame which are timed separately
+enum RenderPass : uint8_t
+{
+    PASS_OPAQUE, PASS_TRANSPARENT, PASS_DEBUG, PASS_MAX
+};
+
+extern const char * const PASS_NAMES[PASS_MAX];
+
+struct RenderCommand
+{
+    enum Type : uint8_t
+    {
+        CLEAR,
+        SET_VIEWPORT,
+        SET_CAMERA,
+        USE_PROGRAM,
+        BIND_TEXTURE,
+        BIND_VERTEX_ARRAY,
+        UNIFORM_1I,
+        UNIFORM_2F,
+        UNIFORM_4F,
+        UNIFORM_MATRIX_3F,
+        UNIFORM_MATRIX_4F,
+        SET_CULL_FACE,
+        SET_RENDER_ORDER,
+        DRAW_ELEMENTS,
+        DRAW_LINES,
+        BEGIN_PASS,
+        END_PASS,
+        TYPE_MAX
+    };
+
+    Type type;
+    union {
+        GLObject object;  // USE_PROGRAM, BIND_VERTEX_ARRAY
+        struct { bool color, depth; } clear;
+        struct { int width, height; } viewport;
+        struct { int unit; GLTexture texture; } texture;
+        // offset into CommandBuffer::data() (also used by SET_CAMERA)
+        struct { GLUniformLocation location; uint32_t offset; } uniform;
+        struct { GLUniformLocation location; int32_t value; } uniformInt;
+        bool reversed;  // SET_CULL_FACE: cull front faces instead of back faces
+        RenderOrder order;
+        struct { uint32_t first, count; } elements;
+        // range of CommandBuffer::lineVertices()
+        struct { uint32_t first, count; } lines;
+        RenderPass pass;
+    };
+};
+
+// A recorded frame of rendering commands. Produced by the Renderer without
+// touching GL, then executed by a RenderBackend.
+class CommandBuffer
+{
+public:
+    void clear();
+
+    void clearScreen();
+    void clearDepth();
+    void setViewport(int width, int height);
+    void setCamera(const CameraBlock &camera);
+    void useProgram(GLProgram program);
+    void bindTexture(int unit, GLTexture texture);
+    void bindVertexArray(GLVertexArray vertexArray);
+    void setUniform(GLUniformLocation location, int value);
+    void setUniform(GLUniformLocation location, const glm::vec2 &value);
+    void setUniform(GLUniformLocation location, const glm::vec4 &value);
+    void setUniform(GLUniformLocation location, const glm::mat3 &value);
+    void setUniform(GLUniformLocation location, const glm::mat4 &value);
+    void setCullFace(bool reversed);
+    void setRenderOrder(RenderOrder order);
+    void drawElements(int numIndices, int firstIndex = 0);
+    // vertices are pairs of line endpoints
+    void drawLines(const glm::vec3 *vertices, int numVertices);
+    // passes can't be nested
+    void beginPass(RenderPass pass);
+    void endPass(RenderPass pass);
+
+    const vector<RenderCommand> & commands() const;
+    const float * data(uint32_t offset) const;
+    const vector<glm::vec3> & lineVertices() const;
+
+private:
+    RenderCommand & push(RenderCommand::Type type);
+    uint32_t pushData(const float *values, size_t count);
+
+    vector<RenderCommand> _commands;
+    vector<float> _data;  // uniform values
+    vector<glm::vec3> _lineVertices;
+};
+
+// GL state set by executed commands, to skip commands that wouldn't change
+// it: the program, texture and vertex array bindings, cull face, render
+// order, viewport, camera and the uniform values of each program. Doesn't call
+// GL itself, so NullBackend can count what would be filtered.
+class StateCache
+{
+public:
+    static const int MAX_TEXTURE_UNITS = 8;
+
+    StateCache();
+
+    // nothing is skipped until it's set again
+    void invalidate();
+    // for bindings changed outside of commands, eg. by loading or texture
+    // streaming. uniforms are kept, they belong to the programs
+    void invalidateBindings();
+
+    // false if the command can be skipped. records the state it sets
+    bool apply(const RenderCommand &command, const CommandBuffer &commands);
+
+    void resetCounts();
+    size_t numFiltered() const;
+
+    // skipped since the last reset
+    array<size_t, RenderCommand::TYPE_MAX> filteredCounts {};
+
+private:
+    static constexpr GLObject UNKNOWN = ~(GLObject)0;
+    // uniforms at higher locations aren't cached
+    static const int MAX_CACHED_LOCATION = 256;
+
+    struct UniformValue
+    {
+        int count = 0;  // 0 if unknown
+        array<float, 16> values;
+    };
+
+    // for the current program
+    bool setUniform(GLUniformLocation location, const float *values,
+                    int count);
+
+    GLProgram program = UNKNOWN;
+    array<GLTexture, MAX_TEXTURE_UNITS> textures;
+    GLVertexArray vertexArray = UNKNOWN;
+    int reversed = -1;  // -1 if unknown
+    int order = -1;
+    int viewportWidth = -1, viewportHeight = -1;
+    bool cameraKnown = false;
+    array<float, sizeof(CameraBlock) / sizeof(float)> camera;
+    // by program, indexed by location
+    std::unordered_map<GLProgram, vector<UniformValue>> uniforms;
+    vector<UniformValue> *programUniforms = nullptr;  // current program
+};
+
+class RenderBackend
+{
+public:
+    virtual ~RenderBackend() = default;
+
+    virtual void init() = 0;
+    virtual void execute(const CommandBuffer &commands) = 0;
+};
+
+// Doesn't render anything, just counts commands. For measuring the CPU side of
+// the renderer without a GL context.
+class NullBackend : public RenderBackend
+{
+public:
+    void init() override;
+    void execute(const CommandBuffer &commands) override;
+
+    void resetCounts();
+
+    // totals since the last reset
+    array<size_t, RenderCommand::TYPE_MAX> commandCounts {};
+    StateCache stateCache;  // counts what GLBackend would skip
+    size_t numFrames = 0;
+    size_t numTriangles = 0;
+};
+
+}  // namespace
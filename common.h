@@ -2,6 +2,7 @@
 
 #include <memory>
 using std::unique_ptr;
+using std::shared_ptr;
 
 #include <string>
 using std::string;
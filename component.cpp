@@ -10,6 +10,7 @@ Component::Component(const Component &other)
     : name(other.name)
     , mesh(other.mesh)
     , material(other.material)
+    , dynamic(other.dynamic)
     , _tLocal(other._tLocal)
 {}
 
@@ -18,6 +19,7 @@ Component & Component::operator=(const Component &rhs)
     this->name = rhs.name;
     this->mesh = rhs.mesh;
     this->material = rhs.material;
+    this->dynamic = rhs.dynamic;
     this->_tLocal = rhs._tLocal;
     return *this;
 }
@@ -25,7 +27,8 @@ Component & Component::operator=(const Component &rhs)
 Component::~Component()
 {
     for (auto &child : _children) {
-        delete child;
+        if (!child->_inArena)
+            delete child;
     }
 }
 
@@ -36,6 +39,8 @@ const Transform & Component::tLocal() const
 
 Transform & Component::tLocalMut()
 {
+    if (_world)
+        _world->componentMoved(this);
     return _tLocal;
 }
 
@@ -48,6 +53,7 @@ void Component::setParent(Component *parent)
 {
     if (parent == _parent)
         return;
+    World *oldWorld = _world;
     if (_parent) {
         auto &childrenVec = _parent->_children;
         // TODO fast remove without preserving order
@@ -56,24 +62,29 @@ void Component::setParent(Component *parent)
             childrenVec.erase(childIt);
     }
     _parent = parent;
-    if (parent) {
+    if (parent)
         parent->_children.push_back(this);
-        setWorld(parent->world());
-    } else {
-        setWorld(nullptr);
+    // reparenting within a world leaves the index alone
+    World *newWorld = parent ? parent->_world : nullptr;
+    if (oldWorld != newWorld) {
+        if (oldWorld)
+            oldWorld->removeHierarchy(this);
+        if (newWorld)
+            newWorld->addHierarchy(this);
     }
 }
 
-const vector<Component *> Component::children() const
+const vector<Component *> & Component::children() const
 {
     return _children;
 }
 
-Component * Component::cloneHierarchy() const
+Component * Component::cloneHierarchy(World *world) const
 {
-    Component *copy = new Component(*this);
+    Component *copy = world ? world->createComponent(*this)
+        : new Component(*this);
     for (auto &child : _children) {
-        Component *childCopy = child->cloneHierarchy();
+        Component *childCopy = child->cloneHierarchy(world);
         // should have no world so this should be fine
         childCopy->setParent(copy);
     }
@@ -89,10 +100,10 @@ void Component::setWorld(World *world)
 {
     if (world == _world)
         return;
-    if (_world)
-        _world->removeHierarchy(this);
-    _world = world;
-    if (world);
+    World *oldWorld = _world;
+    if (oldWorld)
+        oldWorld->removeHierarchy(this);
+    if (world)
         world->addHierarchy(this);
 }
 
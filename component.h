@@ -23,20 +23,27 @@ public:
     const Mesh *mesh = nullptr;  // could be null
     // overrides defaults in mesh and children. null for default
     const Material *material = nullptr;
+    // moves at runtime, with its children. static collision structures are
+    // baked once and skip dynamic components
+    bool dynamic = false;
 
     const Transform & tLocal() const;
-    Transform & tLocalMut();
+    Transform & tLocalMut();  // tells the world the component moved
 
     Component * parent() const;
     // parent takes ownership of child
     // if parent is null, caller is expected to take ownership
     void setParent(Component *parent);
-    const vector<Component *> children() const;
+    const vector<Component *> & children() const;
 
-    Component * cloneHierarchy() const;
+    // if world is given, the copies are created in its arena (but not added
+    // to it until they're under its root)
+    Component * cloneHierarchy(World *world = nullptr) const;
 
+    // the world of the root, stored on every component. World updates it
+    // when a hierarchy is added or removed
     World * world() const;
-    void setWorld(World *world);  // called by World
+    void setWorld(World *world);  // called by World, on its root
 
 private:
     Transform _tLocal;
@@ -46,6 +53,11 @@ private:
     vector<Component *> _children;
 
     World *_world = nullptr;
+    bool _inArena = false;  // destroyed by World, not by the parent
+    // in the World's list for this name, UINT32_MAX if not there
+    uint32_t _nameIndex = UINT32_MAX;
+
+    friend class World;
 };
 
 }  // namespace
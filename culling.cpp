@@ -0,0 +1,221 @@
+#include "culling.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace diorama::render {
+
+// level sizes are WIDTH >> level by HEIGHT >> level
+const int OCCLUSION_LEVELS = 8;
+// bounds are tested at the first level where they cover at most this many
+// texels in each direction
+const int MAX_TEST_TEXELS = 4;
+
+static const float EMPTY_DEPTH = std::numeric_limits<float>::infinity();
+
+// https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+Frustum::Frustum(const glm::mat4 &cameraMatrix)
+{
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(cameraMatrix[0][i], cameraMatrix[1][i],
+                            cameraMatrix[2][i], cameraMatrix[3][i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        planes[i * 2] = rows[3] + rows[i];
+        planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+}
+
+bool Frustum::intersects(const BoundingBox &box) const
+{
+    for (auto &plane : planes) {
+        // corner farthest along the plane normal
+        glm::vec3 corner(
+            plane.x > 0 ? box.max.x : box.min.x,
+            plane.y > 0 ? box.max.y : box.min.y,
+            plane.z > 0 ? box.max.z : box.min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0)
+            return false;
+    }
+    return true;
+}
+
+void OcclusionBuffer::begin(const glm::mat4 &cameraMatrix, float nearClip)
+{
+    this->cameraMatrix = cameraMatrix;
+    this->nearClip = nearClip;
+    levels.resize(OCCLUSION_LEVELS);
+    for (int level = 0; level < OCCLUSION_LEVELS; level++) {
+        levels[level].assign((WIDTH >> level) * (HEIGHT >> level),
+                             EMPTY_DEPTH);
+    }
+}
+
+void OcclusionBuffer::addOccluder(const glm::mat4 &modelMatrix,
+                                  const glm::vec3 *vertices,
+                                  size_t numVertices, bool reversed)
+{
+    glm::mat4 mvp = cameraMatrix * modelMatrix;
+    for (size_t i = 0; i + 2 < numVertices; i += 3) {
+        glm::vec4 in[3];
+        for (int j = 0; j < 3; j++)
+            in[j] = mvp * glm::vec4(vertices[i + j], 1);
+        if (reversed)
+            std::swap(in[1], in[2]);
+
+        // clip against the near plane, leaving up to 4 vertices
+        glm::vec4 clipped[4];
+        int count = 0;
+        for (int j = 0; j < 3; j++) {
+            const glm::vec4 &a = in[j], &b = in[(j + 1) % 3];
+            bool aIn = a.w >= nearClip, bIn = b.w >= nearClip;
+            if (aIn)
+                clipped[count++] = a;
+            if (aIn != bIn) {
+                float t = (nearClip - a.w) / (b.w - a.w);
+                clipped[count++] = glm::mix(a, b, t);
+            }
+        }
+        for (int j = 1; j + 1 < count; j++)
+            rasterize(clipped[0], clipped[j], clipped[j + 1]);
+    }
+}
+
+void OcclusionBuffer::rasterize(glm::vec4 a, glm::vec4 b, glm::vec4 c)
+{
+    glm::vec2 p[3];
+    float invW[3];
+    const glm::vec4 *clip[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++) {
+        invW[i] = 1 / clip[i]->w;
+        p[i] = (glm::vec2(*clip[i]) * invW[i] + glm::vec2(1))
+            * glm::vec2(WIDTH / 2, HEIGHT / 2);
+    }
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y)
+        - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    // back facing or degenerate. back faces aren't drawn, so they can't
+    // hide anything
+    if (area < 1e-6f)
+        return;
+
+    glm::vec2 lo = glm::min(p[0], glm::min(p[1], p[2]));
+    glm::vec2 hi = glm::max(p[0], glm::max(p[1], p[2]));
+    int x0 = glm::max((int)std::floor(lo.x), 0);
+    int y0 = glm::max((int)std::floor(lo.y), 0);
+    int x1 = glm::min((int)std::ceil(hi.x), WIDTH) - 1;
+    int y1 = glm::min((int)std::ceil(hi.y), HEIGHT) - 1;
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // edge functions e = A x + B y + C, positive inside. edge i is opposite
+    // vertex i, so e[i] / area is the barycentric weight of vertex i
+    glm::vec3 edges[3];
+    for (int i = 0; i < 3; i++) {
+        glm::vec2 from = p[(i + 1) % 3], to = p[(i + 2) % 3];
+        float A = from.y - to.y, B = to.x - from.x;
+        edges[i] = glm::vec3(A, B, -(A * from.x + B * from.y));
+    }
+    // 1/w is linear in screen space
+    glm::vec3 depthPlane = (edges[0] * invW[0] + edges[1] * invW[1]
+        + edges[2] * invW[2]) / area;
+    // how far each function can drop from the pixel center to a corner
+    float edgeSlack[3];
+    for (int i = 0; i < 3; i++)
+        edgeSlack[i] = 0.5f * (std::abs(edges[i].x) + std::abs(edges[i].y));
+    float depthSlack = 0.5f
+        * (std::abs(depthPlane.x) + std::abs(depthPlane.y));
+
+    vector<float> &depth = levels[0];
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            glm::vec3 center(x + 0.5f, y + 0.5f, 1);
+            if (glm::dot(edges[0], center) < edgeSlack[0]
+                    || glm::dot(edges[1], center) < edgeSlack[1]
+                    || glm::dot(edges[2], center) < edgeSlack[2])
+                continue;  // not entirely covered
+            float farInvW = glm::dot(depthPlane, center) - depthSlack;
+            if (farInvW <= 0)
+                continue;
+            float &pixel = depth[y * WIDTH + x];
+            pixel = glm::min(pixel, 1 / farInvW);
+        }
+    }
+}
+
+void OcclusionBuffer::buildHierarchy()
+{
+    for (int level = 1; level < OCCLUSION_LEVELS; level++) {
+        const vector<float> &src = levels[level - 1];
+        vector<float> &dst = levels[level];
+        int srcWidth = WIDTH >> (level - 1);
+        int width = WIDTH >> level, height = HEIGHT >> level;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float *row0 = &src[(y * 2) * srcWidth + x * 2];
+                const float *row1 = row0 + srcWidth;
+                dst[y * width + x] = glm::max(glm::max(row0[0], row0[1]),
+                                              glm::max(row1[0], row1[1]));
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::visible(const BoundingBox &worldBounds) const
+{
+    glm::vec2 lo(std::numeric_limits<float>::max());
+    glm::vec2 hi(-std::numeric_limits<float>::max());
+    float nearest = std::numeric_limits<float>::max();
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner(
+            (i & 1) ? worldBounds.max.x : worldBounds.min.x,
+            (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+            (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+        glm::vec4 clip = cameraMatrix * glm::vec4(corner, 1);
+        if (clip.w < nearClip)
+            return true;  // crosses the near plane
+        glm::vec2 screen = (glm::vec2(clip) / clip.w + glm::vec2(1))
+            * glm::vec2(WIDTH / 2, HEIGHT / 2);
+        lo = glm::min(lo, screen);
+        hi = glm::max(hi, screen);
+        nearest = glm::min(nearest, clip.w);
+    }
+    int x0 = glm::max((int)std::floor(lo.x), 0);
+    int y0 = glm::max((int)std::floor(lo.y), 0);
+    int x1 = glm::min((int)std::floor(hi.x), WIDTH - 1);
+    int y1 = glm::min((int)std::floor(hi.y), HEIGHT - 1);
+    if (x0 > x1 || y0 > y1)
+        return false;  // off screen
+
+    int level = 0;
+    while (level + 1 < OCCLUSION_LEVELS
+            && ((x1 >> level) - (x0 >> level) >= MAX_TEST_TEXELS
+                || (y1 >> level) - (y0 >> level) >= MAX_TEST_TEXELS))
+        level++;
+    const vector<float> &depth = levels[level];
+    int width = WIDTH >> level;
+    for (int y = y0 >> level; y <= y1 >> level; y++) {
+        for (int x = x0 >> level; x <= x1 >> level; x++) {
+            if (depth[y * width + x] >= nearest)
+                return true;
+        }
+    }
+    return false;
+}
+
+vector<glm::vec3> selectOccluders(const vector<glm::vec3> &vertices,
+                                  const vector<MeshIndex> &indices,
+                                  float minArea)
+{
+    vector<glm::vec3> occluders;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        glm::vec3 a = vertices[indices[i]];
+        glm::vec3 b = vertices[indices[i + 1]];
+        glm::vec3 c = vertices[indices[i + 2]];
+        if (glm::length(glm::cross(b - a, c - a)) * 0.5f >= minArea)
+            occluders.insert(occluders.end(), {a, b, c});
+    }
+    return occluders;
+}
+
+}  // namespace
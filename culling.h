@@ -0,0 +1,62 @@
+#pragma once
+#include "common.h"
+
+#include "mesh.h"
+#include "mathutils.h"
+
+namespace diorama::render {
+
+// triangles smaller than this (in square model units) don't make useful
+// occluders
+const float MIN_OCCLUDER_AREA = 144;
+
+// Planes of the view volume of a projection * view matrix.
+class Frustum
+{
+public:
+    Frustum(const glm::mat4 &cameraMatrix);
+
+    // can be true for boxes just outside the corners
+    bool intersects(const BoundingBox &box) const;
+
+private:
+    array<glm::vec4, 6> planes;  // points inside have dot(plane, p) >= 0
+};
+
+// Low resolution depth buffer of large occluders, rasterized on the CPU, with
+// a hierarchy of farthest depths for testing bounds against it. Depth is
+// distance along the view direction (clip space w). Only pixels entirely
+// covered by a triangle are written, at the triangle's farthest depth within
+// the pixel, so a visible object is never reported as hidden.
+class OcclusionBuffer
+{
+public:
+    static const int WIDTH = 256, HEIGHT = 128;
+
+    // clears the buffer
+    void begin(const glm::mat4 &cameraMatrix, float nearClip);
+    // triangle list in model space. back faces are skipped like the
+    // renderer culls them, reversed for mirrored models (see DrawCall)
+    void addOccluder(const glm::mat4 &modelMatrix, const glm::vec3 *vertices,
+                     size_t numVertices, bool reversed = false);
+    // call after adding occluders, before testing
+    void buildHierarchy();
+    bool visible(const BoundingBox &worldBounds) const;
+
+private:
+    // vertices in clip space, in front of the near plane, counter-clockwise
+    // on screen if front facing
+    void rasterize(glm::vec4 a, glm::vec4 b, glm::vec4 c);
+
+    glm::mat4 cameraMatrix {1};
+    float nearClip = 1;
+    // level 0 is full resolution, each level after is half the size
+    vector<vector<float>> levels;
+};
+
+// large triangles of a render primitive, as a triangle list
+vector<glm::vec3> selectOccluders(const vector<glm::vec3> &vertices,
+                                  const vector<MeshIndex> &indices,
+                                  float minArea = MIN_OCCLUDER_AREA);
+
+}  // namespace
@@ -1,6 +1,12 @@
 #include "game.h"
 #include "load_skp.h"
-#include <exception>
+#include "log.h"
+#include "profiler.h"
+#include "staticbatch.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace diorama {
@@ -8,113 +14,411 @@ namespace diorama {
 const float LOOK_SPEED = 0.007;
 const float FLY_SPEED_ADJUST = 0.2f;
 const float PLAYER_RADIUS = 24.0f;
+const float MAX_HASH_CELLS_MOVED = 4;  // per frame
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
 
 Game::Game(SDL_Window *window)
     : window(window)
-    , renderer(&shaders)
+    , renderer(&shaders, &glBackend)
 {}
 
 void Game::main(const vector<string> args)
 {
-    if (args.size() < 2) {
-        throw std::exception("Please specify a map file");
+    string path;
+    bool headless = false;
+    bool staticBatching = false;
+    int textureBudgetMB = 0;  // 0 to load all texture levels
+    string shaderCacheDir = "shadercache";  // empty to always compile
+    int benchmarkFrames = 300;
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "--headless") {
+            headless = true;
+        } else if (args[i] == "--frames" && i + 1 < args.size()) {
+            benchmarkFrames = std::stoi(args[++i]);
+        } else if (args[i] == "--software") {
+            // handled by main
+        } else if (args[i] == "--static-batching") {
+            staticBatching = true;
+        } else if (args[i] == "--texture-budget" && i + 1 < args.size()) {
+            textureBudgetMB = std::stoi(args[++i]);
+        } else if (args[i] == "--shader-cache" && i + 1 < args.size()) {
+            shaderCacheDir = args[++i];
+        } else if (args[i] == "--no-shader-cache") {
+            shaderCacheDir.clear();
+        } else if (args[i] == "--no-occlusion") {
+            renderer.setOcclusionCulling(false);
+        } else if (args[i] == "--verbose") {
+            setVerbosity(Verbosity::Verbose);
+        } else if (args[i] == "--quiet") {
+            setVerbosity(Verbosity::Quiet);
+        } else if (args[i] == "--record" && i + 1 < args.size()) {
+            recordPath = args[++i];
+        } else if (args[i] == "--stats-csv" && i + 1 < args.size()) {
+            statsCSV.open(args[++i]);
+            if (!statsCSV)
+                throw std::runtime_error("Couldn't write stats file");
+            overlay.writeCSVHeader(statsCSV);
+        } else if (args[i] == "--profile" && i + 1 < args.size()) {
+            profilePath = args[++i];
+        } else if (args[i] == "--replay" && i + 1 < args.size()) {
+            recording.load(args[++i]);
+            replaying = true;
+        } else {
+            path = args[i];
+        }
+    }
+    if (path.empty()) {
+        throw std::runtime_error("Please specify a map file");
     }
-    string path = args[1];
     if (path.compare(path.length() - 4, 4, ".skb") == 0) {
-        throw std::exception(
+        throw std::runtime_error(
             "That's a backup file! Look for .skp extension instead.");
     }
 
     renderer.initGL();
-    shaders.linkPrograms();  // after initial OpenGL state is set
+    // after initial OpenGL state is set
+    shaders.linkPrograms(shaderCacheDir);
 
     int winW, winH;
-    SDL_GetWindowSize(window, &winW, &winH);
+    getWindowSize(&winW, &winH);
     renderer.resizeWindow(winW, winH);
 
+    if (!profilePath.empty() && !profiler::enabled())
+        cout << "Profiler is disabled, build with DIORAMA_PROFILE\n";
+
     {
-        SkpLoader loader(path, &world, &shaders);
+        PROFILE_ZONE("Game::load");
+        SkpLoader loader(path, &world, &shaders, staticBatching,
+                         textureBudgetMB > 0);
         loader.loadGlobal();
+        if (textureBudgetMB > 0) {
+            textureStreamer = std::make_unique<render::TextureStreamer>(
+                (size_t)textureBudgetMB << 20);
+            for (auto *array : loader.textureArrays()) {
+                if (!array->layerFiles.empty())
+                    textureStreamer->addArray(array);
+            }
+            renderer.setTextureStreamer(textureStreamer.get());
+        }
         world.setRoot(loader.loadRoot());
+        if (staticBatching) {
+            auto stats = render::buildStaticBatches(&world);
+            cout << "Batched " <<stats.primitives<< " primitives of "
+                <<stats.components<< " components into " <<stats.batches
+                << " batches\n";
+        }
+        spatialHash.build(&world);
+        updateCollision();
     }
 
+    if (headless)
+        runBenchmark(replaying ? recording.frames.size() : benchmarkFrames);
+    else
+        runInteractive();
+
+    if (!recordPath.empty())
+        recording.save(recordPath);
+    if (!profilePath.empty() && profiler::enabled())
+        profiler::writeChromeTrace(profilePath);
+}
+
+void Game::runInteractive()
+{
     int startTick = SDL_GetTicks();
     int prevTick = 0;
+    size_t replayFrame = 0;
+    int divergedFrames = 0;
+    double totalFrameTime = 0, totalCollisionTime = 0;
+    size_t totalDraws = 0;
+    auto prevFrame = Clock::now();
     while (running) {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
-            case SDL_WINDOWEVENT:
-                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-                    renderer.resizeWindow(
-                        event.window.data1, event.window.data2);
-                }
-                break;
-            case SDL_KEYDOWN:
-                keyDown(event.key);
-                break;
-            case SDL_KEYUP:
-                keyUp(event.key);
-                break;
-            case SDL_MOUSEMOTION:
-                camYaw -= event.motion.xrel * LOOK_SPEED;
-                camPitch -= event.motion.yrel * LOOK_SPEED;
-                camPitch = glm::clamp(camPitch,
-                    -glm::pi<float>() / 2, glm::pi<float>() / 2);
-                break;
-            case SDL_MOUSEWHEEL:
-                flySpeed *= glm::exp(event.wheel.y * FLY_SPEED_ADJUST);
-                break;
-            case SDL_QUIT:
-                running = false;
-                break;
-            }
-        }
+        PROFILE_ZONE("Game::frame");
+        pollEvents();
         int tick = SDL_GetTicks() - startTick;
-        float time = tick / 1000.0f;
         float deltaTime = (tick - prevTick) / 1000.0f;
         prevTick = tick;
 
-        Transform camTransform = Transform::rotate(camYaw, Transform::UP);
-        camTransform *= Transform::rotate(camPitch, Transform::RIGHT);
-        
-        glm::vec3 flyVec = flyPos + flyNeg;
-        if (flyVec != glm::vec3(0)) {
-            flyVec = glm::normalize(flyVec);
-            flyVec *= deltaTime * flySpeed;
+        if (replaying) {
+            if (replayFrame >= recording.frames.size())
+                break;
+            applyInput(recording.frames[replayFrame]);
+        }
+        if (replaying || !recordPath.empty())
+            deltaTime = recording.timestep;
+
+        auto frameStart = Clock::now();
+        physics::collisionStats() = physics::CollisionStats();
+        Transform camTransform;
+        {
+            PROFILE_ZONE("Game::physics");
+            camTransform = updatePlayer(deltaTime);
         }
-        flyVec = camTransform.transformVector(flyVec);
-        glm::vec3 testPos = camPos + flyVec;
-
-        playerCollisions.clear();
-        physics::sphereCollision(&world, testPos, PLAYER_RADIUS,
-                                 playerCollisions);
-        glm::vec3 totalNormal{0};
-        for (auto &collision : playerCollisions) {
-            glm::vec3 toCenter = testPos - collision.point;
-            float depth = PLAYER_RADIUS - glm::length(toCenter);
-            // alternatively use normalize(toCenter) instead
-            totalNormal += collision.normal * depth;
+        if (replaying) {
+            if (camPos != recording.frames[replayFrame].camPos)
+                divergedFrames++;
+            replayFrame++;
+        } else if (!recordPath.empty()) {
+            recording.frames.push_back(captureInput());
         }
-        totalNormal = glm::normalize(totalNormal);
-        float flyVecDotNormal = glm::dot(flyVec, totalNormal);
-        if (flyVecDotNormal < 0) {
-            // project flyVec onto plane with normal
-            flyVec -= totalNormal * flyVecDotNormal;
+
+        {
+            PROFILE_ZONE("Game::render");
+            // shows stats from the previous frame
+            overlay.draw(&renderer);
+            renderer.render(&world, camTransform);
         }
+        // for the next frame, after this frame's changes to the world
+        updateCollision();
+        collectGPUTimes();
+        totalFrameTime += millisecondsSince(frameStart);
+        totalCollisionTime += collisionTime;
+        totalDraws += renderer.stats().drawCalls;
+
+        FrameStats stats;
+        stats.frameMs = millisecondsSince(prevFrame);
+        prevFrame = Clock::now();
+        stats.render = renderer.stats();
+        stats.collisionTriangles = physics::collisionStats().trianglesTested;
+        stats.filteredCommands = glBackend.stateCache().numFiltered();
+        for (int pass = 0; pass < render::PASS_MAX; pass++)
+            stats.gpuMs[pass] = gpuPassTimes[pass].latest();
+        overlay.addFrame(stats);
+        if (statsCSV.is_open())
+            overlay.writeCSVRow(statsCSV);
+
+        {
+            PROFILE_ZONE("Game::swap");
+            SDL_GL_SwapWindow(window);
+        }
+    }
+
+    if (replaying && replayFrame > 0) {
+        cout << "Replayed " <<replayFrame<< " frames\n";
+        cout << "  frame (CPU) avg " <<(totalFrameTime / replayFrame)<< " ms\n";
+        cout << "  collision avg " <<(totalCollisionTime / replayFrame)
+            << " ms\n";
+        cout << "  draws avg " <<(totalDraws / replayFrame)<< "\n";
+        if (divergedFrames)
+            cout << "  " <<divergedFrames<< " frames diverged!\n";
+    }
+    for (int pass = 0; pass < render::PASS_MAX; pass++)
+        printTimingSummary(string("GPU ") + render::PASS_NAMES[pass],
+                           gpuPassTimes[pass]);
+}
+
+void Game::pollEvents()
+{
+    PROFILE_ZONE("Game::input");
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                renderer.resizeWindow(
+                    event.window.data1, event.window.data2);
+            }
+            break;
+        case SDL_KEYDOWN:
+            keyDown(event.key);
+            break;
+        case SDL_KEYUP:
+            keyUp(event.key);
+            break;
+        case SDL_MOUSEMOTION:
+            camYaw -= event.motion.xrel * LOOK_SPEED;
+            camPitch -= event.motion.yrel * LOOK_SPEED;
+            camPitch = glm::clamp(camPitch,
+                -glm::pi<float>() / 2, glm::pi<float>() / 2);
+            break;
+        case SDL_MOUSEWHEEL:
+            flySpeed *= glm::exp(event.wheel.y * FLY_SPEED_ADJUST);
+            break;
+        case SDL_QUIT:
+            running = false;
+            break;
+        }
+    }
+}
 
-        camPos += flyVec;
-        camTransform = Transform::translate(camPos) * camTransform;
+Transform Game::updatePlayer(float deltaTime)
+{
+    Transform camTransform = Transform::rotate(camYaw, Transform::UP);
+    camTransform *= Transform::rotate(camPitch, Transform::RIGHT);
+
+    glm::vec3 flyVec = flyPos + flyNeg;
+    if (flyVec != glm::vec3(0)) {
+        flyVec = glm::normalize(flyVec);
+        flyVec *= deltaTime * flySpeed;
+    }
+    flyVec = camTransform.transformVector(flyVec);
+
+    // updated by updateCollision() at the end of the previous frame
+    auto scene = collisionScene.load();
+
+    auto collisionStart = Clock::now();
+    // swept, so fast movement can't tunnel through thin walls.
+    // the hash only looks at nearby cells, long sweeps are better in the BVHs
+    if (glm::length(flyVec) < spatialHash.cellSize() * MAX_HASH_CELLS_MOVED)
+        camPos = spatialHash.slideSphere(camPos, PLAYER_RADIUS, flyVec);
+    else
+        camPos = scene->slideSphere(camPos, PLAYER_RADIUS, flyVec);
+    collisionTime = millisecondsSince(collisionStart);
+    return Transform::translate(camPos) * camTransform;
+}
+
+void Game::updateCollision()
+{
+    PROFILE_ZONE("Game::updateCollision");
+    auto scene = collisionScene.load();
+    if (!scene || scene->worldChanges() != world.changeCount())
+        collisionScene.publish(
+            physics::CollisionScene::update(&world, scene.get()));
+    spatialHash.update(&world);
+}
+
+InputFrame Game::captureInput() const
+{
+    InputFrame input;
+    input.camYaw = camYaw;
+    input.camPitch = camPitch;
+    input.fly = flyPos + flyNeg;
+    input.flySpeed = flySpeed;
+    input.camPos = camPos;
+    return input;
+}
+
+void Game::applyInput(const InputFrame &input)
+{
+    camYaw = input.camYaw;
+    camPitch = input.camPitch;
+    // flyNeg is only used to combine opposite keys
+    flyPos = input.fly;
+    flyNeg = glm::vec3(0);
+    flySpeed = input.flySpeed;
+}
+
+void Game::runBenchmark(int numFrames)
+{
+    int winW, winH;
+    getWindowSize(&winW, &winH);
+    render::Framebuffer framebuffer;
+    framebuffer.create(winW, winH);
+
+    struct FrameResult
+    {
+        double cpuMs, collisionMs;
+        int draws;
+    };
+    vector<FrameResult> results;
+    results.reserve(numFrames);
+    uint64_t firstGPUFrame = glBackend.frameCount();
 
+    for (int frame = 0; frame < numFrames; frame++) {
+        auto start = Clock::now();
+        Transform camTransform;
+        if (replaying) {
+            applyInput(recording.frames[frame]);
+            camTransform = updatePlayer(recording.timestep);
+        } else {
+            // turn in place once over the whole run
+            camYaw = glm::two_pi<float>() * frame / numFrames;
+            camPitch = 0;
+            camTransform = Transform::translate(camPos)
+                * Transform::rotate(camYaw, Transform::UP);
+            // replays as turning with no movement
+            if (!recordPath.empty())
+                recording.frames.push_back(captureInput());
+        }
         renderer.render(&world, camTransform);
+        updateCollision();
+        results.push_back(FrameResult {
+            millisecondsSince(start),
+            replaying ? collisionTime : 0,
+            renderer.stats().drawCalls});
+    }
+    // GPU results arrive late, so print everything at the end
+    glBackend.finishGPUTimes();
+    // frames without any passes have no results
+    vector<render::GPUFrameTimes> gpuTimes(numFrames);
+    for (auto &times : glBackend.takeGPUTimes()) {
+        if (times.frame >= firstGPUFrame
+                && times.frame - firstGPUFrame < (uint64_t)numFrames)
+            gpuTimes[times.frame - firstGPUFrame] = times;
+    }
+
+    TimingHistory cpuHistory(0);
+    array<TimingHistory, render::PASS_MAX> passHistory;
+    passHistory.fill(TimingHistory(0));
+    cout << "frame,cpu_ms";
+    for (auto name : render::PASS_NAMES)
+        cout << ",gpu_" <<name<< "_ms";
+    cout << ",collision_ms,draws\n";
+    for (int frame = 0; frame < numFrames; frame++) {
+        const FrameResult &result = results[frame];
+        cout <<frame<< "," <<result.cpuMs;
+        cpuHistory.add(result.cpuMs);
+        for (int pass = 0; pass < render::PASS_MAX; pass++) {
+            // empty if the pass wasn't recorded
+            cout << ",";
+            if (gpuTimes[frame].used[pass]) {
+                cout <<gpuTimes[frame].passMs[pass];
+                passHistory[pass].add(gpuTimes[frame].passMs[pass]);
+            }
+        }
+        cout << "," <<result.collisionMs<< "," <<result.draws<< "\n";
+    }
 
-        SDL_GL_SwapWindow(window);
+    printTimingSummary("CPU", cpuHistory);
+    for (int pass = 0; pass < render::PASS_MAX; pass++)
+        printTimingSummary(string("GPU ") + render::PASS_NAMES[pass],
+                           passHistory[pass]);
+}
+
+void Game::collectGPUTimes()
+{
+    for (auto &times : glBackend.takeGPUTimes()) {
+        for (int pass = 0; pass < render::PASS_MAX; pass++) {
+            if (times.used[pass])
+                gpuPassTimes[pass].add(times.passMs[pass]);
+        }
+    }
+}
+
+void Game::printTimingSummary(string name, const TimingHistory &history)
+{
+    if (history.count() == 0) {
+        cout <<name<< ": not recorded\n";
+        return;
+    }
+    cout <<name<< ": min " <<history.min()<< " ms, avg "
+        <<history.average()<< " ms, p99 " <<history.percentile(0.99)
+        << " ms\n";
+}
+
+void Game::getWindowSize(int *width, int *height) const
+{
+    if (window) {
+        SDL_GetWindowSize(window, width, height);
+    } else {
+        *width = HEADLESS_WIDTH;
+        *height = HEADLESS_HEIGHT;
     }
 }
 
 void Game::keyDown(const SDL_KeyboardEvent &e)
 {
     switch(e.keysym.sym) {
+    case SDLK_F3:
+        overlay.visible = !overlay.visible;  break;
+    case SDLK_F4:
+        overlay.print();  break;
     case SDLK_d:
         flyPos.x = 1;   break;
     case SDLK_a:
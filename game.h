@@ -2,8 +2,15 @@
 #include "common.h"
 
 #include "render.h"
+#include "glbackend.h"
 #include "collision.h"
+#include "collisionscene.h"
+#include "overlay.h"
+#include "spatialhash.h"
+#include "replay.h"
+#include "stats.h"
 #include "world.h"
+#include <fstream>
 #include <glm/glm.hpp>
 #include <SDL.h>
 
@@ -12,10 +19,32 @@ namespace diorama {
 class Game
 {
 public:
+    // size of the offscreen framebuffer without a window
+    static const int HEADLESS_WIDTH = 800, HEADLESS_HEIGHT = 600;
+
+    // window is null for headless contexts
     Game(SDL_Window *window);
     void main(const vector<string> args);
 
 private:
+    void runInteractive();
+    // render frames offscreen along a fixed camera path (or the replay) and
+    // print timings
+    void runBenchmark(int numFrames);
+
+    void pollEvents();
+    void getWindowSize(int *width, int *height) const;
+    // move the player by one step, return the camera transform
+    Transform updatePlayer(float deltaTime);
+    // bring the collision structures up to date with the world. not part of
+    // updatePlayer, so rebuilds don't land in the middle of player movement
+    void updateCollision();
+    InputFrame captureInput() const;
+    void applyInput(const InputFrame &input);
+
+    void collectGPUTimes();
+    void printTimingSummary(string name, const TimingHistory &history);
+
     void keyDown(const SDL_KeyboardEvent &e);
     void keyUp(const SDL_KeyboardEvent &e);
 
@@ -23,8 +52,11 @@ private:
     World world;
     bool running = true;
 
+    render::GLBackend glBackend;
     render::Renderer renderer;
     ShaderManager shaders;
+    // null unless there's a texture budget
+    unique_ptr<render::TextureStreamer> textureStreamer;
 
     float camYaw = 0, camPitch = 0;
     glm::vec3 camPos{0, 0, 128};
@@ -32,7 +64,20 @@ private:
     glm::vec3 flyNeg{0, 0, 0};
     float flySpeed = 70.0f;  // inches per second
 
-    vector<physics::CollisionInfo> playerCollisions;
+    // updated when the world changes, only moved instances if possible
+    physics::SharedCollisionScene collisionScene;
+    // for the player. static geometry is baked on load
+    physics::SpatialHash spatialHash;
+    double collisionTime = 0;  // ms, for the last step
+    array<TimingHistory, render::PASS_MAX> gpuPassTimes;
+    StatsOverlay overlay;  // toggle with F3, print with F4
+    std::ofstream statsCSV;  // not open if disabled
+
+    // recording and replay use a fixed timestep
+    InputRecording recording;
+    string recordPath;  // empty if not recording
+    string profilePath;  // write Chrome trace on exit
+    bool replaying = false;
 };
 
 }  // namespace
@@ -0,0 +1,246 @@
+#include "glbackend.h"
+#include "mesh.h"
+#include <stdexcept>
+#include <GL/gl3w.h>
+
+namespace diorama::render {
+
+double GPUFrameTimes::totalMs() const
+{
+    double total = 0;
+    for (double ms : passMs)
+        total += ms;
+    return total;
+}
+
+GLBackend::~GLBackend()
+{
+    if (cameraUBO != 0) {
+        glDeleteBuffers(1, &cameraUBO);
+        glDeleteVertexArrays(1, &lineVertexArray);
+        glDeleteBuffers(1, &lineVertexBuffer);
+        for (auto &timers : timerFrames)
+            glDeleteQueries(PASS_MAX, timers.queries.data());
+    }
+}
+
+void GLBackend::init()
+{
+    glClearColor(0, 0, 0, 1);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // https://learnopengl.com/Advanced-OpenGL/Advanced-GLSL
+    glGenBuffers(1, &cameraUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+    CameraBlock initCameraBlock;
+    glBufferData(GL_UNIFORM_BUFFER,
+        sizeof(CameraBlock), &initCameraBlock, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER,
+        ShaderProgram::BIND_TRANSFORM, cameraUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glGenVertexArrays(1, &lineVertexArray);
+    glBindVertexArray(lineVertexArray);
+    glGenBuffers(1, &lineVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, lineVertexBuffer);
+    glVertexAttribPointer(RenderPrimitive::ATTRIB_POSITION, 3, GL_FLOAT,
+                          GL_FALSE, 0, (void *)0);
+    glEnableVertexAttribArray(RenderPrimitive::ATTRIB_POSITION);
+    glBindVertexArray(0);
+
+    for (auto &timers : timerFrames)
+        glGenQueries(PASS_MAX, timers.queries.data());
+    state.invalidate();
+}
+
+void GLBackend::execute(const CommandBuffer &commands)
+{
+    if (!commands.lineVertices().empty())
+        uploadLines(commands.lineVertices());
+
+    // results from TIMER_FRAMES ago should be ready by now
+    TimerFrame &timers = timerFrames[_frameCount % TIMER_FRAMES];
+    readTimers(timers);
+    timers.used.fill(false);
+    timers.frame = _frameCount++;
+
+    // loading and texture streaming bind objects between frames
+    state.invalidateBindings();
+    state.resetCounts();
+    for (auto &command : commands.commands()) {
+        if (!state.apply(command, commands))
+            continue;
+        switch (command.type) {
+        case RenderCommand::CLEAR:
+            glClear((command.clear.color ? GL_COLOR_BUFFER_BIT : 0)
+                    | (command.clear.depth ? GL_DEPTH_BUFFER_BIT : 0));
+            break;
+        case RenderCommand::SET_VIEWPORT:
+            glViewport(0, 0, command.viewport.width, command.viewport.height);
+            break;
+        case RenderCommand::SET_CAMERA:
+            glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock),
+                            commands.data(command.uniform.offset));
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            break;
+        case RenderCommand::USE_PROGRAM:
+            glUseProgram(command.object);
+            break;
+        case RenderCommand::BIND_TEXTURE:
+            glActiveTexture(GL_TEXTURE0 + command.texture.unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, command.texture.texture);
+            break;
+        case RenderCommand::BIND_VERTEX_ARRAY:
+            glBindVertexArray(command.object);
+            break;
+        case RenderCommand::UNIFORM_1I:
+            glUniform1i(command.uniformInt.location, command.uniformInt.value);
+            break;
+        case RenderCommand::UNIFORM_2F:
+            glUniform2fv(command.uniform.location, 1,
+                         commands.data(command.uniform.offset));
+            break;
+        case RenderCommand::UNIFORM_4F:
+            glUniform4fv(command.uniform.location, 1,
+                         commands.data(command.uniform.offset));
+            break;
+        case RenderCommand::UNIFORM_MATRIX_3F:
+            glUniformMatrix3fv(command.uniform.location, 1, GL_FALSE,
+                               commands.data(command.uniform.offset));
+            break;
+        case RenderCommand::UNIFORM_MATRIX_4F:
+            glUniformMatrix4fv(command.uniform.location, 1, GL_FALSE,
+                               commands.data(command.uniform.offset));
+            break;
+        case RenderCommand::SET_CULL_FACE:
+            glCullFace(command.reversed ? GL_FRONT : GL_BACK);
+            break;
+        case RenderCommand::SET_RENDER_ORDER:
+            switch (command.order) {
+            case RenderOrder::Transparent:
+                glEnable(GL_BLEND);
+                glDepthMask(GL_FALSE);
+                break;
+            case RenderOrder::Opaque:
+                glDisable(GL_BLEND);
+                glDepthMask(GL_TRUE);
+                break;
+            }
+            break;
+        case RenderCommand::DRAW_ELEMENTS:
+            glDrawElements(GL_TRIANGLES, command.elements.count,
+                GL_UNSIGNED_SHORT,
+                (void *)(command.elements.first * sizeof(MeshIndex)));
+            break;
+        case RenderCommand::DRAW_LINES:
+            glBindVertexArray(lineVertexArray);
+            glDrawArrays(GL_LINES, command.lines.first, command.lines.count);
+            break;
+        case RenderCommand::BEGIN_PASS:
+            glBeginQuery(GL_TIME_ELAPSED, timers.queries[command.pass]);
+            timers.used[command.pass] = true;
+            timers.pending = true;
+            break;
+        case RenderCommand::END_PASS:
+            glEndQuery(GL_TIME_ELAPSED);
+            break;
+        case RenderCommand::TYPE_MAX:
+            break;
+        }
+    }
+}
+
+const StateCache & GLBackend::stateCache() const
+{
+    return state;
+}
+
+uint64_t GLBackend::frameCount() const
+{
+    return _frameCount;
+}
+
+vector<GPUFrameTimes> GLBackend::takeGPUTimes()
+{
+    vector<GPUFrameTimes> times;
+    times.swap(gpuTimes);
+    return times;
+}
+
+void GLBackend::finishGPUTimes()
+{
+    // oldest first
+    for (int i = 0; i < TIMER_FRAMES; i++)
+        readTimers(timerFrames[(_frameCount + i) % TIMER_FRAMES]);
+}
+
+void GLBackend::readTimers(TimerFrame &timers)
+{
+    if (!timers.pending)
+        return;
+    GPUFrameTimes times;
+    times.frame = timers.frame;
+    for (int pass = 0; pass < PASS_MAX; pass++) {
+        if (!timers.used[pass])
+            continue;
+        times.used[pass] = true;
+        // blocks if the result isn't available yet
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timers.queries[pass], GL_QUERY_RESULT, &elapsed);
+        times.passMs[pass] = elapsed / 1e6;
+    }
+    gpuTimes.push_back(times);
+    timers.pending = false;
+}
+
+void GLBackend::uploadLines(const vector<glm::vec3> &vertices)
+{
+    size_t size = vertices.size() * sizeof(glm::vec3);
+    glBindBuffer(GL_ARRAY_BUFFER, lineVertexBuffer);
+    if (size > lineBufferSize) {
+        glBufferData(GL_ARRAY_BUFFER, size, vertices.data(), GL_STREAM_DRAW);
+        lineBufferSize = size;
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+Framebuffer::~Framebuffer()
+{
+    if (framebuffer != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+}
+
+void Framebuffer::create(int width, int height)
+{
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, colorBuffer);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                          width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Framebuffer incomplete");
+}
+
+}  // namespace
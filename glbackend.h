@@ -0,0 +1,79 @@
+#pragma once
+#include "common.h"
+
+#include "commandbuffer.h"
+#include "glutils.h"
+
+namespace diorama::render {
+
+// GPU time spent in each pass of a frame
+struct GPUFrameTimes
+{
+    uint64_t frame = 0;  // counts calls to GLBackend::execute()
+    array<double, PASS_MAX> passMs {};  // zero if the pass wasn't recorded
+    array<bool, PASS_MAX> used {};  // passes recorded in the frame
+
+    double totalMs() const;
+};
+
+// Executes recorded commands with OpenGL.
+class GLBackend : public RenderBackend
+{
+public:
+    ~GLBackend();
+
+    void init() override;
+    void execute(const CommandBuffer &commands) override;
+
+    // GPU times for frames whose results have arrived since the last call.
+    // results arrive a few frames late
+    vector<GPUFrameTimes> takeGPUTimes();
+    // wait for results of all executed frames
+    void finishGPUTimes();
+    // commands skipped in the last frame
+    const StateCache & stateCache() const;
+    // calls to execute() so far, the frame number of the next one
+    uint64_t frameCount() const;
+
+private:
+    // frames of timer queries in flight, to avoid waiting for results
+    static const int TIMER_FRAMES = 3;
+
+    struct TimerFrame
+    {
+        array<GLQuery, PASS_MAX> queries {};
+        array<bool, PASS_MAX> used {};
+        bool pending = false;
+        uint64_t frame = 0;
+    };
+
+    void uploadLines(const vector<glm::vec3> &vertices);
+    void readTimers(TimerFrame &timers);
+
+    GLBuffer cameraUBO = 0;  // shared between all programs
+    StateCache state;
+
+    GLVertexArray lineVertexArray = 0;
+    GLBuffer lineVertexBuffer = 0;
+    size_t lineBufferSize = 0;  // in bytes
+
+    array<TimerFrame, TIMER_FRAMES> timerFrames;
+    uint64_t _frameCount = 0;
+    vector<GPUFrameTimes> gpuTimes;
+};
+
+// Offscreen render target, for rendering without a visible window.
+class Framebuffer : noncopyable
+{
+public:
+    ~Framebuffer();
+
+    // also binds the framebuffer
+    void create(int width, int height);
+
+    GLFramebuffer framebuffer = 0;
+    GLRenderbuffer colorBuffer = 0;
+    GLRenderbuffer depthBuffer = 0;
+};
+
+}  // namespace
@@ -12,6 +12,9 @@ using GLVertexArray = GLObject;
 using GLTexture = GLObject;
 using GLShader = GLObject;
 using GLProgram = GLObject;
+using GLFramebuffer = GLObject;
+using GLRenderbuffer = GLObject;
+using GLQuery = GLObject;
 
 using GLUniformLocation = int32_t;
 
@@ -32,6 +35,9 @@ enum class GLShaderType : uint32_t
 enum class GLTextureFormat : uint32_t
 {
     Rgba = 0x1908,
+    // EXT_texture_compression_s3tc, not in the core profile headers
+    RgbBC1 = 0x83F0,
+    RgbaBC3 = 0x83F3,
 };
 
 }  // namespace
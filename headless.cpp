@@ -0,0 +1,178 @@
+#include "headless.h"
+#include "log.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace diorama {
+
+#ifdef __linux__
+
+static bool hasExtension(const char *extensions, const char *name)
+{
+    if (!extensions)
+        return false;
+    size_t length = strlen(name);
+    for (const char *found = strstr(extensions, name); found;
+            found = strstr(found + length, name)) {
+        if ((found == extensions || found[-1] == ' ')
+                && (found[length] == ' ' || found[length] == 0))
+            return true;
+    }
+    return false;
+}
+
+// surfaceless needs no display server at all. EGL_DEFAULT_DISPLAY may still
+// work without one on some drivers (eg. Nvidia's)
+static EGLDisplay getDisplay()
+{
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY,
+                                                  EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(
+                EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY)
+                return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessContext::HeadlessContext()
+{}
+
+HeadlessContext::~HeadlessContext()
+{
+    if (!display)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface)
+        eglDestroySurface(display, surface);
+    if (context)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+bool HeadlessContext::create(int majorVersion, int minorVersion, bool debug)
+{
+    EGLDisplay eglDisplay = getDisplay();
+    EGLint eglMajor, eglMinor;
+    if (eglDisplay == EGL_NO_DISPLAY
+            || !eglInitialize(eglDisplay, &eglMajor, &eglMinor)) {
+        logAt(Verbosity::Quiet) << "EGL error: no display\n";
+        return false;
+    }
+    display = eglDisplay;
+    logAt(Verbosity::Normal) << "EGL version: " <<eglMajor<< "."
+        <<eglMinor<< "\n";
+    // desktop GL instead of GLES
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        logAt(Verbosity::Quiet) << "EGL error: OpenGL not supported\n";
+        return false;
+    }
+
+    const char *extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    bool surfaceless = hasExtension(extensions,
+                                    "EGL_KHR_surfaceless_context");
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs)
+            || numConfigs == 0) {
+        logAt(Verbosity::Quiet) << "EGL error: no matching config\n";
+        return false;
+    }
+
+    // the version and profile names are the same in EGL 1.5 and
+    // EGL_KHR_create_context, but only 1.5 has EGL_CONTEXT_OPENGL_DEBUG
+    bool egl15 = eglMajor > 1 || (eglMajor == 1 && eglMinor >= 5);
+    if (!egl15 && !hasExtension(extensions, "EGL_KHR_create_context")) {
+        logAt(Verbosity::Quiet) << "EGL error: can't choose the OpenGL "
+            "version, needs EGL 1.5 or EGL_KHR_create_context\n";
+        return false;
+    }
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, majorVersion,
+        EGL_CONTEXT_MINOR_VERSION_KHR, minorVersion,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        egl15 ? EGL_CONTEXT_OPENGL_DEBUG : EGL_CONTEXT_FLAGS_KHR,
+        egl15 ? (debug ? EGL_TRUE : EGL_FALSE)
+            : (debug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0),
+        EGL_NONE
+    };
+    context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT,
+                               contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        context = nullptr;
+        logAt(Verbosity::Quiet) << "EGL error: couldn't create OpenGL "
+            <<majorVersion<< "." <<minorVersion<< " context ("
+            <<std::hex<< eglGetError() <<std::dec<< ")\n";
+        return false;
+    }
+
+    // everything renders into framebuffers, so the default one can be tiny
+    if (!surfaceless) {
+        const EGLint pbufferAttribs[] = {
+            EGL_WIDTH, 1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+        if (surface == EGL_NO_SURFACE) {
+            surface = nullptr;
+            logAt(Verbosity::Quiet) << "EGL error: couldn't create pbuffer\n";
+            return false;
+        }
+    }
+    EGLSurface eglSurface = surface ? surface : EGL_NO_SURFACE;
+    if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, context)) {
+        logAt(Verbosity::Quiet) << "EGL error: couldn't make context current\n";
+        return false;
+    }
+    return true;
+}
+
+HeadlessContext::GLProc HeadlessContext::getProcAddress(const char *name)
+{
+    // includes core functions with EGL 1.5 or
+    // EGL_KHR_get_all_proc_addresses, which Mesa and Nvidia both support
+    return (GLProc)eglGetProcAddress(name);
+}
+
+#else
+
+HeadlessContext::HeadlessContext()
+{}
+
+HeadlessContext::~HeadlessContext()
+{}
+
+bool HeadlessContext::create(int majorVersion, int minorVersion, bool debug)
+{
+    logAt(Verbosity::Quiet)
+        << "Headless contexts are only supported on Linux\n";
+    return false;
+}
+
+HeadlessContext::GLProc HeadlessContext::getProcAddress(const char *name)
+{
+    return nullptr;
+}
+
+#endif
+
+}  // namespace
@@ -0,0 +1,37 @@
+#pragma once
+#include "common.h"
+
+namespace diorama {
+
+// An OpenGL context with no window or display server, for benchmarking on
+// build servers. Uses EGL on Linux (surfaceless if the driver supports it,
+// otherwise a small pbuffer). Elsewhere use a hidden SDL window instead.
+class HeadlessContext : noncopyable
+{
+public:
+    using GLProc = void (*)();
+
+#ifdef __linux__
+    static const bool SUPPORTED = true;
+#else
+    static const bool SUPPORTED = false;
+#endif
+
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // core profile, made current. prints the reason and returns false on
+    // failure
+    bool create(int majorVersion, int minorVersion, bool debug);
+
+    // for gl3wInit2
+    static GLProc getProcAddress(const char *name);
+
+private:
+    // EGL types, kept out of this header
+    void *display = nullptr;
+    void *context = nullptr;
+    void *surface = nullptr;  // null if surfaceless
+};
+
+}  // namespace
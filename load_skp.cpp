@@ -1,6 +1,18 @@
 #include "load_skp.h"
-#include <exception>
+#include "collisioncook.h"
+#include "culling.h"
+#include "log.h"
+#include "profiler.h"
+#include "simplify.h"
+#include "texstream.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iomanip>
 #include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 
@@ -16,15 +28,19 @@ struct PrimitiveBuilder {
     vector<MeshIndex> indices;
 };
 
-SkpLoader::SkpLoader(string path, World *world, const ShaderManager *shaders)
-    : world(world)
+SkpLoader::SkpLoader(string path, World *world, const ShaderManager *shaders,
+                     bool keepGeometry, bool streamTextures)
+    : path(path)
+    , world(world)
     , shaders(shaders)
+    , keepGeometry(keepGeometry)
+    , streamTextures(streamTextures)
 {
     cout << "Loading from " <<path<< "\n";
     SUInitialize();
 
     if (CHECK(SUModelCreateFromFile(&model, path.c_str())))
-        throw std::exception("Couldn't create model");
+        throw std::runtime_error("Couldn't create model");
 }
 
 SkpLoader::~SkpLoader()
@@ -36,17 +52,24 @@ SkpLoader::~SkpLoader()
 
 void SkpLoader::loadGlobal()
 {
-    size_t numMaterials;
-    // get "All" materials to include Images (also Layers which are unused)
-    CHECK(SUModelGetNumAllMaterials(model, &numMaterials));
-    unique_ptr<SUMaterialRef[]> materials(new SUMaterialRef[numMaterials]);
-    CHECK(SUModelGetAllMaterials(model, numMaterials,
-        materials.get(), &numMaterials));
-    for (int i = 0; i < numMaterials; i++) {
-        int32_t id = getID(SUMaterialToEntity(materials[i]));
-        loadedMaterials[id] = loadMaterial(materials[i]);
+    PROFILE_ZONE("SkpLoader::loadGlobal");
+    {
+        PROFILE_ZONE("SkpLoader::materials");
+        size_t numMaterials;
+        // get "All" materials to include Images (also Layers which are unused)
+        CHECK(SUModelGetNumAllMaterials(model, &numMaterials));
+        unique_ptr<SUMaterialRef[]> materials(new SUMaterialRef[numMaterials]);
+        CHECK(SUModelGetAllMaterials(model, numMaterials,
+            materials.get(), &numMaterials));
+        for (int i = 0; i < numMaterials; i++) {
+            int32_t id = getID(SUMaterialToEntity(materials[i]));
+            loadedMaterials[id] = loadMaterial(materials[i]);
+        }
+        packTextures();
     }
 
+    PROFILE_ZONE("SkpLoader::definitions");
+
     // IDs seem to follow dependency order, so load definitions in order of ID
     std::map<int32_t, SUComponentDefinitionRef> defs;
 
@@ -93,36 +116,47 @@ void SkpLoader::loadGlobal()
     }
 
     for (auto &defPair : defs) {
-        Component * component = new Component;
+        // never added to the world, but freed with it
+        Component * component = world->createComponent();
 
         SUStringRef nameStr = createString();
         CHECK(SUComponentDefinitionGetName(defPair.second, &nameStr));
         component->name = convertStringAndRelease(&nameStr);
-        cout << "Definition " <<defPair.first<< ": " <<component->name<< "\n";
+        logAt(Verbosity::Verbose) << "Definition " <<defPair.first<< ": "
+            <<component->name<< "\n";
 
         SUEntitiesRef entities = SU_INVALID;
         CHECK(SUComponentDefinitionGetEntities(defPair.second, &entities));
         // component definitions don't seem to use materials
-        loadEntities(entities, component);
+        loadEntities(entities, component, isCollisionName(component->name));
         int32_t id = getID(SUComponentDefinitionToEntity(defPair.second));
-        componentDefinitions[id] = unique_ptr<Component>(component);
+        componentDefinitions[id] = component;
     }
 }
 
+const vector<TextureArray *> & SkpLoader::textureArrays() const
+{
+    return _textureArrays;
+}
+
 Component * SkpLoader::loadRoot()
 {
-    Component *root = new Component;
+    PROFILE_ZONE("SkpLoader::loadRoot");
+    Component *root = world->createComponent();
     root->name = "root";
     SUEntitiesRef entities = SU_INVALID;
     CHECK(SUModelGetEntities(model, &entities));
-    cout << "Model:\n";
+    logAt(Verbosity::Verbose) << "Model:\n";
     loadEntities(entities, root);
     return root;
 }
 
-void SkpLoader::loadEntities(SUEntitiesRef entities, Component *component)
+void SkpLoader::loadEntities(SUEntitiesRef entities, Component *component,
+                             bool collisionOnly)
 {
-    component->mesh = loadMesh(entities);
+    // children first, dedicated collision children replace the collision of
+    // this mesh
+    bool collisionChildren = false;
 
     size_t numGroups;
     CHECK(SUEntitiesGetNumGroups(entities, &numGroups));
@@ -131,6 +165,7 @@ void SkpLoader::loadEntities(SUEntitiesRef entities, Component *component)
     for (int i = 0; i < numGroups; i++) {
         SUComponentInstanceRef instance = SUGroupToComponentInstance(groups[i]);
         loadInstance(instance)->setParent(component);
+        collisionChildren |= isCollisionInstance(instance);
     }
 
     size_t numInstances;
@@ -142,6 +177,7 @@ void SkpLoader::loadEntities(SUEntitiesRef entities, Component *component)
     for (int i = 0; i < numInstances; i++) {
         SUComponentInstanceRef instance = instances[i];
         loadInstance(instance)->setParent(component);
+        collisionChildren |= isCollisionInstance(instance);
     }
 
     size_t numImages;
@@ -158,6 +194,12 @@ void SkpLoader::loadEntities(SUEntitiesRef entities, Component *component)
         }
         loadInstance(instIt->second)->setParent(component);
     }
+
+    component->mesh = loadMesh(entities, collisionOnly, !collisionChildren);
+    if (collisionOnly) {
+        for (auto &child : component->children())
+            makeCollisionOnly(child);
+    }
 }
 
 Component * SkpLoader::loadInstance(SUComponentInstanceRef instance)
@@ -168,15 +210,18 @@ Component * SkpLoader::loadInstance(SUComponentInstanceRef instance)
     auto defIt = componentDefinitions.find(definitionID);
     if (defIt == componentDefinitions.end()) {
         cout << "  Definition " <<definitionID<< " not loaded!\n";
-        return new Component;
+        return world->createComponent();
     }
 
-    Component *component = defIt->second->cloneHierarchy();
+    Component *component = defIt->second->cloneHierarchy(world);
+    if (isCollisionInstance(instance))
+        makeCollisionOnly(component);
 
     SUStringRef nameStr = createString();
     CHECK(SUComponentInstanceGetName(instance, &nameStr));
     string name = convertStringAndRelease(&nameStr);
-    cout << "  Instance " <<name<< " of " <<definitionID<< "\n";
+    logAt(Verbosity::Verbose) << "  Instance " <<name<< " of "
+        <<definitionID<< "\n";
     // instances with empty names use the name of their definition
     // this matches the behavior of Dynamic Components
     if (!name.empty())
@@ -202,8 +247,10 @@ Component * SkpLoader::loadInstance(SUComponentInstanceRef instance)
     return component;
 }
 
-Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
+Mesh * SkpLoader::loadMesh(SUEntitiesRef entities, bool collisionOnly,
+                           bool ownCollision)
 {
+    PROFILE_ZONE("SkpLoader::loadMesh");
     size_t numFaces;
     CHECK(SUEntitiesGetNumFaces(entities, &numFaces));
     if (numFaces == 0)
@@ -211,8 +258,17 @@ Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
     unique_ptr<SUFaceRef[]> faces(new SUFaceRef[numFaces]);
     CHECK(SUEntitiesGetFaces(entities, numFaces, faces.get(), &numFaces));
 
-    Mesh * mesh = new Mesh;
-    world->addResource(mesh);
+    // faces on the collision layer replace the others for collision
+    unique_ptr<bool[]> collisionFaces(new bool[numFaces]);
+    bool anyCollisionFaces = false;
+    for (int i = 0; i < numFaces; i++) {
+        collisionFaces[i] = collisionOnly
+            || onCollisionLayer(SUFaceToDrawingElement(faces[i]));
+        anyCollisionFaces |= collisionFaces[i];
+    }
+    bool renderCollides = ownCollision && !anyCollisionFaces;
+
+    Mesh * mesh = world->createResource<Mesh>();
 
     // maps material ID to builder
     std::unordered_map<int32_t, PrimitiveBuilder> materialPrimitives;
@@ -220,6 +276,11 @@ Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
     CollisionPrimitive &collision = mesh->collision.back();
 
     for (int i = 0; i < numFaces; i++) {
+        bool render = !collisionFaces[i];
+        bool collide = collisionFaces[i] || renderCollides;
+        if (!render && !collide)
+            continue;
+
         SUMeshHelperRef helper = SU_INVALID;
         CHECK(SUMeshHelperCreate(&helper, faces[i]));
 
@@ -246,30 +307,43 @@ Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
         CHECK(SUMeshHelperRelease(&helper));
 
 
-        SUMaterialRef material = SU_INVALID;
-        int32_t materialID;
-        if (!SUFaceGetFrontMaterial(faces[i], &material))
-            materialID = getID(SUMaterialToEntity(material));
-        else
-            materialID = NO_ID;
-        
-        // constructs if doesn't exist
-        PrimitiveBuilder &build = materialPrimitives[materialID];
-        MeshIndex renderOffset = build.vertices.size();
-        convertVec3Array(suVertices.get(), numVertices, build.vertices);
-        convertVec3Array(suSTQCoords.get(), numVertices, build.stqCoords);
-        convertVec3Array(suNormals.get(), numVertices, build.normals);
-
-        MeshIndex collisionOffset = collision.vertices.size();
-        convertVec3Array(suVertices.get(), numVertices, collision.vertices);
-
-        for (int i = 0; i < numIndices; i++) {
-            build.indices.push_back((MeshIndex)suIndices[i] + renderOffset);
-            collision.indices.push_back(
-                (MeshIndex)suIndices[i] + collisionOffset);
+        if (render) {
+            SUMaterialRef material = SU_INVALID;
+            int32_t materialID;
+            if (!SUFaceGetFrontMaterial(faces[i], &material))
+                materialID = getID(SUMaterialToEntity(material));
+            else
+                materialID = NO_ID;
+
+            // constructs if doesn't exist
+            PrimitiveBuilder &build = materialPrimitives[materialID];
+            MeshIndex renderOffset = build.vertices.size();
+            convertVec3Array(suVertices.get(), numVertices, build.vertices);
+            convertVec3Array(suSTQCoords.get(), numVertices, build.stqCoords);
+            convertVec3Array(suNormals.get(), numVertices, build.normals);
+            for (int i = 0; i < numIndices; i++)
+                build.indices.push_back((MeshIndex)suIndices[i] + renderOffset);
+        }
+
+        if (collide) {
+            MeshIndex collisionOffset = collision.vertices.size();
+            convertVec3Array(suVertices.get(), numVertices,
+                             collision.vertices);
+            for (int i = 0; i < numIndices; i++) {
+                collision.indices.push_back(
+                    (MeshIndex)suIndices[i] + collisionOffset);
+            }
         }
     }  // for each face
 
+    size_t rawTriangles = collision.indices.size() / 3;
+    physics::cookCollision(&collision);
+    collision.computeBounds();
+    size_t cookedTriangles = collision.indices.size() / 3;
+    if (cookedTriangles == 0)
+        mesh->collision.clear();
+
+    size_t lodTriangles = 0;
     for (auto &primPair : materialPrimitives) {
         int32_t materialID = primPair.first;
         PrimitiveBuilder &build = primPair.second;
@@ -287,6 +361,17 @@ Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
             }
         }
 
+        for (auto &vertex : build.vertices)
+            mesh->bounds.add(vertex);
+        primitive.occluders = render::selectOccluders(
+            build.vertices, build.indices);
+        primitive.textureDensity = computeTextureDensity(
+            build.vertices, build.stqCoords, build.indices);
+        size_t fullIndices = build.indices.size();
+        vector<LevelOfDetail> lods = buildLods(
+            build.vertices, build.normals, build.stqCoords, build.indices);
+        lodTriangles += (build.indices.size() - fullIndices) / 3;
+
         size_t vertexBufferSize = build.vertices.size() * sizeof(glm::vec3);
         primitive.setAttribData(RenderPrimitive::ATTRIB_POSITION,
             vertexBufferSize, 3, GLDataType::Float, &build.vertices[0]);
@@ -294,28 +379,53 @@ Mesh * SkpLoader::loadMesh(SUEntitiesRef entities)
             vertexBufferSize, 3, GLDataType::Float, &build.normals[0]);
         primitive.setAttribData(RenderPrimitive::ATTRIB_STQ,
             vertexBufferSize, 3, GLDataType::Float, &build.stqCoords[0]);
-        primitive.setIndices(build.indices.size(), &build.indices[0]);
+        primitive.setIndices(fullIndices, &build.indices[0], std::move(lods));
+
+        if (keepGeometry) {
+            build.indices.resize(fullIndices);
+            primitive.geometry = std::make_unique<RenderGeometry>(
+                RenderGeometry {std::move(build.vertices),
+                                std::move(build.normals),
+                                std::move(build.stqCoords),
+                                std::move(build.indices)});
+        }
     }
 
-    cout << "  " <<mesh->render.size()<< " primitives\n";
+    logAt(Verbosity::Verbose) << "  " <<mesh->render.size()<< " primitives, "
+        <<rawTriangles<< " collision triangles cooked to " <<cookedTriangles
+        << ", " <<lodTriangles<< " lod triangles\n";
     return mesh;
 }
 
+void SkpLoader::makeCollisionOnly(Component *component)
+{
+    if (component->mesh && !component->mesh->render.empty()) {
+        auto meshIt = collisionOnlyMeshes.find(component->mesh);
+        if (meshIt == collisionOnlyMeshes.end()) {
+            Mesh *mesh = world->createResource<Mesh>();
+            mesh->collision = component->mesh->collision;
+            meshIt = collisionOnlyMeshes.emplace(component->mesh, mesh).first;
+        }
+        component->mesh = meshIt->second;
+    }
+    for (auto &child : component->children())
+        makeCollisionOnly(child);
+}
+
 Material * SkpLoader::loadMaterial(SUMaterialRef suMaterial)
 {
     SUStringRef nameStr = createString();
     CHECK(SUMaterialGetName(suMaterial, &nameStr));
     string name = convertStringAndRelease(&nameStr);
-    cout << "Material " <<getID(SUMaterialToEntity(suMaterial))<< ": "
-        <<name<< "\n";
+    logAt(Verbosity::Verbose) << "Material "
+        <<getID(SUMaterialToEntity(suMaterial))<< ": " <<name<< "\n";
 
-    Material * material = new Material;
-    world->addResource(material);
+    Material * material = world->createResource<Material>();
 
     bool transparent;
     CHECK(SUMaterialIsDrawnTransparent(suMaterial, &transparent));
     if (transparent)
-        cout << "  Material is transparent\n";
+        logAt(Verbosity::Verbose) << "  Material is transparent\n";
     material->order = transparent ? RenderOrder::Transparent
         : RenderOrder::Opaque;
 
@@ -328,7 +438,8 @@ Material * SkpLoader::loadMaterial(SUMaterialRef suMaterial)
         material->shader = &shaders->coloredProg;
         material->color = colorToVec(color);
         material->texture = &Texture::NO_TEXTURE;
-        cout << "  Solid color " <<glm::to_string(material->color)<< "\n";
+        logAt(Verbosity::Verbose) << "  Solid color "
+            <<glm::to_string(material->color)<< "\n";
     } else {
         SUTextureRef texture = SU_INVALID;
         CHECK(SUMaterialGetTexture(suMaterial, &texture));
@@ -347,10 +458,10 @@ Material * SkpLoader::loadMaterial(SUMaterialRef suMaterial)
             SUMaterialColorizeType type;
             CHECK(SUMaterialGetColorizeType(suMaterial, &type));
             if (type == SUMaterialColorizeType_Tint) {
-                cout << "  Colorize (tint)\n";
+                logAt(Verbosity::Verbose) << "  Colorize (tint)\n";
                 material->shader = &shaders->tintedTextureProg;
             } else if (type == SUMaterialColorizeType_Shift) {
-                cout << "  Colorize (shift)\n";
+                logAt(Verbosity::Verbose) << "  Colorize (shift)\n";
                 material->shader = &shaders->shiftedTextureProg;
             }
 
@@ -369,39 +480,271 @@ Material * SkpLoader::loadMaterial(SUMaterialRef suMaterial)
 
 Texture * SkpLoader::loadTexture(SUTextureRef suTexture)
 {
+    PROFILE_ZONE("SkpLoader::loadTexture");
     SUStringRef fileNameStr = createString();
     CHECK(SUTextureGetFileName(suTexture, &fileNameStr));
     string fileName = convertStringAndRelease(&fileNameStr);
 
     auto texIt = loadedTextures.find(fileName);
     if (texIt != loadedTextures.end()) {
-        cout << "  Already loaded " <<fileName<< "\n";
+        logAt(Verbosity::Verbose) << "  Already loaded " <<fileName<< "\n";
         return texIt->second;
     }
-    cout << "  Texture " <<fileName<< "\n";
+    logAt(Verbosity::Verbose) << "  Texture " <<fileName<< "\n";
+
+    size_t width, height;
+    double sScale, tScale;  // ignored
+    CHECK(SUTextureGetDimensions(suTexture, &width, &height,
+        &sScale, &tScale));
+
+    // uploaded later by packTextures(), when all the sizes are known
+    Texture * texture = world->createResource<Texture>();
+    pendingTextures.push_back({texture, suTexture, fileName, width, height});
+
+    loadedTextures[fileName] = texture;
+    return texture;
+}
+
+void SkpLoader::packTextures()
+{
+    PROFILE_ZONE("SkpLoader::packTextures");
+    if (TextureArray::compressionSupported()) {
+        packCompressedTextures();
+    } else {
+        cout << "S3TC not supported, textures are uncompressed\n";
+        packRawTextures();
+    }
+    pendingTextures.clear();
+}
 
+void SkpLoader::packCompressedTextures()
+{
+    namespace fs = std::filesystem;
+    std::error_code error;
+    fs::file_time_type sceneTime = fs::last_write_time(path, error);
+    fs::path cacheDir = path + ".texcache";
+    fs::create_directories(cacheDir, error);
+    bool canSave = !error;
+
+    // only the headers of cached images are read here, their levels are
+    // read one group at a time when uploading. new images are dropped once
+    // saved, and read back the same way
+    vector<CompressedImage> images(pendingTextures.size());
+    vector<string> cacheFiles(pendingTextures.size());  // empty if not saved
+    // indices of images, grouped by format and size
+    std::map<std::tuple<BlockFormat, int, int>, vector<size_t>> groups;
+    int numCached = 0;
+    vector<SUColor> colors;
+    for (size_t i = 0; i < pendingTextures.size(); i++) {
+        const PendingTexture &pending = pendingTextures[i];
+        fs::path cachePath = cacheDir / textureCacheName(pending);
+        // stale if the scene was saved since
+        fs::file_time_type cacheTime = fs::last_write_time(cachePath, error);
+        if (!error && cacheTime >= sceneTime
+                && loadCompressedHeader(cachePath.string(), &images[i])) {
+            cacheFiles[i] = cachePath.string();
+            numCached++;
+        } else {
+            PROFILE_ZONE("SkpLoader::compressTexture");
+            size_t width, height;
+            decodeTexture(pending.suTexture, &width, &height, colors);
+            images[i] = compressImage((const uint8_t *)colors.data(),
+                                      (int)width, (int)height);
+            if (canSave) {
+                if (saveCompressedImage(cachePath.string(), images[i])) {
+                    cacheFiles[i] = cachePath.string();
+                    for (auto &level : images[i].levels)
+                        level = vector<uint8_t>();
+                } else {
+                    cout << "Couldn't write " <<cachePath.string()<< "\n";
+                }
+            }
+        }
+        const CompressedImage &image = images[i];
+        groups[{image.format, image.width, image.height}].push_back(i);
+    }
+    cout << "Textures: " <<numCached<< " of " <<images.size()
+        << " from cache\n";
+
+    size_t maxLayers = TextureArray::maxLayers();
+    size_t numBytes = 0;
+    for (auto &group : groups) {
+        BlockFormat format = std::get<0>(group.first);
+        int width = std::get<1>(group.first), height = std::get<2>(group.first);
+        const vector<size_t> &members = group.second;
+        // same size, so the same number of levels
+        int levels = (int)images[members[0]].levels.size();
+        for (size_t first = 0; first < members.size(); first += maxLayers) {
+            size_t layers = std::min(members.size() - first, maxLayers);
+            logAt(Verbosity::Verbose) << "Texture array "
+                <<(format == BlockFormat::BC1 ? "BC1 " : "BC3 ")
+                <<width<< "x" <<height<< ": " <<layers<< " layers\n";
+            TextureArray * array = world->createResource<TextureArray>();
+            array->allocateCompressed(width, height, layers, format, levels);
+            // streamed arrays start with only the small levels, the rest are
+            // read from the cache files when needed
+            int baseLevel = 0;
+            if (streamTextures) {
+                for (size_t layer = 0; layer < layers; layer++) {
+                    array->layerFiles.push_back(
+                        cacheFiles[members[first + layer]]);
+                }
+                if (std::find(array->layerFiles.begin(),
+                        array->layerFiles.end(), "")
+                        == array->layerFiles.end()) {
+                    baseLevel = glm::min(levels - 1,
+                        render::TextureStreamer::coarsestLevel(width, height));
+                } else {
+                    array->layerFiles.clear();
+                }
+            }
+            for (int level = baseLevel; level < levels; level++)
+                array->allocateLevel(level);
+            array->setBaseLevel(baseLevel);
+
+            for (size_t layer = 0; layer < layers; layer++) {
+                size_t index = members[first + layer];
+                CompressedImage &image = images[index];
+                if (!cacheFiles[index].empty()
+                        && !loadCompressedImage(cacheFiles[index], &image,
+                                                baseLevel))
+                    throw std::runtime_error("Couldn't read texture cache");
+                for (int level = baseLevel; level < levels; level++) {
+                    const vector<uint8_t> &data = image.levels[level];
+                    array->setCompressedLevel(layer, level, data.data(),
+                                              data.size());
+                    numBytes += data.size();
+                }
+                image.levels = vector<vector<uint8_t>>();
+                Texture *texture = pendingTextures[index].texture;
+                texture->glTexture = array->glTexture;
+                texture->layer = layer;
+                texture->array = array;
+            }
+            _textureArrays.push_back(array);
+        }
+    }
+    logAt(Verbosity::Verbose) << "Compressed textures: " <<numBytes / 1024
+        << " KB\n";
+}
+
+void SkpLoader::packRawTextures()
+{
+    // grouped by the decoded size, like the compressed images. pixels are
+    // only kept for one texture at a time
+    std::map<std::pair<size_t, size_t>, vector<PendingTexture *>> sizes;
+    for (auto &pending : pendingTextures) {
+        size_t width, height;
+        decodedSize(pending.suTexture, &width, &height);
+        sizes[{width, height}].push_back(&pending);
+    }
+
+    size_t maxLayers = TextureArray::maxLayers();
+    vector<SUColor> colors;
+    for (auto &sizePair : sizes) {
+        size_t width = sizePair.first.first, height = sizePair.first.second;
+        const vector<PendingTexture *> &group = sizePair.second;
+        for (size_t first = 0; first < group.size(); first += maxLayers) {
+            size_t layers = std::min(group.size() - first, maxLayers);
+            logAt(Verbosity::Verbose) << "Texture array " <<width<< "x"
+                <<height<< ": " <<layers<< " layers\n";
+            TextureArray * array = world->createResource<TextureArray>();
+            array->allocate(width, height, layers);
+
+            for (size_t layer = 0; layer < layers; layer++) {
+                PendingTexture *pending = group[first + layer];
+                size_t imageWidth, imageHeight;
+                decodeTexture(pending->suTexture, &imageWidth, &imageHeight,
+                              colors);
+                array->setLayer(layer, GLTextureFormat::Rgba,
+                                GLDataType::UnsignedByte, colors.data());
+                pending->texture->glTexture = array->glTexture;
+                pending->texture->layer = layer;
+                pending->texture->array = array;
+            }
+            array->generateMipmaps();
+            _textureArrays.push_back(array);
+        }
+    }
+}
+
+void SkpLoader::decodeTexture(SUTextureRef suTexture, size_t *width,
+                              size_t *height, vector<SUColor> &colors)
+{
     SUImageRepRef image = SU_INVALID;
     CHECK(SUImageRepCreate(&image));  // uncolorized
     CHECK(SUTextureGetImageRep(suTexture, &image));
-
-    size_t width, height;
-    CHECK(SUImageRepGetPixelDimensions(image, &width, &height));
-
-    unique_ptr<SUColor[]> colors(new SUColor[width * height]);
+    CHECK(SUImageRepGetPixelDimensions(image, width, height));
+    colors.resize(*width * *height);
     // this is actually much faster than SUImageRepConvertTo32BitsPerPixel
-    CHECK(SUImageRepGetDataAsColors(image, colors.get()));
+    CHECK(SUImageRepGetDataAsColors(image, colors.data()));
+    CHECK(SUImageRepRelease(&image));
+}
 
+void SkpLoader::decodedSize(SUTextureRef suTexture, size_t *width,
+                            size_t *height)
+{
+    SUImageRepRef image = SU_INVALID;
+    CHECK(SUImageRepCreate(&image));
+    CHECK(SUTextureGetImageRep(suTexture, &image));
+    CHECK(SUImageRepGetPixelDimensions(image, width, height));
     CHECK(SUImageRepRelease(&image));
+}
+
+string SkpLoader::textureCacheName(const PendingTexture &pending)
+{
+    // FNV-1a of the file name and size
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](const void *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= ((const uint8_t *)data)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    add(pending.fileName.data(), pending.fileName.size());
+    add(&pending.width, sizeof(pending.width));
+    add(&pending.height, sizeof(pending.height));
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".dtex";
+    return name.str();
+}
 
-    Texture * texture(new Texture);
-    world->addResource(texture);
-    texture->setImage(width, height, GLTextureFormat::Rgba,
-                      GLDataType::UnsignedByte, colors.get());
 
-    loadedTextures[fileName] = texture;
-    return texture;
+bool SkpLoader::isCollisionName(string name)
+{
+    const string SUFFIX = "_collision";
+    std::transform(name.begin(), name.end(), name.begin(),
+        [](unsigned char c) { return std::tolower(c); });
+    return name == "collision" || (name.size() > SUFFIX.size()
+        && name.compare(name.size() - SUFFIX.size(), SUFFIX.size(), SUFFIX)
+            == 0);
 }
 
+bool SkpLoader::onCollisionLayer(SUDrawingElementRef element)
+{
+    SULayerRef layer = SU_INVALID;
+    if (SUDrawingElementGetLayer(element, &layer))
+        return false;
+    SUStringRef nameStr = createString();
+    CHECK(SULayerGetName(layer, &nameStr));
+    return isCollisionName(convertStringAndRelease(&nameStr));
+}
+
+bool SkpLoader::isCollisionInstance(SUComponentInstanceRef instance)
+{
+    if (onCollisionLayer(SUComponentInstanceToDrawingElement(instance)))
+        return true;
+    // groups are usually named by their instance
+    SUStringRef nameStr = createString();
+    CHECK(SUComponentInstanceGetName(instance, &nameStr));
+    if (isCollisionName(convertStringAndRelease(&nameStr)))
+        return true;
+    SUComponentDefinitionRef definition = SU_INVALID;
+    CHECK(SUComponentInstanceGetDefinition(instance, &definition));
+    nameStr = createString();
+    CHECK(SUComponentDefinitionGetName(definition, &nameStr));
+    return isCollisionName(convertStringAndRelease(&nameStr));
+}
 
 int32_t SkpLoader::getID(SUEntityRef entity)
 {
@@ -13,22 +13,60 @@ namespace diorama {
 class SkpLoader
 {
 public:
-    SkpLoader(string path, World *world, const ShaderManager *shaders);
+    // keepGeometry leaves vertex data on the CPU for static batching.
+    // streamTextures only uploads small texture levels, see TextureStreamer
+    SkpLoader(string path, World *world, const ShaderManager *shaders,
+              bool keepGeometry = false, bool streamTextures = false);
     ~SkpLoader();
 
     // call before loading anything else
     void loadGlobal();
     Component * loadRoot();
 
+    // created by loadGlobal(), owned by the world
+    const vector<TextureArray *> & textureArrays() const;
+
 private:
-    // return null for no mesh
-    void loadEntities(SUEntitiesRef entities, Component *component);
+    struct PendingTexture
+    {
+        Texture *texture;
+        SUTextureRef suTexture;
+        string fileName;
+        size_t width, height;
+    };
+
+    // collisionOnly for dedicated collision geometry, which isn't rendered
+    void loadEntities(SUEntitiesRef entities, Component *component,
+                      bool collisionOnly = false);
     Component * loadInstance(SUComponentInstanceRef instance);
-    Mesh * loadMesh(SUEntitiesRef entities);
+    // return null for no mesh
+    // if ownCollision is false, only faces on the collision layer collide
+    Mesh * loadMesh(SUEntitiesRef entities, bool collisionOnly,
+                    bool ownCollision);
+    // replace meshes in the hierarchy with copies that only collide
+    void makeCollisionOnly(Component *component);
     Material * loadMaterial(SUMaterialRef suMaterial);
     Texture * loadTexture(SUTextureRef suTexture);
+    // upload loaded textures into texture arrays, grouped by size
+    void packTextures();
+    // BC1 / BC3 with mips, cached next to the scene
+    void packCompressedTextures();
+    // RGBA, mips generated by GL
+    void packRawTextures();
 
     // utils
+    void decodeTexture(SUTextureRef suTexture, size_t *width, size_t *height,
+                       vector<SUColor> &colors);
+    // pixel size of the image, which can differ from the size SketchUp
+    // reports for the texture
+    void decodedSize(SUTextureRef suTexture, size_t *width, size_t *height);
+    // file in the texture cache directory
+    static string textureCacheName(const PendingTexture &pending);
+    // layers (tags) named "Collision" and definitions ending in "_collision"
+    // hold low-poly collision geometry instead of the rendered faces
+    static bool isCollisionName(string name);
+    bool onCollisionLayer(SUDrawingElementRef element);
+    bool isCollisionInstance(SUComponentInstanceRef instance);
     int32_t getID(SUEntityRef entity);
     SUStringRef createString();
     string convertStringAndRelease(SUStringRef *suStr);
@@ -47,21 +85,29 @@ private:
         }
     }
 
+    string path;
     SUModelRef model = SU_INVALID;
     World *world;
     const ShaderManager *shaders;
+    bool keepGeometry;
+    bool streamTextures;
 
     // maps file name to texture
     // file name seems to be the only way to identify shared ImageReps, but this
     // can cause conflicts
     std::unordered_map<string, Texture *> loadedTextures;
+    // loaded textures waiting for packTextures()
+    vector<PendingTexture> pendingTextures;
+    vector<TextureArray *> _textureArrays;
     // maps SU material ID to material (not persistent ID!)
     std::unordered_map<int32_t, Material *> loadedMaterials;
-    // maps SU definition ID to component hierarchy
-    std::unordered_map<int32_t, unique_ptr<Component>> componentDefinitions;
+    // maps SU definition ID to component hierarchy, owned by the world
+    std::unordered_map<int32_t, Component *> componentDefinitions;
     // maps image instance ID to ComponentInstance
     // because we can't cast Image to ComponentInstance for some reason :(
     std::unordered_map<int32_t, SUComponentInstanceRef> imageInstances;
+    // maps mesh to a copy without render primitives
+    std::unordered_map<const Mesh *, Mesh *> collisionOnlyMeshes;
 };
 
 }  // namespace
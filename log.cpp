@@ -0,0 +1,23 @@
+#include "log.h"
+
+namespace diorama {
+
+static Verbosity currentVerbosity = Verbosity::Normal;
+static std::ostream discard(nullptr);  // no buffer, writes do nothing
+
+Verbosity verbosity()
+{
+    return currentVerbosity;
+}
+
+void setVerbosity(Verbosity level)
+{
+    currentVerbosity = level;
+}
+
+std::ostream & logAt(Verbosity level)
+{
+    return level <= currentVerbosity ? cout : discard;
+}
+
+}  // namespace
@@ -0,0 +1,20 @@
+#pragma once
+#include "common.h"
+
+namespace diorama {
+
+enum class Verbosity
+{
+    Quiet,  // only warnings and errors
+    Normal,
+    Verbose  // every loaded object and world change
+};
+
+Verbosity verbosity();
+void setVerbosity(Verbosity level);
+
+// cout if the verbosity is at least level, otherwise a stream that discards
+// everything. warnings and errors should go straight to cout
+std::ostream & logAt(Verbosity level);
+
+}  // namespace
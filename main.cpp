@@ -1,4 +1,6 @@
 #include "game.h"
+#include "headless.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
@@ -7,6 +9,13 @@
 
 #define OPENGL_DEBUG
 
+#ifdef OPENGL_DEBUG
+const bool DEBUG_CONTEXT = true;
+#else
+const bool DEBUG_CONTEXT = false;
+#endif
+
+#ifdef _WIN32
 extern "C" 
 {
     // request dedicated graphics card for Nvidia and AMD
@@ -15,8 +24,10 @@ extern "C"
     __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
     __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 }
+#endif
 
 std::ostream & operator<<(std::ostream &o, SDL_version version);
+void showError(const char *title, const char *message, SDL_Window *window);
 void messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
                      GLsizei length, const GLchar *msg, const void *data);
 
@@ -28,41 +39,73 @@ int main(int argc, char *argv[])
     cout << "SDL version: " <<compiled<< " (compiled), "
         <<linked<< " (linked)\n";
     
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_Window *window = SDL_CreateWindow("diorama",
-        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        800, 600,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);  // TODO highdpi?
-    if (!window) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Error",
-                                 SDL_GetError(), nullptr);
-        SDL_Quit();
-        return EXIT_FAILURE;
+    vector<string> args;
+    args.reserve(argc);
+    for (int i = 0; i < argc; i++)
+        args.emplace_back(argv[i]);
+    // headless mode renders offscreen for benchmarking
+    bool headless = std::find(args.begin(), args.end(), "--headless")
+        != args.end();
+    if (std::find(args.begin(), args.end(), "--software") != args.end()) {
+        // select Mesa's software rasterizer (also works with the Mesa
+        // opengl32.dll drop-in on Windows)
+        SDL_setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+        SDL_setenv("GALLIUM_DRIVER", "llvmpipe", 1);
     }
 
-#ifdef OPENGL_DEBUG
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-#else
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
-#endif
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
-                        SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-    SDL_GLContext gl_context = SDL_GL_CreateContext(window);
-    if (!gl_context) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL OpenGL Error",
-                                 SDL_GetError(), window);
-        SDL_Quit();
-        return EXIT_FAILURE;
-    }
-    SDL_GL_SetSwapInterval(1);  // enable vsync
+    // build servers often have no display server, which SDL windows need
+    bool useEGL = headless && diorama::HeadlessContext::SUPPORTED;
+    diorama::HeadlessContext headlessContext;
+    SDL_Window *window = nullptr;  // null with EGL
+
+    if (useEGL) {
+        SDL_Init(0);
+        if (!headlessContext.create(3, 3, DEBUG_CONTEXT)) {
+            showError("EGL Error", "Error creating headless context",
+                      nullptr);
+            SDL_Quit();
+            return EXIT_FAILURE;
+        }
+        if (gl3wInit2(diorama::HeadlessContext::getProcAddress)) {
+            showError("gl3w Error", "Error initializing OpenGL", nullptr);
+            SDL_Quit();
+            return EXIT_FAILURE;
+        }
+    } else {
+        SDL_Init(SDL_INIT_VIDEO);
+        Uint32 windowFlags = SDL_WINDOW_OPENGL;
+        if (headless)
+            windowFlags |= SDL_WINDOW_HIDDEN;
+        else
+            windowFlags |= SDL_WINDOW_RESIZABLE;  // TODO highdpi?
+        window = SDL_CreateWindow("diorama",
+            SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            800, 600, windowFlags);
+        if (!window) {
+            showError("SDL Error", SDL_GetError(), nullptr);
+            SDL_Quit();
+            return EXIT_FAILURE;
+        }
+
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS,
+            DEBUG_CONTEXT ? SDL_GL_CONTEXT_DEBUG_FLAG : 0);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                            SDL_GL_CONTEXT_PROFILE_CORE);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GLContext gl_context = SDL_GL_CreateContext(window);
+        if (!gl_context) {
+            showError("SDL OpenGL Error", SDL_GetError(), window);
+            SDL_Quit();
+            return EXIT_FAILURE;
+        }
+        SDL_GL_SetSwapInterval(headless ? 0 : 1);  // enable vsync
 
-    if (gl3wInit()) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "gl3w Error",
-                                 "Error initializing OpenGL", window);
-        SDL_Quit();
-        return EXIT_FAILURE;
+        if (gl3wInit()) {
+            showError("gl3w Error", "Error initializing OpenGL", window);
+            SDL_Quit();
+            return EXIT_FAILURE;
+        }
     }
 
     cout << "OpenGL renderer: " <<glGetString(GL_RENDERER)<< "\n";
@@ -76,24 +119,20 @@ int main(int argc, char *argv[])
         GL_DONT_CARE, 0, nullptr, GL_FALSE);
 #endif
 
-    SDL_SetRelativeMouseMode(SDL_TRUE);
-
-    vector<string> args;
-    args.reserve(argc);
-    for (int i = 0; i < argc; i++)
-        args.emplace_back(argv[i]);
+    if (!headless)
+        SDL_SetRelativeMouseMode(SDL_TRUE);
 
     int result = EXIT_SUCCESS;
     try {
         diorama::Game game(window);
         game.main(args);
-    } catch (std::exception e) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error running game",
-                                 e.what(), window);
+    } catch (const std::exception &e) {
+        showError("Error running game", e.what(), window);
         result = EXIT_FAILURE;
     }
 
-    SDL_DestroyWindow(window);
+    if (window)
+        SDL_DestroyWindow(window);
     SDL_Quit();
     return result;
 }
@@ -104,6 +143,13 @@ std::ostream & operator<<(std::ostream &o, SDL_version version)
         <<(int)version.patch;
 }
 
+// also printed for headless runs, where there may be no display to show it
+void showError(const char *title, const char *message, SDL_Window *window)
+{
+    cout <<title<< ": " <<message<< "\n";
+    SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, title, message, window);
+}
+
 void messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
                      GLsizei length, const GLchar *msg, const void *data)
 {
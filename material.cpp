@@ -1,26 +1,41 @@
 #include "material.h"
+#include "log.h"
+#include "profiler.h"
 #include "shadersource.h"
 #include "world.h"
-#include <exception>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <GL/gl3w.h>
 
 namespace diorama {
 
-const Texture Texture::NO_TEXTURE(0);
+const Texture Texture::NO_TEXTURE(0, 0);
 
 ShaderProgram::ShaderProgram()
-{
-    glProgram = glCreateProgram();
-}
+{}
 
 ShaderProgram::~ShaderProgram()
 {
-    glDeleteProgram(glProgram);
+    if (glProgram != 0)
+        glDeleteProgram(glProgram);
 }
 
-void ShaderProgram::link(string name, initializer_list<GLShader> shaders) {
+void ShaderProgram::link(string name, initializer_list<GLShader> shaders,
+                         bool retrievable)
+{
+    // created here instead of the constructor so programs can exist without a
+    // GL context
+    if (glProgram == 0)
+        glProgram = glCreateProgram();
     for (auto &shader : shaders)
         glAttachShader(glProgram, shader);
+    if (retrievable)
+        glProgramParameteri(glProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
 
     glLinkProgram(glProgram);
     GLint linked;
@@ -31,13 +46,50 @@ void ShaderProgram::link(string name, initializer_list<GLShader> shaders) {
         unique_ptr<char[]> log(new char[logLen]);
         glGetProgramInfoLog(glProgram, logLen, NULL, log.get());
         cout <<name<< " link error: " <<log.get()<< "\n";
-        throw std::exception("Program link error");
+        throw std::runtime_error("Program link error");
     }
+    // shaders can be deleted after linking
+    for (auto &shader : shaders)
+        glDetachShader(glProgram, shader);
+
+    initUniforms();
+}
+
+bool ShaderProgram::loadBinary(uint32_t format, const vector<uint8_t> &binary)
+{
+    if (glProgram == 0)
+        glProgram = glCreateProgram();
+    glProgramBinary(glProgram, format, binary.data(), (GLsizei)binary.size());
+    GLint linked;
+    glGetProgramiv(glProgram, GL_LINK_STATUS, &linked);
+    if (!linked)
+        return false;  // can still be linked from source
+    initUniforms();
+    return true;
+}
+
+bool ShaderProgram::getBinary(uint32_t *format, vector<uint8_t> *binary) const
+{
+    GLint length = 0;
+    glGetProgramiv(glProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    binary->resize(length);
+    GLenum binaryFormat;
+    glGetProgramBinary(glProgram, length, &length, &binaryFormat,
+                       binary->data());
+    binary->resize(length);
+    *format = binaryFormat;
+    return length > 0;
+}
 
+void ShaderProgram::initUniforms()
+{
     modelMatrixLoc = glGetUniformLocation(glProgram, "ModelMatrix");
     normalMatrixLoc = glGetUniformLocation(glProgram, "NormalMatrix");
     baseColorLoc = glGetUniformLocation(glProgram, "BaseColor");
     textureScaleLoc = glGetUniformLocation(glProgram, "TextureScale");
+    textureLayerLoc = glGetUniformLocation(glProgram, "TextureLayer");
 
     glUseProgram(glProgram);
     GLuint transformIdx = glGetUniformBlockIndex(glProgram, "CameraBlock");
@@ -50,50 +102,160 @@ void ShaderProgram::link(string name, initializer_list<GLShader> shaders) {
     glUseProgram(0);
 }
 
-void ShaderManager::linkPrograms()
+const char PROGRAM_CACHE_MAGIC[4] = {'D', 'P', 'R', 'G'};
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// FNV-1a
+static uint64_t hashStrings(const vector<string> &strings)
 {
-    basicVert = compileShader(GLShaderType::VertexShader,
-        "Basic vertex",
-        {VERSION_DIRECTIVE, vertShaderSrc});
-    GLShader coloredFrag = compileShader(GLShaderType::FragmentShader,
-        "Solid color",
+    uint64_t hash = 14695981039346656037ull;
+    for (auto &str : strings) {
+        // include the terminator so boundaries between strings matter
+        for (size_t i = 0; i <= str.size(); i++) {
+            hash ^= (uint8_t)str.c_str()[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// the key is stored too in case of a hash collision in the file name
+static bool loadProgramBinary(const string &path, uint64_t key,
+                              uint32_t *format, vector<uint8_t> *binary)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version, length;
+    uint64_t fileKey;
+    file.read(magic, sizeof(magic));
+    file.read((char *)&version, sizeof(version));
+    file.read((char *)&fileKey, sizeof(fileKey));
+    file.read((char *)format, sizeof(*format));
+    file.read((char *)&length, sizeof(length));
+    if (!file || memcmp(magic, PROGRAM_CACHE_MAGIC, sizeof(magic)) != 0
+            || version != PROGRAM_CACHE_VERSION || fileKey != key
+            || length == 0 || length > (64u << 20))
+        return false;
+    binary->resize(length);
+    file.read((char *)binary->data(), length);
+    return (bool)file;
+}
+
+static bool saveProgramBinary(const string &path, uint64_t key,
+                              uint32_t format, const vector<uint8_t> &binary)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    uint32_t length = (uint32_t)binary.size();
+    file.write(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    file.write((const char *)&PROGRAM_CACHE_VERSION,
+               sizeof(PROGRAM_CACHE_VERSION));
+    file.write((const char *)&key, sizeof(key));
+    file.write((const char *)&format, sizeof(format));
+    file.write((const char *)&length, sizeof(length));
+    file.write((const char *)binary.data(), binary.size());
+    return (bool)file;
+}
+
+bool ShaderManager::binaryCacheSupported()
+{
+    // core since 4.1, otherwise ARB_get_program_binary
+    if (!glProgramBinary || !glGetProgramBinary)
+        return false;
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return numFormats > 0;
+}
+
+void ShaderManager::linkPrograms(string cacheDir)
+{
+    PROFILE_ZONE("ShaderManager::linkPrograms");
+    this->cacheDir.clear();
+    cachedPrograms = 0;
+    if (!cacheDir.empty()) {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        fs::create_directories(cacheDir, error);
+        if (!binaryCacheSupported()) {
+            logAt(Verbosity::Verbose)
+                << "Program binaries not supported, not caching shaders\n";
+        } else if (error) {
+            cout << "Couldn't create shader cache " <<cacheDir<< "\n";
+        } else {
+            this->cacheDir = cacheDir;
+            driverString = string((const char *)glGetString(GL_VENDOR)) + "\n"
+                + (const char *)glGetString(GL_RENDERER) + "\n"
+                + (const char *)glGetString(GL_VERSION);
+        }
+    }
+
+    linkProgram(&coloredProg, "Solid color",
         {VERSION_DIRECTIVE, fragShaderSrc});
-    GLShader texturedFrag = compileShader(GLShaderType::FragmentShader,
-        "Textured",
+    linkProgram(&texturedProg, "Textured",
         {VERSION_DIRECTIVE,
         "#define BASE_TEXTURE\n",
         fragShaderSrc});
-    GLShader shiftedTextureFrag = compileShader(GLShaderType::FragmentShader,
-        "Color-shifted texture",
+    linkProgram(&shiftedTextureProg, "Color-shifted texture",
         {VERSION_DIRECTIVE,
         "#define BASE_TEXTURE\n#define COLORIZE_SHIFT\n",
         fragShaderSrc});
-    GLShader tintedTextureFrag = compileShader(GLShaderType::FragmentShader,
-        "Color-tinted texture",
+    linkProgram(&tintedTextureProg, "Color-tinted texture",
         {VERSION_DIRECTIVE,
         "#define BASE_TEXTURE\n#define COLORIZE_TINT\n",
         fragShaderSrc});
-    GLShader debugFrag = compileShader(GLShaderType::FragmentShader,
-        "Debug",
+    linkProgram(&debugProg, "Debug",
         {VERSION_DIRECTIVE, debugFragShaderSrc});
 
-    coloredProg.link("Solid color", {basicVert, coloredFrag});
-    texturedProg.link("Textured", {basicVert, texturedFrag});
-    shiftedTextureProg.link("Color-shifted texture",
-        {basicVert, shiftedTextureFrag});
-    tintedTextureProg.link("Color-tinted texture",
-        {basicVert, tintedTextureFrag});
-    debugProg.link("Debug", {basicVert, debugFrag});
+    if (!this->cacheDir.empty())
+        logAt(Verbosity::Verbose) << "Loaded " <<cachedPrograms
+            << " shader programs from cache\n";
+}
 
-    glDeleteShader(coloredFrag);
-    glDeleteShader(texturedFrag);
-    glDeleteShader(shiftedTextureFrag);
-    glDeleteShader(tintedTextureFrag);
-    glDeleteShader(debugFrag);
+void ShaderManager::linkProgram(ShaderProgram *program, string name,
+                                const vector<string> &fragSources)
+{
+    vector<string> vertSources = {VERSION_DIRECTIVE, vertShaderSrc};
+    string cachePath;
+    uint64_t key = 0;
+    uint32_t format;
+    vector<uint8_t> binary;
+    if (!cacheDir.empty()) {
+        vector<string> keyStrings = {driverString};
+        keyStrings.insert(keyStrings.end(),
+                          vertSources.begin(), vertSources.end());
+        keyStrings.insert(keyStrings.end(),
+                          fragSources.begin(), fragSources.end());
+        key = hashStrings(keyStrings);
+        std::ostringstream fileName;
+        fileName << std::hex << std::setw(16) << std::setfill('0') << key
+            << ".prog";
+        cachePath = cacheDir + "/" + fileName.str();
+        if (loadProgramBinary(cachePath, key, &format, &binary)
+                && program->loadBinary(format, binary)) {
+            cachedPrograms++;
+            return;
+        }
+    }
+
+    // only compiled if some program isn't cached
+    if (basicVert == 0)
+        basicVert = compileShader(GLShaderType::VertexShader,
+            "Basic vertex", vertSources);
+    GLShader frag = compileShader(GLShaderType::FragmentShader, name,
+                                  fragSources);
+    program->link(name, {basicVert, frag}, !cachePath.empty());
+    glDeleteShader(frag);
+
+    if (!cachePath.empty()) {
+        if (!program->getBinary(&format, &binary)
+                || !saveProgramBinary(cachePath, key, format, binary))
+            cout << "Couldn't cache " <<name<< " shader program\n";
+    }
 }
 
 GLShader ShaderManager::compileShader(GLShaderType type, string name,
-                                      initializer_list<string> sources)
+                                      const vector<string> &sources)
 {
     GLShader shader = glCreateShader((GLenum)type);
     vector<const char *> sourcePtrs;
@@ -112,40 +274,151 @@ GLShader ShaderManager::compileShader(GLShaderType type, string name,
         unique_ptr<char[]> log(new char[logLen]);
         glGetShaderInfoLog(shader, logLen, NULL, log.get());
         cout <<name<< " compile error: " <<log.get()<< "\n";
-        throw std::exception("Shader compile error");
+        throw std::runtime_error("Shader compile error");
     }
     return shader;
 }
 
-Texture::Texture()
+TextureArray::TextureArray()
 {
     glGenTextures(1, &glTexture);
 }
 
-Texture::Texture(GLTexture glTexture)
-    : glTexture(glTexture)
-{}
-
-Texture::~Texture()
+TextureArray::~TextureArray()
 {
     if (glTexture != 0) {
         glDeleteTextures(1, &glTexture);
     }
 }
 
-void Texture::setImage(int width, int height, GLTextureFormat format,
-                       GLDataType type, const void *data)
+int TextureArray::maxLayers()
 {
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    return maxLayers;
+}
+
+bool TextureArray::compressionSupported()
+{
+    GLint numExtensions;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; i++) {
+        const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (string(name) == "GL_EXT_texture_compression_s3tc")
+            return true;
+    }
+    return false;
+}
+
+void TextureArray::allocate(int width, int height, int layers)
+{
+    this->width = width;
+    this->height = height;
+    this->layers = layers;
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, glTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                 width, height, 0,
-                 (GLenum)format, (GLenum)type, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA,
+                 width, height, layers, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
                     GL_LINEAR_MIPMAP_LINEAR);  // trilinear
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::setLayer(int layer, GLTextureFormat format,
+                            GLDataType type, const void *data)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+                    width, height, 1,
+                    (GLenum)format, (GLenum)type, data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::generateMipmaps()
+{
+    // each layer is filtered separately, so nothing bleeds between textures
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::allocateCompressed(int width, int height, int layers,
+                                      BlockFormat format, int levels)
+{
+    this->width = width;
+    this->height = height;
+    this->layers = layers;
+    this->levels = levels;
+    blockFormat = format;
+    glFormat = format == BlockFormat::BC1 ? GLTextureFormat::RgbBC1
+        : GLTextureFormat::RgbaBC3;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);  // trilinear
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::allocateLevel(int level)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, (GLenum)glFormat,
+                           glm::max(width >> level, 1),
+                           glm::max(height >> level, 1), layers, 0,
+                           (GLsizei)levelBytes(level), nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::freeLevel(int level)
+{
+    // respecifying as empty releases the storage
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, (GLenum)glFormat,
+                           0, 0, 0, 0, 0, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
+void TextureArray::setCompressedLevel(int layer, int level, const void *data,
+                                      size_t size)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                              glm::max(width >> level, 1),
+                              glm::max(height >> level, 1), 1,
+                              (GLenum)glFormat, (GLsizei)size, data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::setBaseLevel(int level)
+{
+    baseLevel = level;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, glTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+size_t TextureArray::levelBytes(int level) const
+{
+    return compressedSize(blockFormat, glm::max(width >> level, 1),
+                          glm::max(height >> level, 1)) * layers;
+}
+
+Texture::Texture()
+    : glTexture(0), layer(0)
+{}
+
+Texture::Texture(GLTexture glTexture, int layer)
+    : glTexture(glTexture), layer(layer)
+{}
+
 }  // namespace
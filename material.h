@@ -3,6 +3,7 @@
 
 #include "glutils.h"
 #include "resource.h"
+#include "texcompress.h"
 #include <glm/glm.hpp>
 
 namespace diorama {
@@ -25,13 +26,23 @@ public:
     ShaderProgram();
     ~ShaderProgram();
 
-    void link(string name, initializer_list<GLShader> shaders);
+    // retrievable so getBinary() works afterwards
+    void link(string name, initializer_list<GLShader> shaders,
+              bool retrievable = false);
+    // from getBinary(). false if the driver rejects it, eg. after an update
+    bool loadBinary(uint32_t format, const vector<uint8_t> &binary);
+    bool getBinary(uint32_t *format, vector<uint8_t> *binary) const;
 
-    GLProgram glProgram;
+    GLProgram glProgram = 0;
     GLUniformLocation modelMatrixLoc = -1;
     GLUniformLocation normalMatrixLoc = -1;
     GLUniformLocation baseColorLoc = -1;
     GLUniformLocation textureScaleLoc = -1;
+    GLUniformLocation textureLayerLoc = -1;
+
+private:
+    // after linking or loading a binary
+    void initUniforms();
 };
 
 class ShaderManager
@@ -43,28 +54,84 @@ public:
     ShaderProgram tintedTextureProg;
     ShaderProgram debugProg;
 
-    void linkPrograms();
+    // Linked programs are cached in cacheDir as driver-specific binaries, keyed
+    // on the shader sources and the GL vendor, renderer and version. Programs
+    // are compiled as usual if the cache misses or is rejected. Empty to
+    // always compile.
+    void linkPrograms(string cacheDir = "");
+
+    static bool binaryCacheSupported();
 
 private:
+    // from the cache if possible, with the basic vertex shader
+    void linkProgram(ShaderProgram *program, string name,
+                     const vector<string> &fragSources);
     GLShader compileShader(GLShaderType type, string name,
-        initializer_list<string> sources);
+        const vector<string> &sources);
+
+    string cacheDir;
+    string driverString;
+    int cachedPrograms = 0;
 
     GLShader basicVert = 0;
 };
 
+// Stack of same-size images in one GL texture, so materials with different
+// textures can be drawn without rebinding.
+class TextureArray : public Resource
+{
+public:
+    TextureArray();
+    ~TextureArray();
+
+    // limit of the GL implementation, at least 256
+    static int maxLayers();
+    // S3TC (BC1 / BC3) is an extension, but almost always available
+    static bool compressionSupported();
+
+    // images are RGBA, contents are undefined until set
+    void allocate(int width, int height, int layers);
+    void setLayer(int layer, GLTextureFormat format, GLDataType type,
+                  const void *data);
+    // call after setting all layers
+    void generateMipmaps();
+
+    // levels of a compressed format. storage is allocated separately for each
+    // level, so levels can be streamed in and out (see TextureStreamer)
+    void allocateCompressed(int width, int height, int layers,
+                            BlockFormat format, int levels);
+    void allocateLevel(int level);  // contents undefined until set
+    void freeLevel(int level);
+    void setCompressedLevel(int layer, int level, const void *data,
+                            size_t size);
+    // most detailed level sampled, more detailed levels don't need storage
+    void setBaseLevel(int level);
+    // of all layers, for compressed arrays
+    size_t levelBytes(int level) const;
+
+    GLTexture glTexture;
+    GLTextureFormat glFormat = GLTextureFormat::Rgba;
+    BlockFormat blockFormat = BlockFormat::BC1;
+    int width = 0, height = 0, layers = 0;
+    int levels = 1, baseLevel = 0;
+    // cache files with the compressed levels of each layer, empty if the array
+    // isn't streamed
+    vector<string> layerFiles;
+    int streamIndex = -1;  // in the TextureStreamer
+};
+
+// A layer of a TextureArray, which owns the GL texture.
 class Texture : public Resource
 {
 public:
     static const Texture NO_TEXTURE;
 
     Texture();
-    Texture(GLTexture glTexture);
-    ~Texture();
-
-    void setImage(int width, int height, GLTextureFormat format,
-                  GLDataType type, const void *data);
+    Texture(GLTexture glTexture, int layer);
 
     GLTexture glTexture;
+    int layer;
+    TextureArray *array = nullptr;  // null for NO_TEXTURE
 };
 
 enum class RenderOrder
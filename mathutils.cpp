@@ -1,6 +1,12 @@
 #include "mathutils.h"
 #include <glm/ext/matrix_transform.hpp>
 
+#if defined(__SSE__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define DIORAMA_SSE
+#include <xmmintrin.h>
+#endif
+
 namespace diorama {
 
 // blender coordinate system
@@ -53,6 +59,9 @@ Transform & Transform::operator*=(const Transform &rhs)
 
 Transform Transform::inverse() const
 {
+    // almost everything is affine, which is much cheaper to invert
+    if (mat[0][3] == 0 && mat[1][3] == 0 && mat[2][3] == 0 && mat[3][3] == 1)
+        return AffineTransform(*this).inverse().matrix();
     return glm::inverse(mat);
 }
 
@@ -101,4 +110,251 @@ glm::vec3 Transform::transformPoint(const glm::vec3 &v) const
     return mat * glm::vec4(v, 1);
 }
 
+
+AffineTransform::AffineTransform()
+    : cols {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}
+{}
+
+AffineTransform::AffineTransform(const Transform &t)
+{
+    const glm::mat4 &m = t.matrix();
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 3; i++)
+            cols[j][i] = m[j][i];
+        cols[j][3] = j == 3 ? 1.0f : 0.0f;
+    }
+}
+
+glm::mat4 AffineTransform::matrix() const
+{
+    glm::mat4 m;
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++)
+            m[j][i] = cols[j][i];
+    }
+    return m;
+}
+
+#ifdef DIORAMA_SSE
+// c0 * x + c1 * y + c2 * z + c3 * w
+static inline __m128 combine(__m128 c0, __m128 c1, __m128 c2, __m128 c3,
+                             float x, float y, float z, float w)
+{
+    __m128 xy = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(x)),
+                           _mm_mul_ps(c1, _mm_set1_ps(y)));
+    __m128 zw = _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(z)),
+                           _mm_mul_ps(c3, _mm_set1_ps(w)));
+    return _mm_add_ps(xy, zw);
+}
+#endif
+
+AffineTransform AffineTransform::operator*(const AffineTransform &rhs) const
+{
+    AffineTransform result;
+#ifdef DIORAMA_SSE
+    __m128 c0 = _mm_load_ps(cols[0]), c1 = _mm_load_ps(cols[1]);
+    __m128 c2 = _mm_load_ps(cols[2]), c3 = _mm_load_ps(cols[3]);
+    for (int j = 0; j < 4; j++) {
+        const float *b = rhs.cols[j];
+        _mm_store_ps(result.cols[j], combine(c0, c1, c2, c3,
+                                             b[0], b[1], b[2], b[3]));
+    }
+#else
+    for (int j = 0; j < 4; j++) {
+        const float *b = rhs.cols[j];
+        for (int i = 0; i < 4; i++) {
+            result.cols[j][i] = cols[0][i] * b[0] + cols[1][i] * b[1]
+                + cols[2][i] * b[2] + cols[3][i] * b[3];
+        }
+    }
+#endif
+    return result;
+}
+
+AffineTransform & AffineTransform::operator*=(const AffineTransform &rhs)
+{
+    return *this = *this * rhs;
+}
+
+AffineTransform AffineTransform::inverse() const
+{
+    // rows of the inverse are the cross products of the columns, over the
+    // determinant
+    glm::vec3 c0 = axis(0), c1 = axis(1), c2 = axis(2), t = origin();
+    glm::vec3 r0 = glm::cross(c1, c2), r1 = glm::cross(c2, c0);
+    glm::vec3 r2 = glm::cross(c0, c1);
+    float invDet = 1.0f / glm::dot(c0, r0);
+    r0 *= invDet;
+    r1 *= invDet;
+    r2 *= invDet;
+
+    AffineTransform result;
+    for (int j = 0; j < 3; j++) {
+        result.cols[j][0] = r0[j];
+        result.cols[j][1] = r1[j];
+        result.cols[j][2] = r2[j];
+    }
+    result.cols[3][0] = -glm::dot(r0, t);
+    result.cols[3][1] = -glm::dot(r1, t);
+    result.cols[3][2] = -glm::dot(r2, t);
+    return result;
+}
+
+float AffineTransform::determinant() const
+{
+    glm::vec3 c0 = axis(0), c1 = axis(1), c2 = axis(2);
+    return glm::dot(c0, glm::cross(c1, c2));
+}
+
+glm::mat3 AffineTransform::normalMatrix() const
+{
+    glm::vec3 c0 = axis(0), c1 = axis(1), c2 = axis(2);
+    glm::vec3 r0 = glm::cross(c1, c2);
+    float invDet = 1.0f / glm::dot(c0, r0);
+    // the transpose of the inverse, so the rows from inverse() are columns
+    return glm::mat3(r0 * invDet, glm::cross(c2, c0) * invDet,
+                     glm::cross(c0, c1) * invDet);
+}
+
+glm::vec3 AffineTransform::axis(int i) const
+{
+    return glm::vec3(cols[i][0], cols[i][1], cols[i][2]);
+}
+
+glm::vec3 AffineTransform::origin() const
+{
+    return axis(3);
+}
+
+glm::vec3 AffineTransform::transformVector(const glm::vec3 &v) const
+{
+    glm::vec3 result;
+    transformVectors(&v, &result, 1);
+    return result;
+}
+
+glm::vec3 AffineTransform::transformPoint(const glm::vec3 &p) const
+{
+    glm::vec3 result;
+    transformPoints(&p, &result, 1);
+    return result;
+}
+
+void AffineTransform::transformPoints(const glm::vec3 *in, glm::vec3 *out,
+                                      size_t count) const
+{
+#ifdef DIORAMA_SSE
+    __m128 c0 = _mm_load_ps(cols[0]), c1 = _mm_load_ps(cols[1]);
+    __m128 c2 = _mm_load_ps(cols[2]), c3 = _mm_load_ps(cols[3]);
+    for (size_t i = 0; i < count; i++) {
+        // store all 4 lanes separately, out[i + 1] could still be unread
+        alignas(16) float p[4];
+        _mm_store_ps(p, combine(c0, c1, c2, c3, in[i].x, in[i].y, in[i].z, 1));
+        out[i] = glm::vec3(p[0], p[1], p[2]);
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 p = in[i];
+        for (int k = 0; k < 3; k++) {
+            out[i][k] = cols[0][k] * p.x + cols[1][k] * p.y
+                + cols[2][k] * p.z + cols[3][k];
+        }
+    }
+#endif
+}
+
+void AffineTransform::transformVectors(const glm::vec3 *in, glm::vec3 *out,
+                                       size_t count) const
+{
+#ifdef DIORAMA_SSE
+    __m128 c0 = _mm_load_ps(cols[0]), c1 = _mm_load_ps(cols[1]);
+    __m128 c2 = _mm_load_ps(cols[2]), c3 = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i++) {
+        alignas(16) float v[4];
+        _mm_store_ps(v, combine(c0, c1, c2, c3, in[i].x, in[i].y, in[i].z, 0));
+        out[i] = glm::vec3(v[0], v[1], v[2]);
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 v = in[i];
+        for (int k = 0; k < 3; k++)
+            out[i][k] = cols[0][k] * v.x + cols[1][k] * v.y + cols[2][k] * v.z;
+    }
+#endif
+}
+
+
+bool BoundingBox::empty() const
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+void BoundingBox::add(const glm::vec3 &point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void BoundingBox::add(const BoundingBox &box)
+{
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+BoundingBox BoundingBox::expanded(float amount) const
+{
+    if (empty())
+        return *this;
+    return BoundingBox {min - glm::vec3(amount), max + glm::vec3(amount)};
+}
+
+BoundingBox BoundingBox::transformed(const Transform &t) const
+{
+    BoundingBox box;
+    if (empty())
+        return box;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? max.x : min.x,
+                         (i & 2) ? max.y : min.y,
+                         (i & 4) ? max.z : min.z);
+        box.add(t.transformPoint(corner));
+    }
+    return box;
+}
+
+BoundingBox BoundingBox::transformed(const AffineTransform &t) const
+{
+    BoundingBox box;
+    if (empty())
+        return box;
+    // center and half extents, so the 8 corners aren't needed
+    glm::vec3 center = t.transformPoint((min + max) * 0.5f);
+    glm::vec3 half = (max - min) * 0.5f;
+    glm::vec3 extent = glm::abs(t.axis(0)) * half.x
+        + glm::abs(t.axis(1)) * half.y + glm::abs(t.axis(2)) * half.z;
+    return BoundingBox {center - extent, center + extent};
+}
+
+bool BoundingBox::intersects(const BoundingBox &other) const
+{
+    return min.x <= other.max.x && max.x >= other.min.x
+        && min.y <= other.max.y && max.y >= other.min.y
+        && min.z <= other.max.z && max.z >= other.min.z;
+}
+
+bool BoundingBox::intersectsRay(glm::vec3 origin, glm::vec3 dir,
+                                float maxT) const
+{
+    if (empty())
+        return false;
+    // slab test, division by zero gives infinities which work out
+    glm::vec3 invDir = 1.0f / dir;
+    glm::vec3 t0 = (min - origin) * invDir;
+    glm::vec3 t1 = (max - origin) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tNear.x, tNear.y), tNear.z);
+    float exit = glm::min(glm::min(tFar.x, tFar.y), tFar.z);
+    return enter <= exit && exit >= 0 && enter <= maxT;
+}
+
 }  // mamespace
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <limits>
 #include <glm/glm.hpp>
 
 namespace diorama {
@@ -43,4 +45,54 @@ private:
     glm::mat4 mat;
 };
 
+// Transform without the projective row, which is all that the hierarchy
+// uses. Multiplying and inverting are much cheaper, and use SSE if available.
+class AffineTransform
+{
+public:
+    AffineTransform();  // identity
+    AffineTransform(const Transform &t);  // drops the bottom row
+
+    glm::mat4 matrix() const;
+
+    AffineTransform operator*(const AffineTransform &rhs) const;
+    AffineTransform & operator*=(const AffineTransform &rhs);
+    // inverts the 3x3 part and translation, no general 4x4 inverse
+    AffineTransform inverse() const;
+    float determinant() const;  // of the 3x3 part, negative if mirrored
+    glm::mat3 normalMatrix() const;  // inverse transpose of the 3x3 part
+
+    glm::vec3 axis(int i) const;  // column i of the 3x3 part, NOT normalized
+    glm::vec3 origin() const;
+    glm::vec3 transformVector(const glm::vec3 &v) const;
+    glm::vec3 transformPoint(const glm::vec3 &p) const;
+    // out can be the same as in
+    void transformPoints(const glm::vec3 *in, glm::vec3 *out,
+                         size_t count) const;
+    void transformVectors(const glm::vec3 *in, glm::vec3 *out,
+                          size_t count) const;
+
+private:
+    // columns of a 4x4 matrix, bottom row is always 0 0 0 1
+    alignas(16) float cols[4][4];
+};
+
+// axis-aligned. starts empty
+struct BoundingBox
+{
+    glm::vec3 min {std::numeric_limits<float>::max()};
+    glm::vec3 max {-std::numeric_limits<float>::max()};
+
+    bool empty() const;
+    void add(const glm::vec3 &point);
+    void add(const BoundingBox &box);
+    BoundingBox expanded(float amount) const;  // in every direction
+    // box containing the transformed corners
+    BoundingBox transformed(const Transform &t) const;
+    BoundingBox transformed(const AffineTransform &t) const;
+    bool intersects(const BoundingBox &other) const;
+    // does the ray hit the box between origin and origin + dir * maxT
+    bool intersectsRay(glm::vec3 origin, glm::vec3 dir, float maxT) const;
+};
+
 }  // namespace
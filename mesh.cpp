@@ -1,14 +1,11 @@
 #include "mesh.h"
+#include <cmath>
 #include <GL/gl3w.h>
 
 namespace diorama {
 
 RenderPrimitive::RenderPrimitive()
-{
-    glGenVertexArrays(1, &vertexArray);
-    glGenBuffers(ATTRIB_MAX, attribBuffers.data());
-    glGenBuffers(1, &elementBuffer);
-}
+{}
 
 RenderPrimitive::~RenderPrimitive()
 {
@@ -24,6 +21,10 @@ RenderPrimitive::RenderPrimitive(RenderPrimitive &&other)
     , attribBuffers(other.attribBuffers)
     , elementBuffer(other.elementBuffer)
     , numIndices(other.numIndices)
+    , lods(std::move(other.lods))
+    , occluders(std::move(other.occluders))
+    , textureDensity(other.textureDensity)
+    , geometry(std::move(other.geometry))
     , material(other.material)
 {
     other.vertexArray = 0;
@@ -38,6 +39,7 @@ void RenderPrimitive::setAttribData(VertexAttribute attrib, size_t size,
     // array buffer bindings are not stored in VAO
     // https://gamedev.stackexchange.com/a/99238
     // https://stackoverflow.com/a/26559063
+    genBuffers();
     glBindVertexArray(vertexArray);
     glBindBuffer(GL_ARRAY_BUFFER, attribBuffers[attrib]);
     glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
@@ -47,15 +49,75 @@ void RenderPrimitive::setAttribData(VertexAttribute attrib, size_t size,
     glBindVertexArray(0);
 }
 
-void RenderPrimitive::setIndices(int numIndices, const MeshIndex *indices)
+void RenderPrimitive::setIndices(int numIndices, const MeshIndex *indices,
+                                 vector<LevelOfDetail> lods)
 {
+    int totalIndices = numIndices;
+    if (!lods.empty())
+        totalIndices = lods.back().firstIndex + lods.back().numIndices;
+    genBuffers();
     glBindVertexArray(vertexArray);
     // element buffer binding *is* stored in VAO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(MeshIndex),
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(MeshIndex),
                  indices, GL_STATIC_DRAW);
     glBindVertexArray(0);
     this->numIndices = numIndices;
+    this->lods = std::move(lods);
+}
+
+void RenderPrimitive::setGeometry(const RenderGeometry &geometry)
+{
+    size_t vertexBufferSize = geometry.positions.size() * sizeof(glm::vec3);
+    setAttribData(ATTRIB_POSITION, vertexBufferSize, 3, GLDataType::Float,
+                  geometry.positions.data());
+    setAttribData(ATTRIB_NORMAL, vertexBufferSize, 3, GLDataType::Float,
+                  geometry.normals.data());
+    setAttribData(ATTRIB_STQ, vertexBufferSize, 3, GLDataType::Float,
+                  geometry.stqCoords.data());
+    setIndices(geometry.indices.size(), geometry.indices.data());
+    textureDensity = computeTextureDensity(geometry.positions,
+                                           geometry.stqCoords,
+                                           geometry.indices);
+}
+
+void RenderPrimitive::genBuffers()
+{
+    // GL objects are created on first use, so primitives can be constructed
+    // without a GL context
+    if (vertexArray == 0) {
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(ATTRIB_MAX, attribBuffers.data());
+        glGenBuffers(1, &elementBuffer);
+    }
+}
+
+float computeTextureDensity(const vector<glm::vec3> &positions,
+                            const vector<glm::vec3> &stqCoords,
+                            const vector<MeshIndex> &indices)
+{
+    // area weighted, so slivers don't dominate
+    float area = 0, textureArea = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        glm::vec3 p[3];
+        glm::vec2 uv[3];
+        for (int j = 0; j < 3; j++) {
+            p[j] = positions[indices[i + j]];
+            glm::vec3 stq = stqCoords[indices[i + j]];
+            uv[j] = glm::vec2(stq) / (stq.z != 0 ? stq.z : 1);
+        }
+        area += glm::length(glm::cross(p[1] - p[0], p[2] - p[0]));
+        glm::vec2 e1 = uv[1] - uv[0], e2 = uv[2] - uv[0];
+        textureArea += std::abs(e1.x * e2.y - e1.y * e2.x);
+    }
+    return area > 0 ? std::sqrt(textureArea / area) : 0;
+}
+
+void CollisionPrimitive::computeBounds()
+{
+    bounds = BoundingBox();
+    for (auto &vertex : vertices)
+        bounds.add(vertex);
 }
 
 }  // namespace
@@ -3,12 +3,28 @@
 
 #include "glutils.h"
 #include "material.h"
+#include "mathutils.h"
 #include "resource.h"
 
 namespace diorama {
 
 using MeshIndex = uint16_t;
 
+// a simplified version of a render primitive, using the same vertices
+struct LevelOfDetail
+{
+    int firstIndex;  // in the element buffer
+    int numIndices;
+    float error;  // max distance from the full detail surface, in mesh space
+};
+
+// vertex data of a render primitive kept on the CPU, for static batching
+struct RenderGeometry
+{
+    vector<glm::vec3> positions, normals, stqCoords;
+    vector<MeshIndex> indices;  // full detail triangles
+};
+
 class RenderPrimitive : noncopyable
 {
 public:
@@ -23,29 +39,54 @@ public:
 
     void setAttribData(VertexAttribute attrib, size_t size,
                        int components, GLDataType type, const void *data);
-    void setIndices(int numIndices, const MeshIndex *indices);
+    // indices also holds the ranges of any lods after the first numIndices
+    void setIndices(int numIndices, const MeshIndex *indices,
+                    vector<LevelOfDetail> lods = {});
+    // uploads all attributes and indices, and sets textureDensity
+    void setGeometry(const RenderGeometry &geometry);
 
-    GLVertexArray vertexArray;
-    array<GLBuffer, ATTRIB_MAX> attribBuffers;  // buffers for vertex attributes
-    GLBuffer elementBuffer;  // buffer for element indices
-    int numIndices = 0;
+    GLVertexArray vertexArray = 0;
+    // buffers for vertex attributes
+    array<GLBuffer, ATTRIB_MAX> attribBuffers {};
+    GLBuffer elementBuffer = 0;  // buffer for element indices
+    int numIndices = 0;  // full detail, starting at 0
+    vector<LevelOfDetail> lods;  // least detailed last
+    // triangle list of large opaque faces for occlusion culling
+    vector<glm::vec3> occluders;
+    // texture coordinate units per mesh unit, before any material texture
+    // scale, for choosing texture levels. 0 if unknown
+    float textureDensity = 0;
+    // only kept until static batching, otherwise null. mutable so batching
+    // can release it through const meshes
+    mutable unique_ptr<RenderGeometry> geometry;
 
     const Material *material = nullptr;  // null for default material
+
+private:
+    void genBuffers();
 };
 
+// average over the surface of a triangle list
+float computeTextureDensity(const vector<glm::vec3> &positions,
+                            const vector<glm::vec3> &stqCoords,
+                            const vector<MeshIndex> &indices);
+
 struct CollisionPrimitive
 {
     vector<glm::vec3> vertices;
     vector<MeshIndex> indices;  // triangles
+    BoundingBox bounds;  // call computeBounds() after changing vertices
     // TODO substance
+
+    void computeBounds();
 };
 
 struct Mesh : Resource
 {
     vector<RenderPrimitive> render;
     vector<CollisionPrimitive> collision;
+    BoundingBox bounds;  // of render primitives
     // TODO edges
-    // TODO bounds
 };
 
 }  // namespace
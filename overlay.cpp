@@ -0,0 +1,212 @@
+#include "overlay.h"
+#include <cctype>
+#include <iomanip>
+#include <sstream>
+
+namespace diorama {
+
+const glm::vec3 TEXT_COLOR(1, 1, 1);
+const glm::vec3 GRAPH_GOOD(0.2, 0.9, 0.2);
+const glm::vec3 GRAPH_SLOW(0.9, 0.9, 0.2);
+const glm::vec3 GRAPH_BAD(0.9, 0.2, 0.2);
+const glm::vec3 GRAPH_REFERENCE(0.5, 0.5, 0.5);
+
+const float TEXT_SCALE = 2;
+const float LINE_HEIGHT = 10 * TEXT_SCALE;
+const float MARGIN = 10;
+const float GRAPH_HEIGHT = 100;  // pixels
+const float GRAPH_MAX_MS = 50;  // top of graph
+
+static string formatMs(double ms)
+{
+    std::ostringstream str;
+    str << std::fixed << std::setprecision(2) << ms;
+    return str.str();
+}
+
+static string formatMB(size_t bytes)
+{
+    std::ostringstream str;
+    str << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " mb";
+    return str.str();
+}
+
+void StatsOverlay::addFrame(const FrameStats &stats)
+{
+    frameTimes.add(stats.frameMs);
+    latest = stats;
+    numFrames++;
+}
+
+void StatsOverlay::draw(render::Renderer *renderer) const
+{
+    if (!visible)
+        return;
+    const render::RenderStats &r = latest.render;
+
+    vector<string> lines;
+    lines.push_back("frame " + formatMs(latest.frameMs)
+        + "  p50 " + formatMs(frameTimes.percentile(0.5))
+        + "  p95 " + formatMs(frameTimes.percentile(0.95))
+        + "  p99 " + formatMs(frameTimes.percentile(0.99)));
+    string gpuLine = "gpu";
+    for (int pass = 0; pass < render::PASS_MAX; pass++) {
+        gpuLine += string("  ") + render::PASS_NAMES[pass] + " "
+            + formatMs(latest.gpuMs[pass]);
+    }
+    lines.push_back(gpuLine);
+    lines.push_back("draws " + std::to_string(r.drawCalls)
+        + "  tris " + std::to_string(r.triangles)
+        + "  lod " + std::to_string(r.lodDrawCalls)
+        + "  culled " + std::to_string(r.culledComponents)
+        + "  occluded " + std::to_string(r.occludedComponents));
+    lines.push_back("program " + std::to_string(r.programChanges)
+        + "  texture " + std::to_string(r.textureChanges)
+        + "  vao " + std::to_string(r.vertexArrayChanges)
+        + "  cull " + std::to_string(r.cullFaceChanges)
+        + "  filtered " + std::to_string(latest.filteredCommands));
+    lines.push_back("streamed tex " + formatMB(r.streamedTextureBytes)
+        + "  loads " + std::to_string(r.textureLevelLoads));
+    lines.push_back("collision tris "
+        + std::to_string(latest.collisionTriangles));
+
+    glm::vec2 pos(MARGIN, MARGIN);
+    for (auto &line : lines) {
+        overlayText(renderer, pos, line, TEXT_COLOR, TEXT_SCALE);
+        pos.y += LINE_HEIGHT;
+    }
+
+    // frame time graph, newest on the right
+    float bottom = pos.y + MARGIN + GRAPH_HEIGHT;
+    float right = MARGIN + GRAPH_FRAMES * 2;
+    for (float ms : {1000 / 60.0f, 1000 / 30.0f}) {
+        float y = bottom - ms / GRAPH_MAX_MS * GRAPH_HEIGHT;
+        renderer->overlayLine(glm::vec2(MARGIN, y), glm::vec2(right, y),
+                              GRAPH_REFERENCE);
+    }
+    size_t count = frameTimes.count();
+    for (size_t i = 0; i < count; i++) {
+        double ms = frameTimes.at(i);
+        float height = glm::min((float)ms / GRAPH_MAX_MS, 1.0f) * GRAPH_HEIGHT;
+        float x = right - (count - i) * 2;
+        glm::vec3 color = ms <= 1000 / 58.0 ? GRAPH_GOOD
+            : ms <= 1000 / 29.0 ? GRAPH_SLOW : GRAPH_BAD;
+        renderer->overlayLine(glm::vec2(x, bottom),
+                              glm::vec2(x, bottom - height), color);
+    }
+}
+
+void StatsOverlay::print() const
+{
+    const render::RenderStats &r = latest.render;
+    cout << "Frame: p50 " <<frameTimes.percentile(0.5)<< " ms, p95 "
+        <<frameTimes.percentile(0.95)<< " ms, p99 "
+        <<frameTimes.percentile(0.99)<< " ms\n";
+    cout << "  " <<r.drawCalls<< " draws (" <<r.lodDrawCalls<< " lod), "
+        <<r.triangles<< " triangles, " <<r.culledComponents<< " culled, "
+        <<r.occludedComponents<< " occluded ("
+        <<r.occluderTriangles<< " occluder triangles)\n";
+    cout << "  changes: " <<r.programChanges<< " program, "
+        <<r.textureChanges<< " texture, " <<r.vertexArrayChanges<< " vao, "
+        <<r.cullFaceChanges<< " cull face, " <<latest.filteredCommands
+        << " redundant commands filtered\n";
+    cout << "  " <<r.streamedTextureBytes / (1 << 20)
+        << " MB streamed textures resident\n";
+    cout << "  " <<latest.collisionTriangles<< " collision triangles\n";
+}
+
+void StatsOverlay::writeCSVHeader(std::ostream &out) const
+{
+    out << "frame,frame_ms";
+    for (auto name : render::PASS_NAMES)
+        out << ",gpu_" <<name<< "_ms";
+    out << ",draws,lod_draws,triangles,program_changes,texture_changes"
+        << ",vao_changes,cull_changes,culled,occluded,occluder_triangles"
+        << ",texture_loads,streamed_texture_bytes,filtered_commands"
+        << ",collision_triangles\n";
+}
+
+void StatsOverlay::writeCSVRow(std::ostream &out) const
+{
+    const render::RenderStats &r = latest.render;
+    out <<(numFrames - 1)<< "," <<latest.frameMs;
+    for (double ms : latest.gpuMs)
+        out << "," <<ms;
+    out << "," <<r.drawCalls<< "," <<r.lodDrawCalls<< "," <<r.triangles
+        << "," <<r.programChanges
+        << "," <<r.textureChanges<< "," <<r.vertexArrayChanges
+        << "," <<r.cullFaceChanges<< "," <<r.culledComponents
+        << "," <<r.occludedComponents<< "," <<r.occluderTriangles
+        << "," <<r.textureLevelLoads<< "," <<r.streamedTextureBytes
+        << "," <<latest.filteredCommands
+        << "," <<latest.collisionTriangles<< "\n";
+}
+
+
+// Stroke font on a 4x6 grid, y down. Each segment is four digits: x0 y0 x1 y1
+static const char * glyphSegments(char c)
+{
+    switch (c) {
+    case '0': return "0040 4046 4606 0600 4006";
+    case '1': return "2026 1120 1636";
+    case '2': return "0040 4043 4303 0306 0646";
+    case '3': return "0040 4046 0646 1343";
+    case '4': return "0003 0343 4046";
+    case '5': return "4000 0003 0343 4346 4606";
+    case '6': return "4000 0006 0646 4643 4303";
+    case '7': return "0040 4016";
+    case '8': return "0040 4046 4606 0600 0343";
+    case '9': return "4303 0300 0040 4046 4606";
+    case 'A': return "0600 0040 4046 0343";
+    case 'B': return "0006 0030 3041 4142 4233 0333 3344 4445 4536 3606";
+    case 'C': return "4000 0006 0646";
+    case 'D': return "0006 0030 3041 4145 4536 3606";
+    case 'E': return "4000 0006 0646 0333";
+    case 'F': return "4000 0006 0333";
+    case 'G': return "4000 0006 0646 4643 4323";
+    case 'H': return "0006 4046 0343";
+    case 'I': return "0040 2026 0646";
+    case 'J': return "4046 4606 0604";
+    case 'K': return "0006 0340 0346";
+    case 'L': return "0006 0646";
+    case 'M': return "0600 0023 2340 4046";
+    case 'N': return "0600 0046 4640";
+    case 'O': return "0040 4046 4606 0600";
+    case 'P': return "0600 0040 4043 4303";
+    case 'Q': return "0040 4046 4606 0600 2446";
+    case 'R': return "0600 0040 4043 4303 2346";
+    case 'S': return "4000 0003 0343 4346 4606";
+    case 'T': return "0040 2026";
+    case 'U': return "0006 0646 4640";
+    case 'V': return "0026 2640";
+    case 'W': return "0006 0623 2346 4640";
+    case 'X': return "0046 4006";
+    case 'Y': return "0023 4023 2326";
+    case 'Z': return "0040 4006 0646";
+    case '.': return "2526";
+    case ':': return "2122 2425";
+    case '-': return "1333";
+    case '/': return "4006";
+    case '%': return "4006 0001 4546";
+    default:  return "";
+    }
+}
+
+void overlayText(render::Renderer *renderer, glm::vec2 pos,
+                 const string &text, glm::vec3 color, float scale)
+{
+    for (char c : text) {
+        const char *segments = glyphSegments((char)std::toupper(c));
+        for (const char *s = segments; s[0]; s += 4) {
+            glm::vec2 start(s[0] - '0', s[1] - '0');
+            glm::vec2 end(s[2] - '0', s[3] - '0');
+            renderer->overlayLine(pos + start * scale, pos + end * scale,
+                                  color);
+            if (s[4] == ' ')
+                s++;
+        }
+        pos.x += 6 * scale;
+    }
+}
+
+}  // namespace
@@ -0,0 +1,49 @@
+#pragma once
+#include "common.h"
+
+#include "render.h"
+#include "stats.h"
+#include <ostream>
+#include <glm/glm.hpp>
+
+namespace diorama {
+
+// counters and timings for one frame
+struct FrameStats
+{
+    double frameMs = 0;  // wall time since the previous frame
+    render::RenderStats render;
+    size_t collisionTriangles = 0;
+    size_t filteredCommands = 0;  // redundant state changes skipped by GL
+    // latest available results, which are a few frames behind
+    array<double, render::PASS_MAX> gpuMs {};
+};
+
+// Frame time graph and counters, drawn with overlay lines.
+class StatsOverlay
+{
+public:
+    static const int GRAPH_FRAMES = 240;
+
+    void addFrame(const FrameStats &stats);
+    void draw(render::Renderer *renderer) const;
+    void print() const;  // summary to console
+
+    void writeCSVHeader(std::ostream &out) const;
+    void writeCSVRow(std::ostream &out) const;  // latest frame
+
+    bool visible = false;
+
+private:
+    TimingHistory frameTimes {GRAPH_FRAMES};
+    FrameStats latest;
+    size_t numFrames = 0;
+};
+
+// Draw text with overlay lines, from the top left corner. Supports letters,
+// digits, space and . : - / %
+// Each character is 6 * scale pixels wide and 8 * scale pixels tall.
+void overlayText(render::Renderer *renderer, glm::vec2 pos,
+                 const string &text, glm::vec3 color, float scale = 2);
+
+}  // namespace
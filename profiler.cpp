@@ -0,0 +1,107 @@
+#include "profiler.h"
+#include <chrono>
+#include <stdexcept>
+#include <fstream>
+#include <mutex>
+
+namespace diorama::profiler {
+
+struct ZoneRecord
+{
+    const char *name;
+    uint64_t start, end;  // nanoseconds
+};
+
+// each thread records into its own buffer. the lock is only contended while
+// exporting
+struct ThreadBuffer
+{
+    int threadID;
+    std::mutex lock;
+    vector<ZoneRecord> zones;
+};
+
+static std::mutex threadsLock;
+static vector<unique_ptr<ThreadBuffer>> threads;  // never shrinks
+
+static uint64_t now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+static ThreadBuffer * threadBuffer()
+{
+    // buffers are owned by the list so they outlive their threads
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> guard(threadsLock);
+        threads.push_back(std::make_unique<ThreadBuffer>());
+        buffer = threads.back().get();
+        buffer->threadID = threads.size() - 1;
+    }
+    return buffer;
+}
+
+Zone::Zone(const char *name)
+    : name(name)
+    , start(now())
+{}
+
+Zone::~Zone()
+{
+    uint64_t end = now();
+    ThreadBuffer *buffer = threadBuffer();
+    std::lock_guard<std::mutex> guard(buffer->lock);
+    buffer->zones.push_back(ZoneRecord {name, start, end});
+}
+
+bool enabled()
+{
+#ifdef DIORAMA_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void writeChromeTrace(string path)
+{
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Couldn't write trace file");
+
+    // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t numZones = 0;
+    std::lock_guard<std::mutex> guard(threadsLock);
+    for (auto &buffer : threads) {
+        std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+        for (auto &zone : buffer->zones) {
+            if (!first)
+                file << ",\n";
+            first = false;
+            // names are identifiers, no escaping necessary
+            file << "{\"name\":\"" <<zone.name<< "\",\"ph\":\"X\""
+                << ",\"ts\":" <<(zone.start / 1000.0)
+                << ",\"dur\":" <<((zone.end - zone.start) / 1000.0)
+                << ",\"pid\":0,\"tid\":" <<buffer->threadID<< "}";
+        }
+        numZones += buffer->zones.size();
+    }
+    file << "\n]}\n";
+    cout << "Wrote " <<numZones<< " zones to " <<path<< "\n";
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> guard(threadsLock);
+    for (auto &buffer : threads) {
+        std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+        buffer->zones.clear();
+    }
+}
+
+}  // namespace
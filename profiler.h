@@ -0,0 +1,39 @@
+#pragma once
+#include "common.h"
+
+#include <cstdint>
+
+// Scoped timing zones, exported in the Chrome trace event format
+// (open in chrome://tracing or https://ui.perfetto.dev).
+// Zones compile to nothing unless DIORAMA_PROFILE is defined.
+
+namespace diorama::profiler {
+
+// records the time from construction to destruction
+class Zone : noncopyable
+{
+public:
+    // name must outlive the profiler (use a string literal)
+    Zone(const char *name);
+    ~Zone();
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+bool enabled();  // compiled with DIORAMA_PROFILE
+// zones from all threads. other threads may keep recording
+void writeChromeTrace(string path);
+void clear();
+
+}  // namespace
+
+#ifdef DIORAMA_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) \
+    ::diorama::profiler::Zone PROFILE_CONCAT(profileZone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
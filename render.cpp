@@ -1,8 +1,8 @@
 #include "render.h"
+#include "profiler.h"
 #include <algorithm>
-#include <GL/gl3w.h>
+#include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
 namespace diorama::render {
 
@@ -13,13 +13,24 @@ const glm::mat4 REMAP_AXES(
     glm::vec4(0,1,0,0),
     glm::vec4(0,0,0,1));
 
+// use the least detailed lod that's off by at most this many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+// occluders are drawn nearest first until this many triangles
+const int MAX_OCCLUDER_TRIANGLES = 4096;
+
 bool DrawCall::operator<(const DrawCall &rhs) const
 {
     return sortKey < rhs.sortKey;
 }
 
-Renderer::Renderer(const ShaderManager *shaders)
+static RenderPass passForOrder(RenderOrder order)
+{
+    return order == RenderOrder::Transparent ? PASS_TRANSPARENT : PASS_OPAQUE;
+}
+
+Renderer::Renderer(const ShaderManager *shaders, RenderBackend *backend)
     : debugShader(&shaders->debugProg)
+    , backend(backend)
 {
     defaultMaterial.shader = &shaders->coloredProg;
     defaultMaterial.texture = &Texture::NO_TEXTURE;
@@ -27,31 +38,7 @@ Renderer::Renderer(const ShaderManager *shaders)
 
 void Renderer::initGL()
 {
-    glClearColor(0, 0, 0, 1);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // https://learnopengl.com/Advanced-OpenGL/Advanced-GLSL
-    glGenBuffers(1, &cameraUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
-    CameraBlock initCameraBlock;
-    glBufferData(GL_UNIFORM_BUFFER,
-        sizeof(CameraBlock), &initCameraBlock, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER,
-        ShaderProgram::BIND_TRANSFORM, cameraUBO);
-
-    glGenVertexArrays(1, &debugVertexArray);
-    glBindVertexArray(debugVertexArray);
-    glGenBuffers(1, &debugVertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, debugVertexBuffer);
-    glm::vec3 initVertices[] { {0,0,0}, {0,0,0} };
-    glBufferData(GL_ARRAY_BUFFER, sizeof(initVertices), initVertices,
-                 GL_STREAM_DRAW);
-    glVertexAttribPointer(RenderPrimitive::ATTRIB_POSITION, 3, GL_FLOAT,
-                          GL_FALSE, 0, (void *)0);
-    glEnableVertexAttribArray(RenderPrimitive::ATTRIB_POSITION);
-    glBindVertexArray(0);
+    backend->init();
 }
 
 void Renderer::setCameraParameters(float fov, float nearClip, float farClip)
@@ -66,73 +53,196 @@ void Renderer::resizeWindow(int w, int h)
 {
     windowWidth = w;
     windowHeight = h;
-    glViewport(0, 0, w, h);
     updateProjectionMatrix();
 }
 
+void Renderer::setOcclusionCulling(bool enabled)
+{
+    occlusionCulling = enabled;
+}
+
+void Renderer::setTextureStreamer(TextureStreamer *streamer)
+{
+    textureStreamer = streamer;
+}
+
 void Renderer::updateProjectionMatrix()
 {
     projectionMatrix = glm::perspective(cameraFOV,
         (float)windowWidth / windowHeight, nearClip, farClip) * REMAP_AXES;
+    pixelsPerUnit = windowHeight / (2 * glm::tan(cameraFOV / 2));
 }
 
 void Renderer::render(const World *world, const Transform &camTransform)
 {
+    PROFILE_ZONE("Renderer::render");
     glm::mat4 viewMatrix = camTransform.inverse().matrix();
     glm::mat4 cameraMatrix = projectionMatrix * viewMatrix;
-    CameraBlock cameraBlock {viewMatrix, projectionMatrix};
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &cameraBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    cameraPos = camTransform.origin();
 
+    _stats = RenderStats();
     drawCalls.clear();
-    drawHierarchy(drawCalls, world->root(), cameraMatrix, glm::mat4(1),
-                    &defaultMaterial);
-    std::sort(drawCalls.begin(), drawCalls.end());
+    drawBounds.clear();
+    {
+        // zone around the whole recursion instead of each call
+        PROFILE_ZONE("Renderer::drawHierarchy");
+        drawHierarchy(drawCalls, world->root(), cameraMatrix,
+                      Frustum(cameraMatrix), AffineTransform(),
+                      &defaultMaterial);
+    }
+    if (occlusionCulling)
+        cullOccluded(drawCalls, cameraMatrix);
+    {
+        PROFILE_ZONE("Renderer::sort");
+        std::sort(drawCalls.begin(), drawCalls.end());
+    }
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    commandBuffer.clear();
+    commandBuffer.setViewport(windowWidth, windowHeight);
+    commandBuffer.setCamera(CameraBlock {viewMatrix, projectionMatrix});
+    commandBuffer.clearScreen();
     renderDrawCalls(drawCalls);
+    renderDebugLines();
+
+    {
+        PROFILE_ZONE("RenderBackend::execute");
+        backend->execute(commandBuffer);
+    }
+    if (textureStreamer) {
+        // after the frame's draws were submitted
+        textureStreamer->update();
+        _stats.textureLevelLoads = textureStreamer->stats().levelLoads;
+        _stats.streamedTextureBytes = textureStreamer->stats().residentBytes;
+    }
 
     // TODO glFlush?
 }
 
+const CommandBuffer & Renderer::commands() const
+{
+    return commandBuffer;
+}
+
+const RenderStats & Renderer::stats() const
+{
+    return _stats;
+}
+
 void Renderer::drawHierarchy(vector<DrawCall> &drawCalls,
                          const Component *component,
-                         glm::mat4 cameraMatrix, glm::mat4 modelMatrix,
-                         const Material *inherit)
+                         glm::mat4 cameraMatrix, const Frustum &frustum,
+                         AffineTransform modelT, const Material *inherit)
 {
-    // TODO make this faster, cache values, etc.
     if (component->material)
         inherit = component->material;
-    modelMatrix *= component->tLocal().matrix();
-    if (component->mesh && !component->mesh->render.empty()) {
-        glm::mat3 model3 = modelMatrix;
-        glm::mat3 normalMatrix = glm::transpose(glm::inverse(model3));
+    modelT *= component->tLocal();
+    const Mesh *mesh = component->mesh;
+    BoundingBox bounds;
+    if (mesh && !mesh->render.empty() && !mesh->bounds.empty()) {
+        bounds = mesh->bounds.transformed(modelT);
+        if (!frustum.intersects(bounds)) {
+            _stats.culledComponents++;
+            mesh = nullptr;
+        }
+    }
+    if (mesh && !mesh->render.empty()) {
+        drawBounds.push_back(bounds);
+        glm::mat4 modelMatrix = modelT.matrix();
+        glm::mat3 normalMatrix = modelT.normalMatrix();
         // detect negative scale https://gamedev.stackexchange.com/a/54508
-        // TODO determinant is computed twice
-        bool reversed = glm::determinant(model3) < 0;
+        bool reversed = modelT.determinant() < 0;
+
+        // size on screen of one unit in mesh space, at the nearest point of
+        // the bounding sphere
+        float scale = glm::max(glm::length(modelT.axis(0)), glm::max(
+            glm::length(modelT.axis(1)), glm::length(modelT.axis(2))));
+        glm::vec3 center = modelT.transformPoint(
+            (mesh->bounds.min + mesh->bounds.max) * 0.5f);
+        float radius = glm::distance(mesh->bounds.min, mesh->bounds.max)
+            * 0.5f * scale;
+        float distance = glm::max(
+            glm::distance(center, cameraPos) - radius, nearClip);
+        float pixelsPerMeshUnit = pixelsPerUnit * scale / distance;
+
+        for (auto &primitive : mesh->render) {
+            int firstIndex = 0, numIndices = primitive.numIndices;
+            for (auto &lod : primitive.lods) {
+                if (lod.error * pixelsPerMeshUnit > LOD_PIXEL_ERROR)
+                    break;
+                firstIndex = lod.firstIndex;
+                numIndices = lod.numIndices;
+            }
 
-        for (auto &primitive : component->mesh->render) {
             const Material *material = primitive.material;
             DrawCall call {
                 0,
                 &primitive,
+                firstIndex,
+                numIndices,
                 material ? material : inherit,
                 modelMatrix,
                 normalMatrix,
                 reversed,
 // https://extensions.sketchup.com/developers/sketchup_c_api/sketchup/struct_s_u_texture_ref.html#ac9341c5de53bcc1a89e51de463bd54a0
-                !material
+                !material,
+                (uint32_t)drawBounds.size() - 1
             };
             computeSortKey(&call, cameraMatrix);
+            requestTextureLevel(call, pixelsPerMeshUnit);
             drawCalls.push_back(call);
         }
     }
     for (auto &child : component->children()) {
-        drawHierarchy(drawCalls, child, cameraMatrix, modelMatrix, inherit);
+        drawHierarchy(drawCalls, child, cameraMatrix, frustum, modelT,
+                      inherit);
     }
 }
 
+void Renderer::cullOccluded(vector<DrawCall> &drawCalls,
+                            glm::mat4 cameraMatrix)
+{
+    PROFILE_ZONE("Renderer::cullOccluded");
+    occluders.clear();
+    for (auto &call : drawCalls) {
+        if (call.material->order != RenderOrder::Opaque
+                || call.primitive->occluders.empty())
+            continue;
+        const BoundingBox &box = drawBounds[call.bounds];
+        float distance = glm::distance(
+            glm::clamp(cameraPos, box.min, box.max), cameraPos);
+        occluders.emplace_back(distance, &call);
+    }
+    std::sort(occluders.begin(), occluders.end(),
+        [](const std::pair<float, const DrawCall *> &a,
+           const std::pair<float, const DrawCall *> &b) {
+            return a.first < b.first;
+        });
+
+    occlusionBuffer.begin(cameraMatrix, nearClip);
+    for (auto &occluder : occluders) {
+        if (_stats.occluderTriangles >= MAX_OCCLUDER_TRIANGLES)
+            break;
+        const DrawCall *call = occluder.second;
+        const vector<glm::vec3> &vertices = call->primitive->occluders;
+        occlusionBuffer.addOccluder(call->modelMatrix, vertices.data(),
+                                    vertices.size(), call->reversed);
+        _stats.occluderTriangles += vertices.size() / 3;
+    }
+    occlusionBuffer.buildHierarchy();
+
+    boundsVisible.resize(drawBounds.size());
+    for (size_t i = 0; i < drawBounds.size(); i++) {
+        // unknown bounds are always drawn
+        boundsVisible[i] = drawBounds[i].empty()
+            || occlusionBuffer.visible(drawBounds[i]);
+        if (!boundsVisible[i])
+            _stats.occludedComponents++;
+    }
+    drawCalls.erase(std::remove_if(drawCalls.begin(), drawCalls.end(),
+        [&](const DrawCall &call) { return !boundsVisible[call.bounds]; }),
+        drawCalls.end());
+}
+
 void Renderer::computeSortKey(DrawCall *call, glm::mat4 cameraMatrix) {
     call->sortKey = 0;
     // 30 - 31: render order
@@ -152,25 +262,51 @@ void Renderer::computeSortKey(DrawCall *call, glm::mat4 cameraMatrix) {
     }
     // 9 - 13: shader
     call->sortKey |= (call->material->shader->glProgram & 0x1F) << 9;
-    // 0 - 8: material
+    // 4 - 8: texture array
+    call->sortKey |= (call->material->texture->glTexture & 0x1F) << 4;
+    // 0 - 3: material
     // https://stackoverflow.com/q/20953390
     static const size_t shift = (size_t)log2(1 + sizeof(Material));
     size_t matPtr = (size_t)call->material;
-    call->sortKey |= ((matPtr >> shift) ^ (matPtr >> (shift + 9))) & 0x1FF;
+    call->sortKey |= ((matPtr >> shift) ^ (matPtr >> (shift + 4))) & 0xF;
+}
+
+void Renderer::requestTextureLevel(const DrawCall &call,
+                                   float pixelsPerMeshUnit)
+{
+    const TextureArray *array = call.material->texture->array;
+    if (!textureStreamer || !array || array->streamIndex < 0)
+        return;
+    int level = 0;  // full detail if the density is unknown
+    if (call.primitive->textureDensity > 0) {
+        glm::vec2 scale = call.textureScale ? call.material->scale
+            : glm::vec2(1, 1);
+        float texelsPerMeshUnit = call.primitive->textureDensity
+            * glm::max(scale.x, scale.y)
+            * glm::max(array->width, array->height);
+        float texelsPerPixel = texelsPerMeshUnit / pixelsPerMeshUnit;
+        if (texelsPerPixel > 1)
+            level = (int)std::log2(texelsPerPixel);
+    }
+    textureStreamer->request(*array, level);
 }
 
 void Renderer::renderDrawCalls(const vector<DrawCall> &drawCalls)
 {
+    PROFILE_ZONE("Renderer::renderDrawCalls");
     const Material *curMaterial = nullptr;
     const ShaderProgram *curShader = nullptr;
+    GLTexture curTexture = 0;
+    GLVertexArray curVertexArray = 0;
 
-    // TODO is it actually necessary to avoid gl state changes?
+    // only changes are recorded here, redundant values are also skipped by
+    // the backend's StateCache
     RenderOrder curOrder = RenderOrder::Opaque;
     bool curReversed = false;
     // init gl state
-    glCullFace(GL_BACK);
-    glDisable(GL_BLEND);
-    glDepthMask(GL_TRUE);
+    commandBuffer.setCullFace(false);
+    commandBuffer.setRenderOrder(RenderOrder::Opaque);
+    commandBuffer.beginPass(PASS_OPAQUE);
 
     for (auto &call : drawCalls) {
         if (call.material != curMaterial) {
@@ -178,84 +314,127 @@ void Renderer::renderDrawCalls(const vector<DrawCall> &drawCalls)
 
             if (curMaterial->shader != curShader) {
                 curShader = call.material->shader;
-                glUseProgram(curShader->glProgram);
+                commandBuffer.useProgram(curShader->glProgram);
+                _stats.programChanges++;
             }
 
-            setTexture(Material::TEXTURE_BASE, curMaterial->texture->glTexture);
-            glm::vec4 color = curMaterial->color;
-            glUniform4fv(curShader->baseColorLoc, 1, glm::value_ptr(color));
+            // materials in the same texture array only change the layer
+            if (curMaterial->texture->glTexture != curTexture) {
+                curTexture = curMaterial->texture->glTexture;
+                setTexture(Material::TEXTURE_BASE, curTexture);
+                _stats.textureChanges++;
+            }
+            if (curShader->textureLayerLoc != -1) {
+                commandBuffer.setUniform(curShader->textureLayerLoc,
+                                         curMaterial->texture->layer);
+            }
+            commandBuffer.setUniform(curShader->baseColorLoc,
+                                     curMaterial->color);
 
             if (curMaterial->order != curOrder) {
+                // calls are sorted by order, so each pass only starts once
+                commandBuffer.endPass(passForOrder(curOrder));
                 curOrder = curMaterial->order;
-                switch (curOrder) {
-                case RenderOrder::Transparent:
-                    glEnable(GL_BLEND);
-                    glDepthMask(GL_FALSE);
-                    break;
-                case RenderOrder::Opaque:
-                    glDisable(GL_BLEND);
-                    glDepthMask(GL_TRUE);
-                    break;
-                }
+                commandBuffer.beginPass(passForOrder(curOrder));
+                commandBuffer.setRenderOrder(curOrder);
             }
         }
 
         if (call.reversed != curReversed) {
             curReversed = call.reversed;
-            glCullFace(curReversed ? GL_FRONT : GL_BACK);
+            commandBuffer.setCullFace(curReversed);
+            _stats.cullFaceChanges++;
         }
 
         // set uniforms
         setTransform(curShader, call.modelMatrix, call.normalMatrix);
         glm::vec2 scale = call.textureScale ? curMaterial->scale
             : glm::vec2(1, 1);
-        // TODO reduce calls? only necessary when texture is set
-        glUniform2fv(curShader->textureScaleLoc, 1, glm::value_ptr(scale));
+        commandBuffer.setUniform(curShader->textureScaleLoc, scale);
 
-        glBindVertexArray(call.primitive->vertexArray);
-        glDrawElements(GL_TRIANGLES, call.primitive->numIndices,
-                       GL_UNSIGNED_SHORT, (void *)0);
+        commandBuffer.bindVertexArray(call.primitive->vertexArray);
+        commandBuffer.drawElements(call.numIndices, call.firstIndex);
+        if (call.primitive->vertexArray != curVertexArray) {
+            curVertexArray = call.primitive->vertexArray;
+            _stats.vertexArrayChanges++;
+        }
+        _stats.drawCalls++;
+        _stats.triangles += call.numIndices / 3;
+        if (call.firstIndex != 0)
+            _stats.lodDrawCalls++;
     }
 
+    commandBuffer.endPass(passForOrder(curOrder));
+
     // reset gl state
-    glCullFace(GL_BACK);
-    glDisable(GL_BLEND);
-    glDepthMask(GL_TRUE);
-    glUseProgram(0);
-    glBindVertexArray(0);
+    commandBuffer.setCullFace(false);
+    commandBuffer.setRenderOrder(RenderOrder::Opaque);
+    commandBuffer.useProgram(0);
+    commandBuffer.bindVertexArray(0);
+}
+
+void Renderer::renderDebugLines()
+{
+    if (debugLines.empty() && overlayLines.empty())
+        return;
+    commandBuffer.beginPass(PASS_DEBUG);
+    commandBuffer.useProgram(debugShader->glProgram);
+    setTransform(debugShader, glm::mat4(1), glm::mat3(1));
+
+    drawLines(debugLines);
+    if (!overlayLines.empty()) {
+        glm::mat4 pixelProjection = glm::ortho(0.0f, (float)windowWidth,
+            (float)windowHeight, 0.0f, -1.0f, 1.0f);
+        commandBuffer.setCamera(CameraBlock {glm::mat4(1), pixelProjection});
+        commandBuffer.clearDepth();
+        drawLines(overlayLines);
+    }
+
+    commandBuffer.useProgram(0);
+    commandBuffer.bindVertexArray(0);
+    commandBuffer.endPass(PASS_DEBUG);
+}
+
+void Renderer::drawLines(vector<DebugLine> &lines)
+{
+    // lines of the same color are drawn together
+    vector<glm::vec3> vertices;
+    for (size_t i = 0; i < lines.size(); i++) {
+        const DebugLine &line = lines[i];
+        vertices.push_back(line.start);
+        vertices.push_back(line.end);
+        bool last = i + 1 == lines.size();
+        if (last || lines[i + 1].color != line.color) {
+            commandBuffer.setUniform(debugShader->baseColorLoc,
+                                     glm::vec4(line.color, 1));
+            commandBuffer.drawLines(vertices.data(), vertices.size());
+            vertices.clear();
+        }
+    }
+    lines.clear();
 }
 
 void Renderer::setTexture(int unit, GLTexture texture)
 {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    commandBuffer.bindTexture(unit, texture);
 }
 
 void Renderer::setTransform(const ShaderProgram *shader,
                         glm::mat4 modelMatrix, glm::mat3 normalMatrix)
 {
-    glUniformMatrix4fv(shader->modelMatrixLoc, 1, GL_FALSE,
-                       glm::value_ptr(modelMatrix));
-    glUniformMatrix3fv(shader->normalMatrixLoc, 1, GL_FALSE,
-                       glm::value_ptr(normalMatrix));
+    commandBuffer.setUniform(shader->modelMatrixLoc, modelMatrix);
+    commandBuffer.setUniform(shader->normalMatrixLoc, normalMatrix);
 }
 
 void Renderer::debugLine(glm::vec3 start, glm::vec3 end, glm::vec3 color)
 {
-    glm::vec3 data[] {start, end};
-    glBindVertexArray(debugVertexArray);
-    glBindBuffer(GL_ARRAY_BUFFER, debugVertexBuffer);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(data), data);
-
-    glUseProgram(debugShader->glProgram);
-    glm::vec4 color4(color, 1);
-    glUniform4fv(debugShader->baseColorLoc, 1, glm::value_ptr(color4));
-    setTransform(debugShader, glm::mat4(1), glm::mat3(1));
-
-    glDrawArrays(GL_LINES, 0, 2);
+    debugLines.push_back(DebugLine {start, end, color});
+}
 
-    glUseProgram(0);
-    glBindVertexArray(0);
+void Renderer::overlayLine(glm::vec2 start, glm::vec2 end, glm::vec3 color)
+{
+    overlayLines.push_back(DebugLine {
+        glm::vec3(start, 0), glm::vec3(end, 0), color});
 }
 
-}  // namespace
\ No newline at end of file
+}  // namespace
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "common.h"
+#include "commandbuffer.h"
+#include "culling.h"
 #include "glutils.h"
+#include "texstream.h"
 #include "world.h"
 #include <glm/glm.hpp>
 
@@ -13,56 +16,110 @@ struct DrawCall
 {
     uint32_t sortKey;
     const RenderPrimitive *primitive;
+    int firstIndex, numIndices;  // full detail or one of the primitive's lods
     const Material *material;
     glm::mat4 modelMatrix;
     glm::mat3 normalMatrix;
     bool reversed;  // cull front faces instead of back faces
     bool textureScale;  // apply material texture scale
+    uint32_t bounds;  // index in Renderer::drawBounds
 
     bool operator<(const DrawCall &rhs) const;
 };
 
+// counted while recording a frame
+struct RenderStats
+{
+    int drawCalls = 0;
+    int triangles = 0;
+    int lodDrawCalls = 0;  // drawn with a simplified level of detail
+    int occluderTriangles = 0;
+    // state changes
+    int programChanges = 0;
+    int textureChanges = 0;
+    int vertexArrayChanges = 0;
+    int cullFaceChanges = 0;
+    // components with meshes that weren't drawn
+    int culledComponents = 0;  // outside the view frustum
+    int occludedComponents = 0;  // hidden behind occluders
+    // texture streaming, after the frame
+    int textureLevelLoads = 0;
+    size_t streamedTextureBytes = 0;  // resident
+};
+
 class Renderer
 {
 public:
-    Renderer(const ShaderManager *shaders);
+    Renderer(const ShaderManager *shaders, RenderBackend *backend);
 
     void initGL();
 
     void setCameraParameters(float fov, float nearClip, float farClip);
     void resizeWindow(int w, int h);
+    void setOcclusionCulling(bool enabled);
+    // requests texture levels while drawing and updates the streamer after
+    // each frame. null to disable
+    void setTextureStreamer(TextureStreamer *streamer);
     void render(const World *world, const Transform &camTransform);
 
+    // drawn on top of the next frame
     void debugLine(glm::vec3 start, glm::vec3 end, glm::vec3 color);
+    // in pixels from the top left of the window, drawn over everything
+    void overlayLine(glm::vec2 start, glm::vec2 end, glm::vec3 color);
+
+    // commands recorded by the last call to render()
+    const CommandBuffer & commands() const;
+    const RenderStats & stats() const;
 
 private:
     void updateProjectionMatrix();
 
     void drawHierarchy(vector<DrawCall> &drawCalls, const Component *component,
-                       glm::mat4 cameraMatrix, glm::mat4 modelMatrix,
-                       const Material *inherit);
+                       glm::mat4 cameraMatrix, const Frustum &frustum,
+                       AffineTransform modelT, const Material *inherit);
+    // removes draw calls of components hidden behind the nearest occluders
+    void cullOccluded(vector<DrawCall> &drawCalls, glm::mat4 cameraMatrix);
     void computeSortKey(DrawCall *call, glm::mat4 cameraMatrix);
+    void requestTextureLevel(const DrawCall &call, float pixelsPerMeshUnit);
     void renderDrawCalls(const vector<DrawCall> &drawCalls);
+    void renderDebugLines();
 
     void setTexture(int unit, GLTexture texture);
     void setTransform(const ShaderProgram *shader,
                       glm::mat4 modelMatrix, glm::mat3 normalMatrix);
 
+    struct DebugLine
+    {
+        glm::vec3 start, end;
+        glm::vec3 color;
+    };
+    void drawLines(vector<DebugLine> &lines);  // also clears lines
+
     Material defaultMaterial;
     const ShaderProgram *debugShader;
+    RenderBackend *backend;
 
     int windowWidth = 1, windowHeight = 1;
     float cameraFOV = glm::radians(60.0f);
     float nearClip = 5;
     float farClip = 10000;
     glm::mat4 projectionMatrix {1};
-
-    vector<DrawCall> drawCalls;  // avoid reconstructing vector each frame
-
-    GLBuffer cameraUBO;  // shared between all programs
-
-    GLVertexArray debugVertexArray;
-    GLBuffer debugVertexBuffer;
+    // pixels covered by one unit at a distance of one unit, for choosing lods
+    float pixelsPerUnit = 1;
+    glm::vec3 cameraPos {0};
+    bool occlusionCulling = true;
+    TextureStreamer *textureStreamer = nullptr;
+
+    // avoid reconstructing vectors each frame
+    vector<DrawCall> drawCalls;
+    vector<BoundingBox> drawBounds;  // world space, of each drawn component
+    vector<std::pair<float, const DrawCall *>> occluders;
+    vector<bool> boundsVisible;
+    OcclusionBuffer occlusionBuffer;
+    vector<DebugLine> debugLines;
+    vector<DebugLine> overlayLines;
+    CommandBuffer commandBuffer;
+    RenderStats _stats;
 };
 
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "replay.h"
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+namespace diorama {
+
+const char *REPLAY_HEADER = "diorama-replay";
+const int REPLAY_VERSION = 1;
+
+void InputRecording::save(string path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Couldn't write replay file");
+    // round-trip floats exactly
+    file << std::setprecision(std::numeric_limits<float>::max_digits10);
+    file <<REPLAY_HEADER<< " " <<REPLAY_VERSION<< " " <<timestep<< "\n";
+    for (auto &frame : frames) {
+        file <<frame.camYaw<< " " <<frame.camPitch<< " "
+            <<frame.fly.x<< " " <<frame.fly.y<< " " <<frame.fly.z<< " "
+            <<frame.flySpeed<< " "
+            <<frame.camPos.x<< " " <<frame.camPos.y<< " " <<frame.camPos.z
+            << "\n";
+    }
+    cout << "Saved " <<frames.size()<< " frames to " <<path<< "\n";
+}
+
+void InputRecording::load(string path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Couldn't open replay file");
+    string header;
+    int version;
+    file >> header >> version >> timestep;
+    if (header != REPLAY_HEADER || version != REPLAY_VERSION)
+        throw std::runtime_error("Not a replay file");
+
+    frames.clear();
+    InputFrame frame;
+    while (file >> frame.camYaw >> frame.camPitch
+            >> frame.fly.x >> frame.fly.y >> frame.fly.z
+            >> frame.flySpeed
+            >> frame.camPos.x >> frame.camPos.y >> frame.camPos.z) {
+        frames.push_back(frame);
+    }
+    cout << "Loaded " <<frames.size()<< " frames from " <<path<< "\n";
+}
+
+}  // namespace
@@ -0,0 +1,29 @@
+#pragma once
+#include "common.h"
+
+#include <glm/glm.hpp>
+
+namespace diorama {
+
+// player input and resulting camera state for one simulation step
+struct InputFrame
+{
+    float camYaw = 0, camPitch = 0;
+    glm::vec3 fly {0, 0, 0};  // unnormalized movement direction
+    float flySpeed = 0;
+    glm::vec3 camPos {0, 0, 0};  // after the step, to detect divergence
+};
+
+// A recorded fly-through, replayed with the same fixed timestep so runs can
+// be compared across builds and machines.
+class InputRecording
+{
+public:
+    float timestep = 1 / 60.0f;
+    vector<InputFrame> frames;
+
+    void save(string path) const;
+    void load(string path);
+};
+
+}  // namespace
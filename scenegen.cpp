@@ -0,0 +1,191 @@
+#include "scenegen.h"
+#include "culling.h"
+#include "simplify.h"
+#include <cmath>
+#include <random>
+
+namespace diorama {
+
+// largest grid of cells whose vertices can be indexed by MeshIndex
+const int MAX_CELLS = 255;
+
+struct LeafGroup
+{
+    Component *group;
+    Transform invWorld;  // to place instances in world space
+};
+
+static int meshCells(int numTriangles)
+{
+    int cells = (int)std::ceil(std::sqrt(numTriangles / 2.0f));
+    return glm::clamp(cells, 1, MAX_CELLS);
+}
+
+int SceneParams::groups() const
+{
+    int count = 0, level = 1;
+    for (int i = 0; i < depth; i++) {
+        level *= branching;
+        count += level;
+    }
+    return count;
+}
+
+int SceneParams::components() const
+{
+    return 1 + groups() + instances;
+}
+
+int SceneParams::triangles() const
+{
+    int cells = meshCells(trianglesPerMesh);
+    return glm::min(trianglesPerMesh, cells * cells * 2) * instances;
+}
+
+float sceneExtent(const SceneParams &params)
+{
+    return std::ceil(std::sqrt((float)params.instances)) * params.spacing;
+}
+
+static Mesh * generateMesh(World *world, int numTriangles, float size,
+                           std::mt19937 &rng)
+{
+    int cells = meshCells(numTriangles);
+    numTriangles = glm::min(numTriangles, cells * cells * 2);
+    std::uniform_real_distribution<float> height(0, size * 0.1f);
+
+    CollisionPrimitive primitive;
+    for (int y = 0; y <= cells; y++) {
+        for (int x = 0; x <= cells; x++) {
+            primitive.vertices.push_back(glm::vec3(
+                (float)x / cells * size, (float)y / cells * size, height(rng)));
+        }
+    }
+    for (int y = 0; y < cells; y++) {
+        for (int x = 0; x < cells; x++) {
+            MeshIndex i00 = y * (cells + 1) + x;
+            MeshIndex i10 = i00 + 1;
+            MeshIndex i01 = i00 + (cells + 1);
+            MeshIndex i11 = i01 + 1;
+            // counter-clockwise from above
+            primitive.indices.insert(primitive.indices.end(),
+                {i00, i10, i11, i00, i11, i01});
+        }
+    }
+    primitive.indices.resize(numTriangles * 3);
+    primitive.computeBounds();
+
+    // lods and geometry (for static batching) are computed but never
+    // uploaded, since there are no GL objects
+    vector<glm::vec3> normals(primitive.vertices.size(), glm::vec3(0, 0, 1));
+    vector<glm::vec3> stqCoords;
+    for (auto &vertex : primitive.vertices)
+        stqCoords.push_back(glm::vec3(vertex.x / size, vertex.y / size, 1));
+    vector<MeshIndex> renderIndices = primitive.indices;
+
+    Mesh *mesh = world->createResource<Mesh>();
+    mesh->bounds = primitive.bounds;
+    mesh->render.emplace_back();
+    mesh->render.back().numIndices = primitive.indices.size();
+    mesh->render.back().occluders = render::selectOccluders(
+        primitive.vertices, primitive.indices);
+    mesh->render.back().lods = buildLods(
+        primitive.vertices, normals, stqCoords, renderIndices);
+    mesh->render.back().geometry = std::make_unique<RenderGeometry>(
+        RenderGeometry {primitive.vertices, normals, stqCoords,
+                        primitive.indices});
+    mesh->collision.push_back(std::move(primitive));
+    return mesh;
+}
+
+static void generateGroups(World *world, Component *parent, Transform worldT,
+                           int levels, const SceneParams &params,
+                           std::mt19937 &rng, vector<LeafGroup> &leaves,
+                           int *numGroups)
+{
+    if (levels == 0) {
+        leaves.push_back(LeafGroup {parent, worldT.inverse()});
+        return;
+    }
+    // groups are offset so transforms accumulate like in a real hierarchy
+    std::uniform_real_distribution<float> offset(
+        -params.spacing, params.spacing);
+    for (int i = 0; i < params.branching; i++) {
+        Component *group = world->createComponent();
+        group->name = "group" + std::to_string((*numGroups)++);
+        group->tLocalMut() = Transform::translate(
+            glm::vec3(offset(rng), offset(rng), offset(rng)));
+        group->setParent(parent);
+        generateGroups(world, group, worldT * group->tLocal(), levels - 1,
+                       params, rng, leaves, numGroups);
+    }
+}
+
+void generateScene(World *world, const SceneParams &params,
+                   const ShaderManager *shaders)
+{
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<float> unit(0, 1);
+
+    vector<const Mesh *> meshes;
+    for (int i = 0; i < glm::max(params.meshes, 1); i++) {
+        Mesh *mesh = generateMesh(world, params.trianglesPerMesh,
+                                  params.spacing * 0.8f, rng);
+        meshes.push_back(mesh);
+    }
+
+    vector<const Material *> materials;
+    if (shaders) {
+        int numTransparent = (int)std::round(
+            params.materials * params.transparentRatio);
+        for (int i = 0; i < params.materials; i++) {
+            Material *material = world->createResource<Material>();
+            material->shader = &shaders->coloredProg;
+            material->texture = &Texture::NO_TEXTURE;
+            material->color = glm::vec4(unit(rng), unit(rng), unit(rng), 1);
+            if (i < numTransparent) {
+                material->order = RenderOrder::Transparent;
+                material->color.w = 0.5f;
+            }
+            materials.push_back(material);
+        }
+    }
+
+    Component *root = world->createComponent();
+    root->name = "root";
+    vector<LeafGroup> leaves;
+    int numGroups = 0;
+    generateGroups(world, root, Transform(), params.depth, params, rng, leaves,
+                   &numGroups);
+    if (leaves.empty())  // no branches
+        leaves.push_back(LeafGroup {root, Transform()});
+
+    int gridSize = (int)std::ceil(std::sqrt((float)params.instances));
+    std::uniform_int_distribution<size_t> materialIndex(
+        0, materials.empty() ? 0 : materials.size() - 1);
+    for (int i = 0; i < params.instances; i++) {
+        // neighboring instances share groups
+        const LeafGroup &leaf = leaves[(size_t)i * leaves.size()
+                                       / params.instances];
+        Component *component = world->createComponent();
+        component->name = "patch" + std::to_string(i);
+        component->mesh = meshes[i % meshes.size()];
+        if (!materials.empty())
+            component->material = materials[materialIndex(rng)];
+        // spread out evenly, without using the rng
+        component->dynamic = (int)((i + 1) * params.dynamicRatio)
+            > (int)(i * params.dynamicRatio);
+
+        glm::vec3 pos(i % gridSize, i / gridSize, 0);
+        // rotate around the center of the patch
+        glm::vec3 half(params.spacing * 0.4f, params.spacing * 0.4f, 0);
+        component->tLocalMut() = leaf.invWorld
+            * Transform::translate(pos * params.spacing + half)
+            * Transform::rotate(unit(rng) * glm::radians(360.0f), Transform::UP)
+            * Transform::translate(-half);
+        component->setParent(leaf.group);
+    }
+    world->setRoot(root);
+}
+
+}  // namespace
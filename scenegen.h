@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+
+#include "material.h"
+#include "world.h"
+
+namespace diorama {
+
+// Parameters for a synthetic scene, used to measure how systems scale
+// without needing real maps.
+struct SceneParams
+{
+    int instances = 1000;  // mesh components, laid out in a grid
+    int trianglesPerMesh = 128;  // limited by MeshIndex
+    int meshes = 16;  // distinct meshes shared between instances
+    // instances are grouped under depth levels of groups, each with
+    // branching children. 0 puts instances directly under the root
+    int depth = 2;
+    int branching = 8;
+    int materials = 8;  // 0 uses the default material
+    float transparentRatio = 0.1f;  // fraction of materials that are
+    float dynamicRatio = 0.05f;  // fraction of instances that move
+    float spacing = 200;  // distance between instances in the grid
+    unsigned int seed = 1;
+
+    int groups() const;  // not counting the root
+    int components() const;  // including the root
+    int triangles() const;
+};
+
+// Builds a grid of bumpy patches facing up. Meshes have collision geometry and
+// render primitives with index counts, lods and geometry but no GL objects, so
+// the scene can be created without a GL context (but not drawn with
+// GLBackend).
+// shaders is needed for materials, and must outlive the world.
+void generateScene(World *world, const SceneParams &params,
+                   const ShaderManager *shaders = nullptr);
+
+// width of the grid in both directions, starting at the origin
+float sceneExtent(const SceneParams &params);
+
+}  // namespace
@@ -58,7 +58,8 @@ in vec3 vSTQ;
 
 out vec4 fColor;
 
-uniform sampler2D BaseTexture;
+uniform sampler2DArray BaseTexture;
+uniform int TextureLayer;
 uniform vec4 BaseColor;
 
 #if defined(COLORIZE_SHIFT) || defined(COLORIZE_TINT)
@@ -201,7 +202,7 @@ void main(void)
 #ifdef BASE_TEXTURE
     // perspective warping with homogeneous coordinates
     vec2 uv = vSTQ.st / vSTQ.p;
-    color *= texture(BaseTexture, uv);
+    color *= texture(BaseTexture, vec3(uv, TextureLayer));
 #endif
 #ifdef CUTOUT
     if (color.a < 0.5)
@@ -0,0 +1,368 @@
+#include "simplify.h"
+#include "profiler.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <queue>
+#include <tuple>
+#include <glm/gtx/norm.hpp>
+
+namespace diorama {
+
+// constraint planes along borders and seams (where normals or texture
+// coordinates are discontinuous) are weighted so outlines are kept longer
+const double BORDER_WEIGHT = 4;
+// a level must remove at least this fraction of the previous level's triangles
+const float MIN_LEVEL_REDUCTION = 0.2f;
+
+using Triangle = array<uint32_t, 3>;  // render vertices
+
+// sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric
+{
+    array<double, 10> q {};
+
+    // normal must be normalized
+    static Quadric plane(glm::dvec3 n, double d, double weight);
+    Quadric & operator+=(const Quadric &rhs);
+    double error(glm::vec3 p) const;
+};
+
+Quadric Quadric::plane(glm::dvec3 n, double d, double weight)
+{
+    Quadric quadric;
+    quadric.q = {
+        n.x * n.x, n.x * n.y, n.x * n.z, n.x * d,
+        n.y * n.y, n.y * n.z, n.y * d,
+        n.z * n.z, n.z * d,
+        d * d};
+    for (double &value : quadric.q)
+        value *= weight;
+    return quadric;
+}
+
+Quadric & Quadric::operator+=(const Quadric &rhs)
+{
+    for (int i = 0; i < q.size(); i++)
+        q[i] += rhs.q[i];
+    return *this;
+}
+
+double Quadric::error(glm::vec3 p) const
+{
+    double x = p.x, y = p.y, z = p.z;
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+        + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+        + q[7] * z * z + 2 * q[8] * z
+        + q[9];
+}
+
+// Render vertices at the same position are grouped into a "corner", which is
+// what gets collapsed. Each render vertex of the collapsed corner is replaced
+// with the closest matching render vertex of the corner it moves to.
+struct Simplifier
+{
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;  // corners
+        uint32_t fromVersion, toVersion;
+
+        // lowest cost first in a priority_queue
+        bool operator<(const Collapse &rhs) const { return cost > rhs.cost; }
+    };
+
+    Simplifier(const vector<glm::vec3> &positions,
+               const vector<glm::vec3> &normals,
+               const vector<glm::vec3> &stqCoords,
+               const vector<MeshIndex> &indices);
+
+    void simplify(int targetTriangles);
+
+    const vector<glm::vec3> &normals, &stqCoords;  // per render vertex
+    vector<uint32_t> cornerOf;  // per render vertex
+    // per corner
+    vector<glm::vec3> positions;
+    vector<vector<uint32_t>> cornerVertices;
+    vector<vector<uint32_t>> cornerTriangles;  // may include dead triangles
+    vector<Quadric> quadrics;
+    vector<uint32_t> versions;  // changes invalidate queued collapses
+    vector<bool> removed;
+
+    vector<Triangle> triangles;
+    vector<bool> alive;  // for each triangle
+    int aliveTriangles = 0;
+    double maxCost = 0;  // of collapses so far
+    std::priority_queue<Collapse> queue;
+
+private:
+    glm::vec3 normal(const Triangle &tri) const;
+    bool hasCorner(const Triangle &tri, uint32_t corner) const;
+    bool sameAttributes(uint32_t a, uint32_t b) const;
+    uint32_t matchVertex(uint32_t vertex, uint32_t corner) const;
+    void addConstraints();
+    // alive triangles only, and the other corners they use
+    vector<uint32_t> neighbors(uint32_t corner);
+    void push(uint32_t from, uint32_t to);
+    bool tryCollapse(const Collapse &collapse);
+};
+
+Simplifier::Simplifier(const vector<glm::vec3> &positions,
+                       const vector<glm::vec3> &normals,
+                       const vector<glm::vec3> &stqCoords,
+                       const vector<MeshIndex> &indices)
+    : normals(normals)
+    , stqCoords(stqCoords)
+{
+    std::map<std::tuple<float, float, float>, uint32_t> corners;
+    for (uint32_t v = 0; v < positions.size(); v++) {
+        const glm::vec3 &p = positions[v];
+        auto it = corners.find(std::make_tuple(p.x, p.y, p.z));
+        if (it == corners.end()) {
+            it = corners.emplace(std::make_tuple(p.x, p.y, p.z),
+                                 (uint32_t)this->positions.size()).first;
+            this->positions.push_back(p);
+        }
+        cornerOf.push_back(it->second);
+    }
+    size_t numCorners = this->positions.size();
+    cornerVertices.resize(numCorners);
+    for (uint32_t v = 0; v < positions.size(); v++)
+        cornerVertices[cornerOf[v]].push_back(v);
+    cornerTriangles.resize(numCorners);
+    quadrics.resize(numCorners);
+    versions.assign(numCorners, 0);
+    removed.assign(numCorners, false);
+
+    for (int i = 0; i + 2 < indices.size(); i += 3) {
+        Triangle tri {indices[i], indices[i + 1], indices[i + 2]};
+        uint32_t a = cornerOf[tri[0]], b = cornerOf[tri[1]];
+        uint32_t c = cornerOf[tri[2]];
+        glm::vec3 n = normal(tri);
+        if (a == b || b == c || c == a || n == glm::vec3(0))
+            continue;  // degenerate, dropped from every level
+        uint32_t index = triangles.size();
+        triangles.push_back(tri);
+        glm::dvec3 unit = glm::normalize(glm::dvec3(n));
+        Quadric plane = Quadric::plane(
+            unit, -glm::dot(unit, glm::dvec3(positions[tri[0]])), 1);
+        for (uint32_t corner : {a, b, c}) {
+            cornerTriangles[corner].push_back(index);
+            quadrics[corner] += plane;
+        }
+    }
+    alive.assign(triangles.size(), true);
+    aliveTriangles = triangles.size();
+    addConstraints();
+
+    for (uint32_t corner = 0; corner < numCorners; corner++) {
+        for (uint32_t other : neighbors(corner))
+            push(corner, other);
+    }
+}
+
+glm::vec3 Simplifier::normal(const Triangle &tri) const
+{
+    glm::vec3 a = positions[cornerOf[tri[0]]];
+    return glm::cross(positions[cornerOf[tri[1]]] - a,
+                      positions[cornerOf[tri[2]]] - a);
+}
+
+bool Simplifier::hasCorner(const Triangle &tri, uint32_t corner) const
+{
+    return cornerOf[tri[0]] == corner || cornerOf[tri[1]] == corner
+        || cornerOf[tri[2]] == corner;
+}
+
+bool Simplifier::sameAttributes(uint32_t a, uint32_t b) const
+{
+    return normals[a] == normals[b] && stqCoords[a] == stqCoords[b];
+}
+
+uint32_t Simplifier::matchVertex(uint32_t vertex, uint32_t corner) const
+{
+    uint32_t best = cornerVertices[corner][0];
+    float bestDiff = std::numeric_limits<float>::max();
+    for (uint32_t other : cornerVertices[corner]) {
+        float diff = glm::distance2(normals[vertex], normals[other])
+            + glm::distance2(stqCoords[vertex], stqCoords[other]);
+        if (diff < bestDiff) {
+            best = other;
+            bestDiff = diff;
+        }
+    }
+    return best;
+}
+
+// planes perpendicular to the surface through border and seam edges, so
+// moving a corner off the edge costs something even if it stays on the surface
+void Simplifier::addConstraints()
+{
+    struct Edge
+    {
+        uint32_t triangle;  // first triangle using the edge
+        int count;
+        bool seam;
+    };
+    std::map<std::pair<uint32_t, uint32_t>, Edge> edges;
+    for (uint32_t t = 0; t < triangles.size(); t++) {
+        const Triangle &tri = triangles[t];
+        for (int i = 0; i < 3; i++) {
+            uint32_t va = tri[i], vb = tri[(i + 1) % 3];
+            std::pair<uint32_t, uint32_t> key =
+                std::minmax(cornerOf[va], cornerOf[vb]);
+            auto it = edges.find(key);
+            if (it == edges.end()) {
+                edges.emplace(key, Edge {t, 1, false});
+                continue;
+            }
+            it->second.count++;
+            // compare the vertices this triangle uses at each end
+            for (uint32_t v : triangles[it->second.triangle]) {
+                uint32_t corner = cornerOf[v];
+                if (corner == cornerOf[va] && !sameAttributes(v, va))
+                    it->second.seam = true;
+                if (corner == cornerOf[vb] && !sameAttributes(v, vb))
+                    it->second.seam = true;
+            }
+        }
+    }
+
+    for (auto &pair : edges) {
+        const Edge &edge = pair.second;
+        if (edge.count == 2 && !edge.seam)
+            continue;
+        uint32_t a = pair.first.first, b = pair.first.second;
+        glm::dvec3 along = glm::dvec3(positions[b] - positions[a]);
+        glm::dvec3 across = glm::cross(along,
+            glm::dvec3(normal(triangles[edge.triangle])));
+        if (across == glm::dvec3(0))
+            continue;
+        across = glm::normalize(across);
+        Quadric plane = Quadric::plane(
+            across, -glm::dot(across, glm::dvec3(positions[a])),
+            BORDER_WEIGHT);
+        quadrics[a] += plane;
+        quadrics[b] += plane;
+    }
+}
+
+vector<uint32_t> Simplifier::neighbors(uint32_t corner)
+{
+    auto &around = cornerTriangles[corner];
+    around.erase(std::remove_if(around.begin(), around.end(),
+        [&](uint32_t t) { return !alive[t]; }), around.end());
+    vector<uint32_t> result;
+    for (uint32_t t : around) {
+        for (uint32_t v : triangles[t]) {
+            uint32_t other = cornerOf[v];
+            if (other != corner && std::find(result.begin(), result.end(),
+                                             other) == result.end())
+                result.push_back(other);
+        }
+    }
+    return result;
+}
+
+void Simplifier::push(uint32_t from, uint32_t to)
+{
+    Quadric sum = quadrics[from];
+    sum += quadrics[to];
+    queue.push(Collapse {
+        std::max(sum.error(positions[to]), 0.0), from, to,
+        versions[from], versions[to]});
+}
+
+bool Simplifier::tryCollapse(const Collapse &collapse)
+{
+    uint32_t from = collapse.from, to = collapse.to;
+    if (removed[from] || removed[to] || versions[from] != collapse.fromVersion
+            || versions[to] != collapse.toVersion)
+        return false;  // out of date
+    vector<uint32_t> around = neighbors(from);
+    if (std::find(around.begin(), around.end(), to) == around.end())
+        return false;
+
+    // moving the corner must not flip or flatten any remaining triangle
+    glm::vec3 fromPos = positions[from];
+    for (uint32_t t : cornerTriangles[from]) {
+        if (hasCorner(triangles[t], to))
+            continue;  // removed
+        glm::vec3 before = normal(triangles[t]);
+        positions[from] = positions[to];
+        glm::vec3 after = normal(triangles[t]);
+        positions[from] = fromPos;
+        if (glm::dot(before, after) <= 0)
+            return false;
+    }
+
+    for (uint32_t t : cornerTriangles[from]) {
+        Triangle &tri = triangles[t];
+        if (hasCorner(tri, to)) {
+            alive[t] = false;
+            aliveTriangles--;
+            continue;
+        }
+        for (uint32_t &v : tri) {
+            if (cornerOf[v] == from)
+                v = matchVertex(v, to);
+        }
+        cornerTriangles[to].push_back(t);
+    }
+    cornerTriangles[from].clear();
+    cornerVertices[from].clear();
+    quadrics[to] += quadrics[from];
+    removed[from] = true;
+    versions[to]++;
+    maxCost = std::max(maxCost, collapse.cost);
+
+    for (uint32_t other : neighbors(to)) {
+        push(to, other);
+        push(other, to);
+    }
+    return true;
+}
+
+void Simplifier::simplify(int targetTriangles)
+{
+    while (aliveTriangles > targetTriangles && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        tryCollapse(collapse);
+    }
+}
+
+vector<LevelOfDetail> buildLods(const vector<glm::vec3> &positions,
+                                const vector<glm::vec3> &normals,
+                                const vector<glm::vec3> &stqCoords,
+                                vector<MeshIndex> &indices,
+                                const LodParams &params)
+{
+    vector<LevelOfDetail> lods;
+    int previous = indices.size() / 3;
+    if (previous < params.minTriangles)
+        return lods;
+    PROFILE_ZONE("buildLods");
+
+    Simplifier simplifier(positions, normals, stqCoords, indices);
+    for (int level = 0; level < params.maxLevels; level++) {
+        simplifier.simplify((int)(previous * params.reduction));
+        int remaining = simplifier.aliveTriangles;
+        if (remaining == 0
+                || remaining > previous * (1 - MIN_LEVEL_REDUCTION))
+            break;
+        lods.push_back(LevelOfDetail {
+            (int)indices.size(), remaining * 3,
+            (float)glm::sqrt(simplifier.maxCost)});
+        for (uint32_t t = 0; t < simplifier.triangles.size(); t++) {
+            if (simplifier.alive[t]) {
+                for (uint32_t v : simplifier.triangles[t])
+                    indices.push_back((MeshIndex)v);
+            }
+        }
+        previous = remaining;
+    }
+    return lods;
+}
+
+}  // namespace
@@ -0,0 +1,28 @@
+#pragma once
+#include "common.h"
+
+#include "mesh.h"
+
+namespace diorama {
+
+struct LodParams
+{
+    int maxLevels = 3;  // not counting full detail
+    float reduction = 0.5f;  // fraction of triangles kept by each level
+    // primitives with fewer triangles aren't simplified
+    int minTriangles = 64;
+};
+
+// Builds levels of detail for a render primitive with quadric error
+// simplification (Garland & Heckbert). Vertices are collapsed onto their
+// neighbors, so every level uses the original vertex arrays. Appends the
+// levels to indices after the full detail triangles and returns their ranges,
+// least detailed last. Returns fewer levels (or none) when a level wouldn't
+// remove enough triangles to be worth drawing.
+vector<LevelOfDetail> buildLods(const vector<glm::vec3> &positions,
+                                const vector<glm::vec3> &normals,
+                                const vector<glm::vec3> &stqCoords,
+                                vector<MeshIndex> &indices,
+                                const LodParams &params = LodParams());
+
+}  // namespace
@@ -0,0 +1,341 @@
+#include "spatialhash.h"
+#include "profiler.h"
+#include <algorithm>
+
+namespace diorama::physics {
+
+// triangles covering more cells than this go in a list that's always tested
+const size_t MAX_TRIANGLE_CELLS = 64;
+// queries covering more cells than this test every triangle instead
+const size_t MAX_QUERY_CELLS = 512;
+
+bool SpatialHash::DynamicRef::operator<(const DynamicRef &rhs) const
+{
+    return instance < rhs.instance
+        || (instance == rhs.instance && triangle < rhs.triangle);
+}
+
+bool SpatialHash::DynamicRef::operator==(const DynamicRef &rhs) const
+{
+    return instance == rhs.instance && triangle == rhs.triangle;
+}
+
+SpatialHash::SpatialHash(float cellSize)
+    : _cellSize(cellSize)
+{}
+
+float SpatialHash::cellSize() const
+{
+    return _cellSize;
+}
+
+size_t SpatialHash::numStaticTriangles() const
+{
+    return staticTriangles.size();
+}
+
+glm::ivec3 SpatialHash::cellOf(glm::vec3 point) const
+{
+    return glm::ivec3(glm::floor(point / _cellSize));
+}
+
+uint64_t SpatialHash::cellKey(glm::ivec3 cell)
+{
+    // 21 bits per axis, wraps around far from the origin (which is fine, it
+    // only adds candidates)
+    const uint64_t MASK = 0x1FFFFF;
+    return ((uint64_t)cell.x & MASK) << 42 | ((uint64_t)cell.y & MASK) << 21
+        | ((uint64_t)cell.z & MASK);
+}
+
+size_t SpatialHash::cellsCovered(const BoundingBox &box) const
+{
+    glm::ivec3 size = cellOf(box.max) - cellOf(box.min) + glm::ivec3(1);
+    return (size_t)size.x * size.y * size.z;
+}
+
+void SpatialHash::build(const World *world)
+{
+    PROFILE_ZONE("SpatialHash::build");
+    staticTriangles.clear();
+    staticCells.clear();
+    largeTriangles.clear();
+    dynamicInstances.clear();
+    dynamicCells.clear();
+    worldChanges = world->changeCount();
+    worldGeneration = world->generation();
+    if (!world->root())
+        return;
+
+    addStatic(world->root(), AffineTransform());
+    for (uint32_t i = 0; i < staticTriangles.size(); i++) {
+        const BoundingBox &bounds = staticTriangles[i].bounds;
+        if (cellsCovered(bounds) > MAX_TRIANGLE_CELLS) {
+            largeTriangles.push_back(i);
+            continue;
+        }
+        glm::ivec3 lo = cellOf(bounds.min), hi = cellOf(bounds.max);
+        for (int x = lo.x; x <= hi.x; x++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                for (int z = lo.z; z <= hi.z; z++)
+                    staticCells[cellKey(glm::ivec3(x, y, z))].push_back(i);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < dynamicInstances.size(); i++)
+        insertDynamic(i);
+}
+
+void SpatialHash::addStatic(Component *component, AffineTransform worldT)
+{
+    worldT *= component->tLocal();
+    if (component->dynamic) {
+        dynamicInstances.emplace_back();
+        DynamicInstance &instance = dynamicInstances.back();
+        instance.component = component;
+        collectTriangles(component, worldT, &instance);
+        return;
+    }
+    if (component->mesh)
+        addTriangles(component, worldT, staticTriangles);
+    for (auto &child : component->children())
+        addStatic(child, worldT);
+}
+
+void SpatialHash::addTriangles(Component *component,
+                               const AffineTransform &worldT,
+                               vector<Triangle> &triangles)
+{
+    vector<glm::vec3> vertices;
+    for (auto &primitive : component->mesh->collision) {
+        vertices.resize(primitive.vertices.size());
+        worldT.transformPoints(primitive.vertices.data(), vertices.data(),
+                               vertices.size());
+        for (int i = 0; i < primitive.indices.size(); i += 3) {
+            Triangle tri;
+            tri.a = vertices[primitive.indices[i]];
+            tri.b = vertices[primitive.indices[i + 1]];
+            tri.c = vertices[primitive.indices[i + 2]];
+            if (glm::cross(tri.b - tri.a, tri.c - tri.a) == glm::vec3(0))
+                continue;  // degenerate, would never collide
+            tri.bounds.add(tri.a);
+            tri.bounds.add(tri.b);
+            tri.bounds.add(tri.c);
+            tri.component = component;
+            triangles.push_back(tri);
+        }
+    }
+}
+
+// worldT includes the component's own transform
+void SpatialHash::collectPlacements(
+    Component *component, AffineTransform worldT,
+    vector<std::pair<const Component *, glm::mat4>> &placements)
+{
+    if (component->mesh && !component->mesh->collision.empty())
+        placements.emplace_back(component, worldT.matrix());
+    for (auto &child : component->children())
+        collectPlacements(child, worldT * child->tLocal(), placements);
+}
+
+// worldT includes the component's own transform
+void SpatialHash::collectTriangles(Component *component,
+                                   AffineTransform worldT,
+                                   DynamicInstance *instance)
+{
+    if (component->mesh && !component->mesh->collision.empty()) {
+        instance->placements.emplace_back(component, worldT.matrix());
+        addTriangles(component, worldT, instance->triangles);
+    }
+    for (auto &child : component->children())
+        collectTriangles(child, worldT * child->tLocal(), instance);
+}
+
+static AffineTransform worldTransform(const Component *component)
+{
+    AffineTransform worldT;
+    for (; component; component = component->parent())
+        worldT = AffineTransform(component->tLocal()) * worldT;
+    return worldT;
+}
+
+void SpatialHash::update(const World *world)
+{
+    if (world->changeCount() == worldChanges)
+        return;
+    if (world->generation() != worldGeneration) {
+        // dynamic instances point at destroyed components
+        build(world);
+        return;
+    }
+    PROFILE_ZONE("SpatialHash::update");
+    worldChanges = world->changeCount();
+
+    for (uint32_t i = 0; i < dynamicInstances.size(); i++) {
+        DynamicInstance &instance = dynamicInstances[i];
+        // compare matrices first, transforming triangles is much slower
+        AffineTransform worldT = worldTransform(instance.component);
+        placements.clear();
+        collectPlacements(instance.component, worldT, placements);
+        if (placements == instance.placements)
+            continue;
+        removeDynamic(i);
+        instance.placements.clear();
+        instance.triangles.clear();
+        collectTriangles(instance.component, worldT, &instance);
+        insertDynamic(i);
+    }
+}
+
+void SpatialHash::insertDynamic(uint32_t index)
+{
+    DynamicInstance &instance = dynamicInstances[index];
+    for (uint32_t t = 0; t < instance.triangles.size(); t++) {
+        const BoundingBox &bounds = instance.triangles[t].bounds;
+        glm::ivec3 lo = cellOf(bounds.min), hi = cellOf(bounds.max);
+        for (int x = lo.x; x <= hi.x; x++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                for (int z = lo.z; z <= hi.z; z++) {
+                    uint64_t key = cellKey(glm::ivec3(x, y, z));
+                    dynamicCells[key].push_back(DynamicRef {index, t});
+                    instance.cells.push_back(key);
+                }
+            }
+        }
+    }
+    std::sort(instance.cells.begin(), instance.cells.end());
+    instance.cells.erase(std::unique(instance.cells.begin(),
+                                     instance.cells.end()),
+                         instance.cells.end());
+}
+
+void SpatialHash::removeDynamic(uint32_t index)
+{
+    DynamicInstance &instance = dynamicInstances[index];
+    for (uint64_t key : instance.cells) {
+        auto cellIt = dynamicCells.find(key);
+        if (cellIt == dynamicCells.end())
+            continue;
+        auto &refs = cellIt->second;
+        refs.erase(std::remove_if(refs.begin(), refs.end(),
+            [&](const DynamicRef &ref) { return ref.instance == index; }),
+            refs.end());
+        if (refs.empty())
+            dynamicCells.erase(cellIt);
+    }
+    instance.cells.clear();
+}
+
+template<typename Functor>
+void SpatialHash::forEachTriangle(const BoundingBox &box, Functor f) const
+{
+    glm::ivec3 lo = cellOf(box.min), hi = cellOf(box.max);
+    bool smallQuery = cellsCovered(box) <= MAX_QUERY_CELLS;
+
+    // triangles can be in many cells, so gather them and remove duplicates
+    vector<uint32_t> candidates;
+    vector<DynamicRef> dynamicCandidates;
+    if (smallQuery) {
+        for (int x = lo.x; x <= hi.x; x++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                for (int z = lo.z; z <= hi.z; z++) {
+                    uint64_t key = cellKey(glm::ivec3(x, y, z));
+                    auto cellIt = staticCells.find(key);
+                    if (cellIt != staticCells.end()) {
+                        candidates.insert(candidates.end(),
+                            cellIt->second.begin(), cellIt->second.end());
+                    }
+                    auto dynIt = dynamicCells.find(key);
+                    if (dynIt != dynamicCells.end()) {
+                        dynamicCandidates.insert(dynamicCandidates.end(),
+                            dynIt->second.begin(), dynIt->second.end());
+                    }
+                }
+            }
+        }
+        candidates.insert(candidates.end(),
+                          largeTriangles.begin(), largeTriangles.end());
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                         candidates.end());
+        std::sort(dynamicCandidates.begin(), dynamicCandidates.end());
+        dynamicCandidates.erase(std::unique(dynamicCandidates.begin(),
+                                            dynamicCandidates.end()),
+                                dynamicCandidates.end());
+    } else {
+        // cheaper to look at everything
+        for (uint32_t i = 0; i < staticTriangles.size(); i++)
+            candidates.push_back(i);
+        for (uint32_t i = 0; i < dynamicInstances.size(); i++) {
+            for (uint32_t t = 0; t < dynamicInstances[i].triangles.size(); t++)
+                dynamicCandidates.push_back(DynamicRef {i, t});
+        }
+    }
+
+    size_t tested = 0;
+    for (uint32_t i : candidates) {
+        const Triangle &tri = staticTriangles[i];
+        if (tri.bounds.intersects(box)) {
+            f(tri);
+            tested++;
+        }
+    }
+    for (auto &ref : dynamicCandidates) {
+        const Triangle &tri = dynamicInstances[ref.instance]
+            .triangles[ref.triangle];
+        if (tri.bounds.intersects(box)) {
+            f(tri);
+            tested++;
+        }
+    }
+    collisionStats().trianglesTested += tested;
+}
+
+void SpatialHash::sphereCollision(glm::vec3 center, float radius,
+                                  vector<CollisionInfo> &collisions) const
+{
+    PROFILE_ZONE("SpatialHash::sphereCollision");
+    BoundingBox box;
+    box.add(center);
+    float sqRadius = radius * radius;
+    forEachTriangle(box.expanded(radius), [&](const Triangle &tri) {
+        CollisionInfo collision;
+        if (sphereTriangle(tri.a, tri.b, tri.c, center, sqRadius,
+                           &collision)) {
+            collision.component = tri.component;
+            collisions.push_back(collision);
+        }
+    });
+}
+
+SweepInfo SpatialHash::sphereSweep(glm::vec3 center, float radius,
+                                   glm::vec3 motion) const
+{
+    PROFILE_ZONE("SpatialHash::sphereSweep");
+    SweepInfo closest;
+    if (motion == glm::vec3(0))
+        return closest;
+    BoundingBox box;
+    box.add(center);
+    box.add(center + motion);
+    forEachTriangle(box.expanded(radius), [&](const Triangle &tri) {
+        if (sweepTriangle(tri.a, tri.b, tri.c, center, radius, motion,
+                          &closest.time, &closest.collision))
+            closest.collision.component = tri.component;
+    });
+    return closest;
+}
+
+glm::vec3 SpatialHash::slideSphere(glm::vec3 center, float radius,
+                                   glm::vec3 motion, int maxIterations) const
+{
+    return slide(center, radius, motion, maxIterations,
+        [&](glm::vec3 center, glm::vec3 motion) {
+            return sphereSweep(center, radius, motion);
+        },
+        [&](glm::vec3 center, vector<CollisionInfo> &collisions) {
+            sphereCollision(center, radius, collisions);
+        });
+}
+
+}  // namespace
@@ -0,0 +1,101 @@
+#pragma once
+#include "common.h"
+
+#include "collision.h"
+#include <cstdint>
+#include <unordered_map>
+
+namespace diorama::physics {
+
+// Uniform grid of world-space triangles for small queries like the player
+// sphere, which only touch a few cells instead of walking all geometry.
+// Static triangles are baked once by build(). Dynamic components are kept
+// apart and only re-inserted when they move. Queries can run on any thread,
+// but not during build() or update().
+class SpatialHash
+{
+public:
+    explicit SpatialHash(float cellSize = 64);
+
+    void build(const World *world);
+    // re-insert dynamic components that moved since the last update.
+    // moving static components, or adding and removing any, needs a new
+    // build(). after World::clear() this builds again, since the old
+    // components may be gone
+    void update(const World *world);
+
+    void sphereCollision(glm::vec3 center, float radius,
+                         vector<CollisionInfo> &collisions) const;
+    SweepInfo sphereSweep(glm::vec3 center, float radius,
+                          glm::vec3 motion) const;
+    glm::vec3 slideSphere(glm::vec3 center, float radius, glm::vec3 motion,
+                          int maxIterations = 4) const;
+
+    float cellSize() const;
+    size_t numStaticTriangles() const;
+
+private:
+    struct Triangle
+    {
+        glm::vec3 a, b, c;
+        BoundingBox bounds;
+        Component *component;
+    };
+
+    // a dynamic component and its subtree
+    struct DynamicInstance
+    {
+        Component *component;
+        // world matrices of mesh components when inserted, to detect moves
+        vector<std::pair<const Component *, glm::mat4>> placements;
+        vector<Triangle> triangles;
+        vector<uint64_t> cells;  // keys this was inserted into
+    };
+
+    // location in dynamicInstances and their triangles
+    struct DynamicRef
+    {
+        uint32_t instance;
+        uint32_t triangle;
+        bool operator<(const DynamicRef &rhs) const;
+        bool operator==(const DynamicRef &rhs) const;
+    };
+
+    void addStatic(Component *component, AffineTransform worldT);
+    static void addTriangles(Component *component,
+                             const AffineTransform &worldT,
+                             vector<Triangle> &triangles);
+    // world matrices of mesh components under component, cheap enough to
+    // check every instance for moves
+    static void collectPlacements(
+        Component *component, AffineTransform worldT,
+        vector<std::pair<const Component *, glm::mat4>> &placements);
+    static void collectTriangles(Component *component, AffineTransform worldT,
+                                 DynamicInstance *instance);
+    void insertDynamic(uint32_t index);
+    void removeDynamic(uint32_t index);
+
+    glm::ivec3 cellOf(glm::vec3 point) const;
+    static uint64_t cellKey(glm::ivec3 cell);
+    size_t cellsCovered(const BoundingBox &box) const;
+
+    // f(const Triangle &) for each triangle whose bounds overlap the box,
+    // once each
+    template<typename Functor>
+    void forEachTriangle(const BoundingBox &box, Functor f) const;
+
+    float _cellSize;
+    vector<Triangle> staticTriangles;
+    std::unordered_map<uint64_t, vector<uint32_t>> staticCells;
+    // triangles too large for the grid, always tested
+    vector<uint32_t> largeTriangles;
+
+    vector<DynamicInstance> dynamicInstances;
+    std::unordered_map<uint64_t, vector<DynamicRef>> dynamicCells;
+    uint64_t worldChanges = 0;
+    uint64_t worldGeneration = 0;
+    // avoid reallocating every update
+    vector<std::pair<const Component *, glm::mat4>> placements;
+};
+
+}  // namespace
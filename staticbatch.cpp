@@ -0,0 +1,198 @@
+#include "staticbatch.h"
+#include "culling.h"
+#include "profiler.h"
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+
+namespace diorama::render {
+
+// MeshIndex limits the vertices of each batch
+const size_t MAX_BATCH_VERTICES =
+    (size_t)std::numeric_limits<MeshIndex>::max() + 1;
+
+// material and grid cell
+using BatchKey = std::tuple<const Material *, int, int, int>;
+
+struct Batcher
+{
+    Batcher(World *world, const StaticBatchParams &params);
+
+    // rootT is from the component to the root
+    void addHierarchy(Component *component, const AffineTransform &rootT,
+                      const Material *inherit);
+    void buildBatches(Component *parent);
+    void releaseGeometry();
+
+    World *world;
+    const StaticBatchParams &params;
+    // the last batch for each key is the one being filled
+    std::map<BatchKey, vector<RenderGeometry>> batches;
+    std::unordered_map<const Mesh *, Mesh *> collisionMeshes;
+    std::unordered_set<const Mesh *> meshes;  // every mesh seen
+    StaticBatchStats stats;
+
+private:
+    bool canBatch(const Mesh *mesh, const Material *inherit) const;
+    void addPrimitive(const RenderPrimitive &primitive,
+                      const AffineTransform &rootT,
+                      const Material *inherit, const BatchKey &key);
+    const Mesh * collisionOnly(const Mesh *mesh);
+};
+
+Batcher::Batcher(World *world, const StaticBatchParams &params)
+    : world(world)
+    , params(params)
+{}
+
+void Batcher::addHierarchy(Component *component, const AffineTransform &rootT,
+                           const Material *inherit)
+{
+    if (component->dynamic)
+        return;  // moves with its children
+    if (component->material)
+        inherit = component->material;
+    const Mesh *mesh = component->mesh;
+    if (mesh)
+        meshes.insert(mesh);
+    if (mesh && canBatch(mesh, inherit)) {
+        BoundingBox bounds = mesh->bounds.transformed(rootT);
+        glm::vec3 cell = glm::floor(
+            (bounds.min + bounds.max) * 0.5f / params.cellSize);
+        for (auto &primitive : mesh->render) {
+            const Material *material = primitive.material
+                ? primitive.material : inherit;
+            addPrimitive(primitive, rootT, inherit, BatchKey {
+                material, (int)cell.x, (int)cell.y, (int)cell.z});
+            stats.primitives++;
+        }
+        component->mesh = collisionOnly(mesh);
+        stats.components++;
+    }
+    for (auto &child : component->children())
+        addHierarchy(child, rootT * child->tLocal(), inherit);
+}
+
+bool Batcher::canBatch(const Mesh *mesh, const Material *inherit) const
+{
+    if (mesh->render.empty() || mesh->bounds.empty())
+        return false;
+    for (auto &primitive : mesh->render) {
+        const Material *material = primitive.material
+            ? primitive.material : inherit;
+        // transparent primitives are sorted by depth one at a time
+        if (!primitive.geometry
+                || (material && material->order != RenderOrder::Opaque))
+            return false;
+    }
+    return true;
+}
+
+void Batcher::addPrimitive(const RenderPrimitive &primitive,
+                           const AffineTransform &rootT,
+                           const Material *inherit, const BatchKey &key)
+{
+    const RenderGeometry &geometry = *primitive.geometry;
+    size_t numVertices = geometry.positions.size();
+    vector<RenderGeometry> &list = batches[key];
+    if (list.empty() || list.back().positions.size() + numVertices
+            > MAX_BATCH_VERTICES)
+        list.emplace_back();
+    RenderGeometry &batch = list.back();
+    size_t first = batch.positions.size();
+
+    batch.positions.resize(first + numVertices);
+    rootT.transformPoints(geometry.positions.data(), &batch.positions[first],
+                          numVertices);
+    glm::mat3 normalMatrix = rootT.normalMatrix();
+    for (auto &normal : geometry.normals)
+        batch.normals.push_back(glm::normalize(normalMatrix * normal));
+    // the renderer scales coordinates of primitives without their own
+    // material by the inherited material's texture scale
+    glm::vec2 scale(1, 1);
+    if (!primitive.material && inherit)
+        scale = inherit->scale;
+    for (auto &stq : geometry.stqCoords)
+        batch.stqCoords.push_back(glm::vec3(stq.x * scale.x, stq.y * scale.y,
+                                            stq.z));
+
+    // baking a mirrored transform would turn the faces inside out
+    bool reversed = rootT.determinant() < 0;
+    for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+        MeshIndex a = geometry.indices[i], b = geometry.indices[i + 1];
+        MeshIndex c = geometry.indices[i + 2];
+        if (reversed)
+            std::swap(b, c);
+        for (MeshIndex index : {a, b, c})
+            batch.indices.push_back((MeshIndex)(index + first));
+    }
+}
+
+const Mesh * Batcher::collisionOnly(const Mesh *mesh)
+{
+    auto it = collisionMeshes.find(mesh);
+    if (it == collisionMeshes.end()) {
+        Mesh *copy = world->createResource<Mesh>();
+        copy->collision = mesh->collision;
+        it = collisionMeshes.emplace(mesh, copy).first;
+    }
+    return it->second;
+}
+
+void Batcher::buildBatches(Component *parent)
+{
+    for (auto &pair : batches) {
+        for (auto &geometry : pair.second) {
+            Mesh *mesh = world->createResource<Mesh>();
+            mesh->render.emplace_back();
+            RenderPrimitive &primitive = mesh->render.back();
+            primitive.material = std::get<0>(pair.first);
+            for (auto &position : geometry.positions)
+                mesh->bounds.add(position);
+            primitive.occluders = selectOccluders(geometry.positions,
+                                                  geometry.indices);
+            if (params.upload)
+                primitive.setGeometry(geometry);
+            else
+                primitive.numIndices = geometry.indices.size();
+
+            Component *component = world->createComponent();
+            component->name = "static batch";
+            component->mesh = mesh;
+            component->setParent(parent);
+            stats.batches++;
+        }
+    }
+}
+
+void Batcher::releaseGeometry()
+{
+    for (const Mesh *mesh : meshes) {
+        for (auto &primitive : mesh->render)
+            primitive.geometry.reset();
+    }
+}
+
+StaticBatchStats buildStaticBatches(World *world,
+                                    const StaticBatchParams &params)
+{
+    PROFILE_ZONE("buildStaticBatches");
+    Batcher batcher(world, params);
+    Component *root = world->root();
+    if (!root)
+        return batcher.stats;
+    // in root space, since batches go under the root
+    batcher.addHierarchy(root, AffineTransform(), nullptr);
+
+    World::Batch worldBatch(world);
+    Component *group = world->createComponent();
+    group->name = "static batches";
+    batcher.buildBatches(group);
+    group->setParent(root);
+    batcher.releaseGeometry();
+    return batcher.stats;
+}
+
+}  // namespace
@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+
+#include "world.h"
+
+namespace diorama::render {
+
+struct StaticBatchParams
+{
+    // batches don't span grid cells, so they can still be culled. in model
+    // units, by the center of each component's bounds
+    float cellSize = 1000;
+    // false to build batches without a GL context, with index counts only
+    bool upload = true;
+};
+
+struct StaticBatchStats
+{
+    int components = 0;  // batched
+    int primitives = 0;  // replaced by batches
+    int batches = 0;
+};
+
+// Merges the render primitives of static components into batches per material
+// and grid cell, with world transforms baked into the vertices. Batches are
+// added under a "static batches" group of the root.
+// Batched components keep their names, hierarchy and collision, so gameplay
+// can still find them, but their meshes are replaced with copies that don't
+// render. They must not move afterwards. Components under dynamic ones,
+// transparent primitives and primitives without geometry (see SkpLoader) are
+// left alone. Geometry is released from every primitive after batching.
+StaticBatchStats buildStaticBatches(World *world,
+                                    const StaticBatchParams &params
+                                        = StaticBatchParams());
+
+}  // namespace
@@ -0,0 +1,79 @@
+#include "stats.h"
+#include <algorithm>
+
+namespace diorama {
+
+TimingHistory::TimingHistory(size_t capacity)
+    : capacity(capacity)
+{}
+
+void TimingHistory::add(double sample)
+{
+    if (capacity == 0 || samples.size() < capacity) {
+        samples.push_back(sample);
+    } else {
+        samples[next] = sample;
+        next = (next + 1) % capacity;
+    }
+}
+
+void TimingHistory::clear()
+{
+    samples.clear();
+    next = 0;
+}
+
+size_t TimingHistory::count() const
+{
+    return samples.size();
+}
+
+double TimingHistory::at(size_t i) const
+{
+    return samples[(next + i) % samples.size()];
+}
+
+double TimingHistory::latest() const
+{
+    if (samples.empty())
+        return 0;
+    if (next == 0)
+        return samples.back();
+    return samples[next - 1];
+}
+
+double TimingHistory::min() const
+{
+    if (samples.empty())
+        return 0;
+    return *std::min_element(samples.begin(), samples.end());
+}
+
+double TimingHistory::max() const
+{
+    if (samples.empty())
+        return 0;
+    return *std::max_element(samples.begin(), samples.end());
+}
+
+double TimingHistory::average() const
+{
+    if (samples.empty())
+        return 0;
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+    return total / samples.size();
+}
+
+double TimingHistory::percentile(double p) const
+{
+    if (samples.empty())
+        return 0;
+    vector<double> sorted = samples;
+    size_t n = (size_t)(p * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+}  // namespace
@@ -0,0 +1,31 @@
+#pragma once
+#include "common.h"
+
+namespace diorama {
+
+// Keeps the most recent samples of a measurement for summary statistics.
+class TimingHistory
+{
+public:
+    // capacity 0 keeps every sample
+    TimingHistory(size_t capacity = 1000);
+
+    void add(double sample);
+    void clear();
+
+    size_t count() const;
+    double at(size_t i) const;  // 0 is the oldest sample
+    double latest() const;
+    double min() const;
+    double max() const;
+    double average() const;
+    // p from 0 to 1
+    double percentile(double p) const;
+
+private:
+    size_t capacity;
+    vector<double> samples;  // ring buffer once full
+    size_t next = 0;  // oldest sample once full
+};
+
+}  // namespace
@@ -0,0 +1,372 @@
+#include "texcompress.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <glm/glm.hpp>
+
+namespace diorama {
+
+const char CACHE_MAGIC[4] = {'D', 'T', 'E', 'X'};
+const uint32_t CACHE_VERSION = 1;
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t compressedSize(BlockFormat format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// down to 1x1
+static uint32_t numLevels(int width, int height)
+{
+    uint32_t levels = 1;
+    while (width > 1 || height > 1) {
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+        levels++;
+    }
+    return levels;
+}
+
+static uint16_t to565(glm::vec3 color)
+{
+    glm::ivec3 c = glm::clamp(
+        glm::ivec3(color / 255.0f * glm::vec3(31, 63, 31) + 0.5f),
+        glm::ivec3(0), glm::ivec3(31, 63, 31));
+    return (uint16_t)((c.r << 11) | (c.g << 5) | c.b);
+}
+
+static glm::vec3 from565(uint16_t color)
+{
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4),
+                     (b << 3) | (b >> 2));
+}
+
+// picks the nearest palette entry for each pixel, returns the squared error.
+// c0 must be greater than c1 (four color mode) unless they're equal
+static float fitColorIndices(const glm::vec3 colors[16], uint16_t c0,
+                             uint16_t c1, uint32_t *indices)
+{
+    glm::vec3 palette[4];
+    palette[0] = from565(c0);
+    palette[1] = from565(c1);
+    palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+    palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+    // equal endpoints would be three color mode, so only use the first
+    int numEntries = c0 == c1 ? 1 : 4;
+
+    *indices = 0;
+    float error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float bestDist = std::numeric_limits<float>::max();
+        for (int j = 0; j < numEntries; j++) {
+            glm::vec3 d = colors[i] - palette[j];
+            float dist = glm::dot(d, d);
+            if (dist < bestDist) {
+                best = j;
+                bestDist = dist;
+            }
+        }
+        *indices |= (uint32_t)best << (i * 2);
+        error += bestDist;
+    }
+    return error;
+}
+
+// https://github.com/nothings/stb/blob/master/stb_dxt.h
+// endpoints at the extremes of the principal axis, then refined once by least
+// squares for the chosen indices
+static void encodeColorBlock(const glm::vec3 colors[16], uint8_t *out)
+{
+    glm::vec3 mean(0), lo(255), hi(0);
+    for (int i = 0; i < 16; i++) {
+        mean += colors[i];
+        lo = glm::min(lo, colors[i]);
+        hi = glm::max(hi, colors[i]);
+    }
+    mean /= 16.0f;
+    glm::mat3 covariance(0);
+    for (int i = 0; i < 16; i++) {
+        glm::vec3 d = colors[i] - mean;
+        covariance += glm::mat3(d * d.x, d * d.y, d * d.z);
+    }
+    // power iteration, starting from the diagonal of the bounding box
+    glm::vec3 axis = hi - lo;
+    for (int i = 0; i < 4; i++) {
+        glm::vec3 next = covariance * axis;
+        float length = glm::length(next);
+        if (length < 1e-6f)
+            break;
+        axis = next / length;
+    }
+    float axisLength = glm::length(axis);
+    if (axisLength > 1e-6f)
+        axis /= axisLength;
+    float tMin = 0, tMax = 0;
+    for (int i = 0; i < 16; i++) {
+        float t = glm::dot(colors[i] - mean, axis);
+        tMin = glm::min(tMin, t);
+        tMax = glm::max(tMax, t);
+    }
+
+    uint16_t c0 = to565(mean + axis * tMax), c1 = to565(mean + axis * tMin);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    uint32_t indices;
+    float error = fitColorIndices(colors, c0, c1, &indices);
+
+    // pixel = weight * e0 + (1 - weight) * e1
+    static const float WEIGHTS[4] = {1, 0, 2 / 3.0f, 1 / 3.0f};
+    float aa = 0, ab = 0, bb = 0;
+    glm::vec3 ax(0), bx(0);
+    for (int i = 0; i < 16; i++) {
+        float a = WEIGHTS[(indices >> (i * 2)) & 3], b = 1 - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax += a * colors[i];
+        bx += b * colors[i];
+    }
+    float det = aa * bb - ab * ab;
+    if (c0 != c1 && std::abs(det) > 1e-6f) {
+        uint16_t r0 = to565((bb * ax - ab * bx) / det);
+        uint16_t r1 = to565((aa * bx - ab * ax) / det);
+        if (r0 < r1)
+            std::swap(r0, r1);
+        uint32_t refinedIndices;
+        if (fitColorIndices(colors, r0, r1, &refinedIndices) < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refinedIndices;
+        }
+    }
+
+    // little endian
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// eight alpha mode, exact at the minimum and maximum
+static void encodeAlphaBlock(const uint8_t alphas[16], uint8_t *out)
+{
+    uint8_t a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = glm::max(a0, alphas[i]);
+        a1 = glm::min(a1, alphas[i]);
+    }
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        int palette[8] = {a0, a1};
+        for (int k = 1; k <= 6; k++)
+            palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            for (int j = 1; j < 8; j++) {
+                if (std::abs(alphas[i] - palette[j])
+                        < std::abs(alphas[i] - palette[best]))
+                    best = j;
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static vector<uint8_t> compressLevel(const uint8_t *pixels, int width,
+                                     int height, BlockFormat format)
+{
+    vector<uint8_t> data(compressedSize(format, width, height));
+    uint8_t *out = data.data();
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            glm::vec3 colors[16];
+            uint8_t alphas[16];
+            for (int i = 0; i < 16; i++) {
+                // repeat the last row and column into partial blocks
+                int x = glm::min(bx + i % 4, width - 1);
+                int y = glm::min(by + i / 4, height - 1);
+                const uint8_t *pixel = pixels + (y * width + x) * 4;
+                colors[i] = glm::vec3(pixel[0], pixel[1], pixel[2]);
+                alphas[i] = pixel[3];
+            }
+            if (format == BlockFormat::BC3) {
+                encodeAlphaBlock(alphas, out);
+                out += 8;
+            }
+            encodeColorBlock(colors, out);
+            out += 8;
+        }
+    }
+    return data;
+}
+
+static vector<uint8_t> downsample(const vector<uint8_t> &pixels, int width,
+                                  int height)
+{
+    int newWidth = glm::max(width / 2, 1), newHeight = glm::max(height / 2, 1);
+    vector<uint8_t> result(newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; y++) {
+        int y0 = glm::min(y * 2, height - 1);
+        int y1 = glm::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < newWidth; x++) {
+            int x0 = glm::min(x * 2, width - 1);
+            int x1 = glm::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < 4; c++) {
+                int sum = pixels[(y0 * width + x0) * 4 + c]
+                    + pixels[(y0 * width + x1) * 4 + c]
+                    + pixels[(y1 * width + x0) * 4 + c]
+                    + pixels[(y1 * width + x1) * 4 + c];
+                result[(y * newWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+CompressedImage compressImage(const uint8_t *pixels, int width, int height)
+{
+    CompressedImage image;
+    image.width = width;
+    image.height = height;
+    image.format = BlockFormat::BC1;
+    for (int i = 0; i < width * height; i++) {
+        if (pixels[i * 4 + 3] != 255) {
+            image.format = BlockFormat::BC3;
+            break;
+        }
+    }
+
+    vector<uint8_t> level(pixels, pixels + width * height * 4);
+    while (true) {
+        image.levels.push_back(compressLevel(level.data(), width, height,
+                                             image.format));
+        if (width == 1 && height == 1)
+            break;
+        level = downsample(level, width, height);
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+    }
+    return image;
+}
+
+bool saveCompressedImage(const string &path, const CompressedImage &image)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    uint32_t header[5] = {CACHE_VERSION, (uint32_t)image.format,
+        (uint32_t)image.width, (uint32_t)image.height,
+        (uint32_t)image.levels.size()};
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write((const char *)header, sizeof(header));
+    for (auto &level : image.levels)
+        file.write((const char *)level.data(), level.size());
+    return (bool)file;
+}
+
+// header after the magic: version, format, width, height, levels
+static bool readHeader(std::ifstream &file, uint32_t header[5])
+{
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    file.read((char *)header, sizeof(uint32_t) * 5);
+    return file && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+        && header[0] == CACHE_VERSION
+        && header[1] <= (uint32_t)BlockFormat::BC3
+        && header[2] != 0 && header[3] != 0
+        && header[2] <= 65536 && header[3] <= 65536
+        && header[4] == numLevels(header[2], header[3]);
+}
+
+static void setHeader(const uint32_t header[5], CompressedImage *image)
+{
+    image->format = (BlockFormat)header[1];
+    image->width = header[2];
+    image->height = header[3];
+    image->levels.clear();
+    image->levels.resize(header[4]);
+}
+
+bool loadCompressedImage(const string &path, CompressedImage *image,
+                         int firstLevel)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[5];
+    if (!file || !readHeader(file, header))
+        return false;
+
+    setHeader(header, image);
+    int width = image->width, height = image->height;
+    for (int i = 0; i < (int)image->levels.size(); i++) {
+        size_t size = compressedSize(image->format, width, height);
+        if (i < firstLevel) {
+            file.seekg(size, std::ios::cur);
+        } else {
+            image->levels[i].resize(size);
+            file.read((char *)image->levels[i].data(), size);
+        }
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+    }
+    return (bool)file;
+}
+
+bool loadCompressedHeader(const string &path, CompressedImage *image)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0);
+    uint32_t header[5];
+    if (!readHeader(file, header))
+        return false;
+
+    setHeader(header, image);
+    std::streamoff expected = file.tellg();
+    int width = image->width, height = image->height;
+    for (size_t i = 0; i < image->levels.size(); i++) {
+        expected += compressedSize(image->format, width, height);
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+    }
+    return fileSize >= expected;
+}
+
+bool loadCompressedLevel(const string &path, int level,
+                         vector<uint8_t> *data)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[5];
+    if (!file || !readHeader(file, header) || level < 0
+            || level >= (int)header[4])
+        return false;
+    BlockFormat format = (BlockFormat)header[1];
+    int width = header[2], height = header[3];
+    size_t offset = 0;
+    for (int i = 0; i < level; i++) {
+        offset += compressedSize(format, width, height);
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+    }
+    data->resize(compressedSize(format, width, height));
+    file.seekg(offset, std::ios::cur);
+    file.read((char *)data->data(), data->size());
+    return (bool)file;
+}
+
+}  // namespace
@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+
+namespace diorama {
+
+// S3TC formats, encoded in blocks of 4x4 pixels
+enum class BlockFormat : uint32_t
+{
+    BC1,  // RGB, 8 bytes per block
+    BC3,  // RGBA, 16 bytes per block
+};
+
+// A block compressed image with a full mip chain, ready to upload.
+struct CompressedImage
+{
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0, height = 0;
+    vector<vector<uint8_t>> levels;  // largest first, down to 1x1
+};
+
+size_t blockBytes(BlockFormat format);
+// partial blocks at the edges are padded to whole blocks
+size_t compressedSize(BlockFormat format, int width, int height);
+
+// Builds mips with a box filter and encodes every level, as BC1 if all pixels
+// are opaque or BC3 otherwise. Pixels are 8-bit RGBA. Slow, meant for loading
+// uncached textures.
+CompressedImage compressImage(const uint8_t *pixels, int width, int height);
+
+// cache files, all return false on failure
+bool saveCompressedImage(const string &path, const CompressedImage &image);
+// levels before firstLevel are left empty
+bool loadCompressedImage(const string &path, CompressedImage *image,
+                         int firstLevel = 0);
+// format, size and number of levels, but every level is empty. also checks
+// the file is long enough for all of them
+bool loadCompressedHeader(const string &path, CompressedImage *image);
+// one level of a cache file, for streaming
+bool loadCompressedLevel(const string &path, int level,
+                         vector<uint8_t> *data);
+
+}  // namespace
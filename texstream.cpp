@@ -0,0 +1,174 @@
+#include "texstream.h"
+#include "log.h"
+#include "profiler.h"
+#include <algorithm>
+#include <limits>
+
+namespace diorama::render {
+
+static const int NOT_REQUESTED = std::numeric_limits<int>::max();
+
+int TextureStreamer::coarsestLevel(int width, int height)
+{
+    int level = 0;
+    while ((width >> level) > MIN_RESIDENT_SIZE
+            || (height >> level) > MIN_RESIDENT_SIZE)
+        level++;
+    return level;
+}
+
+TextureStreamer::TextureStreamer(size_t budgetBytes)
+    : budgetBytes(budgetBytes)
+{}
+
+void TextureStreamer::addArray(TextureArray *array)
+{
+    array->streamIndex = (int)arrays.size();
+    int coarsest = glm::min(coarsestLevel(array->width, array->height),
+                            array->levels - 1);
+    arrays.push_back({array, 0, coarsest, NOT_REQUESTED, array->baseLevel,
+                      array->baseLevel});
+    _stats.residentBytes += residentBytes(arrays.back(), array->baseLevel);
+}
+
+void TextureStreamer::request(const TextureArray &array, int level)
+{
+    StreamedArray &streamed = arrays[array.streamIndex];
+    streamed.requested = glm::min(streamed.requested, level);
+}
+
+void TextureStreamer::update()
+{
+    PROFILE_ZONE("TextureStreamer::update");
+    frame++;
+    _stats.levelLoads = _stats.levelEvictions = 0;
+
+    // levels that are already resident are kept while under budget, even
+    // if they aren't needed now, so moving back and forth doesn't reload
+    // them
+    size_t total = 0;
+    for (auto &streamed : arrays) {
+        int baseLevel = streamed.array->baseLevel;
+        if (streamed.requested != NOT_REQUESTED) {
+            streamed.needed = glm::clamp(streamed.requested, streamed.finest,
+                                         streamed.coarsest);
+            streamed.lastUsedFrame = frame;
+        } else {
+            streamed.needed = baseLevel;
+        }
+        streamed.target = glm::min(streamed.needed, baseLevel);
+        streamed.requested = NOT_REQUESTED;
+        total += residentBytes(streamed, streamed.target);
+    }
+
+    if (total > budgetBytes) {
+        // first drop detail that isn't needed this frame
+        for (auto &streamed : arrays) {
+            if (total <= budgetBytes)
+                break;
+            if (streamed.target >= streamed.needed)
+                continue;
+            total -= residentBytes(streamed, streamed.target);
+            streamed.target = streamed.needed;
+            total += residentBytes(streamed, streamed.target);
+        }
+        evictOrder.resize(arrays.size());
+        for (size_t i = 0; i < arrays.size(); i++)
+            evictOrder[i] = i;
+        std::sort(evictOrder.begin(), evictOrder.end(),
+            [&](size_t a, size_t b) {
+                return arrays[a].lastUsedFrame < arrays[b].lastUsedFrame;
+            });
+        for (size_t i : evictOrder) {
+            StreamedArray &streamed = arrays[i];
+            if (total <= budgetBytes || streamed.lastUsedFrame == frame)
+                break;
+            total -= residentBytes(streamed, streamed.target);
+            streamed.target = streamed.coarsest;
+            total += residentBytes(streamed, streamed.target);
+        }
+        // drop one level at a time from the most detailed
+        while (total > budgetBytes) {
+            StreamedArray *detailed = nullptr;
+            for (auto &streamed : arrays) {
+                if (streamed.target < streamed.coarsest && (!detailed
+                        || streamed.target < detailed->target))
+                    detailed = &streamed;
+            }
+            if (!detailed)
+                break;  // everything is at its smallest
+            total -= detailed->array->levelBytes(detailed->target);
+            detailed->target++;
+        }
+    }
+
+    // evict first to make room
+    for (auto &streamed : arrays) {
+        TextureArray *array = streamed.array;
+        if (streamed.target <= array->baseLevel)
+            continue;
+        int oldBase = array->baseLevel;
+        array->setBaseLevel(streamed.target);
+        for (int level = oldBase; level < streamed.target; level++) {
+            array->freeLevel(level);
+            _stats.residentBytes -= array->levelBytes(level);
+            _stats.levelEvictions++;
+        }
+    }
+
+    int loads = 0;
+    size_t start = nextLoad;
+    for (size_t i = 0; i < arrays.size() && loads < MAX_LOADS_PER_UPDATE;
+            i++) {
+        StreamedArray &streamed = arrays[(start + i) % arrays.size()];
+        TextureArray *array = streamed.array;
+        // one level at a time, so every array gets a turn
+        if (streamed.target >= array->baseLevel)
+            continue;
+        int level = array->baseLevel - 1;
+        if (!loadLevel(array, level)) {
+            cout << "Couldn't read texture cache, stopped streaming\n";
+            streamed.finest = array->baseLevel;
+            continue;
+        }
+        array->setBaseLevel(level);
+        _stats.residentBytes += array->levelBytes(level);
+        _stats.levelLoads++;
+        loads++;
+        nextLoad = (start + i + 1) % arrays.size();
+    }
+}
+
+const TextureStreamStats & TextureStreamer::stats() const
+{
+    return _stats;
+}
+
+size_t TextureStreamer::residentBytes(const StreamedArray &streamed,
+                                      int baseLevel) const
+{
+    size_t bytes = 0;
+    for (int level = baseLevel; level < streamed.array->levels; level++)
+        bytes += streamed.array->levelBytes(level);
+    return bytes;
+}
+
+bool TextureStreamer::loadLevel(TextureArray *array, int level)
+{
+    PROFILE_ZONE("TextureStreamer::loadLevel");
+    array->allocateLevel(level);
+    for (int layer = 0; layer < array->layers; layer++) {
+        const string &file = array->layerFiles[layer];
+        if (!loadCompressedLevel(file, level, &levelData)) {
+            array->freeLevel(level);
+            return false;
+        }
+        array->setCompressedLevel(layer, level, levelData.data(),
+                                  levelData.size());
+    }
+    logAt(Verbosity::Verbose) << "Streamed level " <<level<< " of "
+        <<array->width<< "x" <<array->height<< " array\n";
+    return true;
+}
+
+}  // namespace
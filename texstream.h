@@ -0,0 +1,72 @@
+#pragma once
+#include "common.h"
+
+#include "material.h"
+
+namespace diorama::render {
+
+struct TextureStreamStats
+{
+    size_t residentBytes = 0;  // of streamed arrays
+    // in the last update, counting each level of an array once
+    int levelLoads = 0;
+    int levelEvictions = 0;
+};
+
+// Keeps the mip levels of streamed texture arrays within a memory budget.
+// Arrays start with only their small levels resident. Each frame the renderer
+// requests the most detailed level every array needs, then update() loads
+// missing levels from the texture cache, a few per frame. Over budget, levels
+// are evicted from arrays that weren't used in the frame first, least recently
+// used first, then evenly from the most detailed of the rest.
+class TextureStreamer
+{
+public:
+    // levels at most this big are always resident
+    static const int MIN_RESIDENT_SIZE = 64;
+    // limits upload time per frame
+    static const int MAX_LOADS_PER_UPDATE = 2;
+
+    // least detailed level streamed arrays can drop to
+    static int coarsestLevel(int width, int height);
+
+    TextureStreamer(size_t budgetBytes);
+
+    // needs layerFiles, and the levels from coarsestLevel() up resident
+    void addArray(TextureArray *array);
+    // while recording a frame
+    void request(const TextureArray &array, int level);
+    // after the frame
+    void update();
+
+    const TextureStreamStats & stats() const;
+
+private:
+    struct StreamedArray
+    {
+        TextureArray *array;
+        int finest;  // raised if the cache can't be read
+        int coarsest;
+        int requested;  // most detailed level needed in this frame
+        int needed;  // requested clamped, or baseLevel if not requested
+        int target;
+        size_t lastUsedFrame = 0;
+    };
+
+    // bytes of levels from baseLevel up
+    size_t residentBytes(const StreamedArray &streamed, int baseLevel) const;
+    // false if the cache files can't be read
+    bool loadLevel(TextureArray *array, int level);
+
+    size_t budgetBytes;
+    vector<StreamedArray> arrays;
+    size_t frame = 0;
+    size_t nextLoad = 0;  // round robin, so all arrays get loaded eventually
+    TextureStreamStats _stats;
+
+    // avoid reconstructing vectors each update
+    vector<size_t> evictOrder;
+    vector<uint8_t> levelData;
+};
+
+}  // namespace
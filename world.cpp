@@ -1,67 +1,326 @@
 #include "world.h"
+#include "log.h"
+#include <algorithm>
 
 namespace diorama {
 
+// cache is cleared when full, patterns are usually the same every frame
+const size_t MAX_CACHED_PATTERNS = 256;
+const uint32_t NOT_INDEXED = UINT32_MAX;
+
+// * matches any characters, ? matches one
+static bool globMatch(const char *pattern, const char *name)
+{
+    // on a mismatch, let the last * take one more character and retry
+    const char *star = nullptr, *starName = nullptr;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            starName = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++starName;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+        pattern++;
+    return !*pattern;
+}
+
+static bool startsWith(const string &str, const string &prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+World::~World()
+{
+    clear();
+}
+
 void World::addResource(const Resource *resource)
 {
     _resources.emplace_back(resource);
 }
 
+Component * World::createComponent()
+{
+    return createComponent(Component());
+}
+
+Component * World::createComponent(const Component &other)
+{
+    void *memory = arena.allocate(sizeof(Component), alignof(Component));
+    Component *component = new(memory) Component(other);
+    component->_inArena = true;
+    arenaComponents.push_back(component);
+    return component;
+}
+
+void World::clear()
+{
+    // everything goes, so skip removing components one by one
+    names.clear();
+    sortedNames.clear();
+    reversedNames.clear();
+    patternCache.clear();
+    pendingAdds.clear();
+    pendingRemoves.clear();
+    if (_root && !_root->_inArena)
+        delete _root;  // along with its children not in the arena
+    _root = nullptr;
+    // arena components don't touch their parents or children when destroyed
+    for (auto it = arenaComponents.rbegin(); it != arenaComponents.rend(); it++)
+        (*it)->~Component();
+    arenaComponents.clear();
+    for (auto it = arenaResources.rbegin(); it != arenaResources.rend(); it++)
+        (*it)->~Resource();
+    arenaResources.clear();
+    _resources.clear();
+    arena.release();
+    // moved components are gone too
+    moveLogStart += moveLog.size();
+    moveLog.clear();
+    _generation++;
+    _changeCount++;
+    _structureChanges++;
+}
+
+uint64_t World::generation() const
+{
+    return _generation;
+}
+
 Component * World::root() const
 {
-    return _root.get();
+    return _root;
 }
 
 void World::setRoot(Component *root)
 {
-    if (_root.get() == root)
+    if (_root == root)
         return;
     if (_root) {
         _root->setWorld(nullptr);
+        if (!_root->_inArena)
+            delete _root;
     }
-    _root = unique_ptr<Component>(root);
+    _root = root;
     if (root) {
         _root->setWorld(this);
     }
 }
 
+World::Batch::Batch(World *world)
+    : world(world)
+{
+    world->batchDepth++;
+}
+
+World::Batch::~Batch()
+{
+    if (--world->batchDepth == 0)
+        world->applyPending();
+}
+
 void World::addComponent(Component *component)
 {
-    cout << "add component " <<component->name<< "\n";  // TODO
-    names[component->name].push_back(component);
+    logAt(Verbosity::Verbose) << "add component " <<component->name<< "\n";
+    auto nameIt = names.find(component->name);
+    if (nameIt == names.end()) {
+        nameIt = names.emplace(component->name, vector<Component *>()).first;
+        const string &name = nameIt->first;
+        sortedNames[name] = &*nameIt;
+        reversedNames[string(name.rbegin(), name.rend())] = &*nameIt;
+    }
+    component->_nameIndex = nameIt->second.size();
+    nameIt->second.push_back(component);
 }
 
 void World::removeComponent(Component *component)
 {
-    cout << "remove component " <<component->name<< "\n";  // TODO
-    auto &nameVec = names[component->name];
-    auto compIt = std::find(nameVec.begin(), nameVec.end(), component);
-    if (compIt != nameVec.end())
-        nameVec.erase(compIt);
+    logAt(Verbosity::Verbose) << "remove component " <<component->name
+        << "\n";
+    auto nameIt = names.find(component->name);
+    if (nameIt == names.end())
+        return;
+    auto &nameVec = nameIt->second;
+    uint32_t index = component->_nameIndex;
+    if (index >= nameVec.size() || nameVec[index] != component)
+        return;
+    // order doesn't matter, move the last one into its place
+    nameVec[index] = nameVec.back();
+    nameVec[index]->_nameIndex = index;
+    nameVec.pop_back();
+    component->_nameIndex = NOT_INDEXED;
+    if (nameVec.empty()) {
+        const string &name = nameIt->first;
+        sortedNames.erase(name);
+        reversedNames.erase(string(name.rbegin(), name.rend()));
+        names.erase(nameIt);
+    }
+}
+
+void World::collectHierarchy(Component *component, World *world,
+                             vector<Component *> &list)
+{
+    component->_world = world;
+    list.push_back(component);
+    for (auto &child : component->children())
+        collectHierarchy(child, world, list);
 }
 
 void World::addHierarchy(Component *component)
 {
-    addComponent(component);
-    for (auto &child : component->children()) {
-        addHierarchy(child);
+    if (batchDepth > 0) {
+        collectHierarchy(component, this, pendingAdds);
+        return;
     }
+    indexHierarchy(component);
+    patternCache.clear();
+    _changeCount++;
+    _structureChanges++;
 }
 
 void World::removeHierarchy(Component *component)
 {
-    removeComponent(component);
-    for (auto &child : component->children()) {
-        removeHierarchy(child);
+    if (batchDepth > 0) {
+        collectHierarchy(component, nullptr, pendingRemoves);
+        return;
+    }
+    unindexHierarchy(component);
+    patternCache.clear();
+    _changeCount++;
+    _structureChanges++;
+}
+
+void World::indexHierarchy(Component *component)
+{
+    component->_world = this;
+    if (component->_nameIndex == NOT_INDEXED)
+        addComponent(component);
+    for (auto &child : component->children())
+        indexHierarchy(child);
+}
+
+void World::unindexHierarchy(Component *component)
+{
+    component->_world = nullptr;
+    if (component->_nameIndex != NOT_INDEXED)
+        removeComponent(component);
+    for (auto &child : component->children())
+        unindexHierarchy(child);
+}
+
+void World::applyPending()
+{
+    if (pendingAdds.empty() && pendingRemoves.empty())
+        return;
+    // components could have moved again since, so check where they ended up
+    for (auto component : pendingRemoves) {
+        if (component->_nameIndex != NOT_INDEXED && component->world() != this)
+            removeComponent(component);
     }
+    for (auto component : pendingAdds) {
+        if (component->_nameIndex == NOT_INDEXED && component->world() == this)
+            addComponent(component);
+    }
+    pendingAdds.clear();
+    pendingRemoves.clear();
+    patternCache.clear();
+    _changeCount++;
+    _structureChanges++;
+}
+
+void World::componentMoved(Component *component)
+{
+    if (moveLog.size() >= MAX_MOVE_LOG) {
+        // forget the older half, so copies that keep up never rebuild
+        size_t half = moveLog.size() / 2;
+        moveLog.erase(moveLog.begin(), moveLog.begin() + half);
+        moveLogStart += half;
+    }
+    moveLog.push_back(component);
+    _changeCount++;
+}
+
+uint64_t World::changeCount() const
+{
+    return _changeCount;
+}
+
+uint64_t World::structureChanges() const
+{
+    return _structureChanges;
+}
+
+uint64_t World::moveCount() const
+{
+    return moveLogStart + moveLog.size();
+}
+
+bool World::movedSince(uint64_t since, vector<Component *> *moved) const
+{
+    if (since < moveLogStart || since > moveCount())
+        return false;
+    moved->insert(moved->end(), moveLog.begin() + (since - moveLogStart),
+                  moveLog.end());
+    return true;
 }
 
 Component * World::findComponent(string glob) const
 {
-    findComponents(glob, [](Component &c){
-        return &c;
-    });
-    return nullptr;
+    Matches matches = match(glob);
+    return matches->empty() ? nullptr : matches->front();
+}
+
+World::Matches World::match(const string &glob) const
+{
+    static const vector<Component *> NONE;
+    size_t first = glob.find_first_of("*?");
+    if (first == string::npos) {
+        auto nameIt = names.find(glob);
+        // aliasing an empty owner, so nothing is allocated or freed
+        return Matches(Matches(),
+                       nameIt != names.end() ? &nameIt->second : &NONE);
+    }
+
+    auto cacheIt = patternCache.find(glob);
+    if (cacheIt != patternCache.end())
+        return cacheIt->second;
+    if (patternCache.size() >= MAX_CACHED_PATTERNS)
+        patternCache.clear();
+    auto matches = std::make_shared<vector<Component *>>();
+    auto addMatches = [&](const NameEntry &entry) {
+        if (globMatch(glob.c_str(), entry.first.c_str())) {
+            matches->insert(matches->end(),
+                            entry.second.begin(), entry.second.end());
+        }
+    };
+
+    // use the longer of the literal prefix and suffix to narrow it down
+    string prefix = glob.substr(0, first);
+    string suffix(glob.rbegin(), glob.rbegin() + (glob.size() - 1
+        - glob.find_last_of("*?")));  // reversed
+    if (!prefix.empty() && prefix.size() >= suffix.size()) {
+        for (auto it = sortedNames.lower_bound(prefix);
+                it != sortedNames.end() && startsWith(it->first, prefix); it++)
+            addMatches(*it->second);
+    } else if (!suffix.empty()) {
+        for (auto it = reversedNames.lower_bound(suffix);
+                it != reversedNames.end() && startsWith(it->first, suffix);
+                it++)
+            addMatches(*it->second);
+    } else {
+        for (auto &entry : names)
+            addMatches(entry);
+    }
+    patternCache[glob] = matches;
+    return matches;
 }
 
 }  // namespace
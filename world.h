@@ -2,51 +2,145 @@
 #include "common.h"
 
 #include "component.h"
+#include <map>
+#include <memory_resource>
+#include <new>
 #include <unordered_map>
 
 namespace diorama {
 
 class World {
 public:
+    World() = default;
+    ~World();
+
     // takes ownership
     void addResource(const Resource *resource);
 
+    // Components and resources created by the world live in its arena and
+    // are destroyed together in a flat pass, not by their parents, so don't
+    // delete them. They aren't added to the world until they're in the
+    // hierarchy under root.
+    Component * createComponent();
+    Component * createComponent(const Component &other);  // copy
+
+    template<typename T>
+    T * createResource()
+    {
+        void *memory = arena.allocate(sizeof(T), alignof(T));
+        T *resource = new(memory) T;
+        arenaResources.push_back(resource);
+        return resource;
+    }
+
+    // destroy the hierarchy and all resources, for unloading a map
+    void clear();
+    // incremented by clear(). the next map's components and resources can
+    // reuse the old addresses, so copies of the world that keep pointers
+    // must drop them when this changes
+    uint64_t generation() const;
+
     Component * root() const;
-    // takes ownership
+    // takes ownership (or only references components created by the world)
     void setRoot(Component *root);
 
-    // called by Component
+    // Defers name index updates while alive, applying them in one pass when
+    // the outermost batch ends. Lookups see the old index until then.
+    // Components removed during a batch must stay alive until it ends, so
+    // don't replace a root that isn't in the arena.
+    class Batch : noncopyable
+    {
+    public:
+        explicit Batch(World *world);
+        ~Batch();
+
+    private:
+        World *world;
+    };
+
+    // called by Component when a hierarchy enters or leaves the world. these
+    // set the world of every component in it, in the same pass as indexing
     void addHierarchy(Component *component);
     void removeHierarchy(Component *component);
+    void componentMoved(Component *component);
+
+    // incremented when components are added, removed or moved, so copies of
+    // the world (like CollisionScene) know when to rebuild
+    uint64_t changeCount() const;
+    // incremented when components are added or removed, but not moved
+    uint64_t structureChanges() const;
+    // components moved so far, counting repeats
+    uint64_t moveCount() const;
+    // appends components moved since moveCount() returned since, oldest
+    // first and possibly repeated, so copies of the world can update only
+    // those (and their children). false if some have been forgotten, since
+    // only the last MAX_MOVE_LOG are kept, then copies should rebuild
+    bool movedSince(uint64_t since, vector<Component *> *moved) const;
+
+    static const size_t MAX_MOVE_LOG = 4096;
 
-    Component * findComponent(string glob) const;
+    // glob can use * for any characters and ? for one character. Patterns
+    // with a literal prefix or suffix only look at names that have it, and
+    // results are cached until components are added or removed, so this is
+    // not thread safe. f shouldn't add or remove components, but can do
+    // other lookups, the matches it's called for are kept alive.
+    Component * findComponent(string glob) const;  // null if none
 
     // functor should have the form f(Component &)
     template<typename Functor>
     bool findComponents(string glob, Functor f) const
     {
-        // TODO support wildcards
-        bool found = false;
-        auto vecIt = names.find(glob);
-        if (vecIt != names.end()) {
-            for (auto component : vecIt->second) {
-                found = true;
-                f(*component);
-            }
-        }
-        return found;
+        Matches matches = match(glob);
+        for (auto component : *matches)
+            f(*component);
+        return !matches->empty();
     }
 
 private:
+    using NameEntry = std::pair<const string, vector<Component *>>;
+    // cached pattern results are shared, so evicting them doesn't free a
+    // list that's being iterated. exact names point into names without
+    // owning it
+    using Matches = shared_ptr<const vector<Component *>>;
+
     void addComponent(Component *component);
     void removeComponent(Component *component);
+    static void collectHierarchy(Component *component, World *world,
+                                 vector<Component *> &list);
+    void indexHierarchy(Component *component);
+    void unindexHierarchy(Component *component);
+    void applyPending();
+    // invalidated by adding or removing components
+    Matches match(const string &glob) const;
 
     vector<unique_ptr<const Resource>> _resources;
 
-    unique_ptr<Component> _root;
+    std::pmr::monotonic_buffer_resource arena;
+    // in order of creation
+    vector<Component *> arenaComponents;
+    vector<const Resource *> arenaResources;
+
+    Component *_root = nullptr;
 
-    // map component name to list of components with that name
+    uint64_t _generation = 0;
+    uint64_t _changeCount = 0;
+    uint64_t _structureChanges = 0;
+    // moves numbered from moveLogStart
+    vector<Component *> moveLog;
+    uint64_t moveLogStart = 0;
+
+    // map component name to list of components with that name, in any
+    // order. Component::_nameIndex is the position in the list
     std::unordered_map<string, vector<Component *>> names;
+    // entries in names, by name and by reversed name, for prefix and suffix
+    // patterns
+    std::map<string, const NameEntry *> sortedNames;
+    std::map<string, const NameEntry *> reversedNames;
+    mutable std::unordered_map<string, Matches> patternCache;
+
+    int batchDepth = 0;
+    // every component in hierarchies added or removed during a batch
+    vector<Component *> pendingAdds, pendingRemoves;
 };
 
 